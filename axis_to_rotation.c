@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * Create a rotation matrix that takes a given direction to the +Z axis,
+ * directly from the direction vector.
+ *
+ * This is the same rotation as
+ *	vector_to_angles (vec, &phi, &theta);
+ *	make_rotation_matrix (theta, phi, 0., rmat);
+ * gives: first turn by theta about Z, to bring the direction into the
+ * Y-Z plane, then by phi about X. But the sines and cosines of theta and
+ * phi are simply ratios of the components of vec, so no trigonometry is
+ * needed, and the searches can afford it for every trial axis.
+ *
+ * Input:
+ *	vec is a non-zero (X,Y,Z) vector; it need not be of unit length.
+ *
+ * Output:
+ *	rmat is the 3x3 rotation matrix. As for any rotation to canonical
+ *	orientation, rmat[k], rmat[3+k], rmat[6+k] is the direction taken to
+ *	the k'th coordinate axis; for k = 2 that is vec, normalized.
+ */
+
+void
+axis_to_rotation (FLT_DBL * vec, FLT_DBL * rmat)
+{
+double          len, horiz;
+double          cos_theta, sin_theta, cos_phi, sin_phi;
+
+    horiz = sqrt (vec[0] * vec[0] + vec[1] * vec[1]);
+    len = sqrt (horiz * horiz + vec[2] * vec[2]);
+
+    /* Straight up or down, theta is 0 (as vector_to_angles has it). */
+    if (horiz > 0.)
+    {
+	sin_theta = vec[0] / horiz;
+	cos_theta = vec[1] / horiz;
+    }
+    else
+    {
+	sin_theta = 0.;
+	cos_theta = 1.;
+    }
+    sin_phi = horiz / len;
+    cos_phi = vec[2] / len;
+
+    RMAT (0, 0) = cos_theta;
+    RMAT (0, 1) = sin_theta * cos_phi;
+    RMAT (0, 2) = sin_theta * sin_phi;
+
+    RMAT (1, 0) = -sin_theta;
+    RMAT (1, 1) = cos_theta * cos_phi;
+    RMAT (1, 2) = cos_theta * sin_phi;
+
+    RMAT (2, 0) = 0.;
+    RMAT (2, 1) = -sin_phi;
+    RMAT (2, 2) = cos_phi;
+
+    return;
+}
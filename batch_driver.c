@@ -0,0 +1,1324 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * What titest and orthotest share: the command-line options they have in
+ * common, and the runs over many matrices, --batch, --serve, and
+ * --volume. Each
+ * program only says, in a struct batch_program (see cmat.h), which
+ * symmetry it fits, what the fields it can output are called, and how to
+ * work them out from the answers.
+ *
+ * A batch run is read, searched, and written a chunk of BATCH_CHUNK
+ * matrices at a time, each stage in a thread of its own (see
+ * batch_pipeline.c). With --checkpoint, the checkpoint (see checkpoint.c)
+ * holds BATCH_CKPT_SIZE bytes: the number of matrices written so far,
+ * then how many bytes of output that came to, both as longs. A volume
+ * run's checkpoint is laid out by volume.c (see volume_checkpoint_size).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "cmat.h"
+
+#define BATCH_CKPT_SIZE	(2 * sizeof (long))
+
+/*
+ * With --checkpoint, how many points of a volume are solved between
+ * looks at whether the checkpoint is due
+ */
+#define VOLUME_EVERY	256
+
+/*
+ * What every chunk of a batch run shares.
+ */
+struct batch_run
+{
+    struct batch_program *prog;
+    struct search_opts *opts;
+    struct result_cache *cache;
+    int             format;
+    int             chosen[OUTPUT_FIELDS_MAX];
+    int             compliance;	/* are the matrices read compliances? */
+    long            nread;	/* matrices read so far */
+    struct run_summary *summary;	/* to summarize the answers in */
+    long            nwritten;	/* matrices written (or summarized) so far */
+    struct checkpoint *ckpt;	/* to keep nwritten in, if not null */
+    struct telemetry *tel;	/* to time the stages with, if not null */
+};
+
+/*
+ * --serve: what serve_answer needs.
+ */
+struct batch_serve
+{
+    struct batch_run *run;
+    struct batch_chunk *chunk;
+};
+
+/*
+ * Parse the value of --budget: a number of distance evaluations, or a
+ * number of milliseconds followed by "ms".
+ */
+static int
+batch_budget (char *arg, struct search_opts *opts)
+{
+double          value;
+char            unit[3];
+int             nn;
+
+    nn = sscanf (arg, "%lf%2s", &value, unit);
+    if (nn == 1 && value >= 1.)
+    {
+	opts->max_evals = (long) value;
+	return 1;
+    }
+    if (nn == 2 && strcmp (unit, "ms") == 0 && value > 0.)
+    {
+	opts->max_seconds = value / 1000.;
+	return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Take one command-line option. Return 1 if it is one of ours, else 0.
+ * --cone and --box are only for FIT_TI.
+ */
+static int
+batch_option (struct batch_program *prog, struct batch_options *bo,
+	      char *arg)
+{
+double          val[4];
+char            junk;
+
+    if (strcmp (arg, "--group") == 0)
+	bo->group = 1;
+    else if (strcmp (arg, "--batch") == 0)
+	bo->batch = 1;
+    else if (strcmp (arg, "--serve") == 0)
+	bo->serve = 1;
+    else if (strcmp (arg, "--summary") == 0)
+	bo->zone_size = 0;
+    else if (sscanf (arg, "--summary=%ld", &bo->zone_size) == 1 &&
+	     bo->zone_size > 0)
+	return 1;
+    else if (sscanf (arg, "--volume=%d,%d,%d",
+		     bo->dims, bo->dims + 1, bo->dims + 2) == 3 &&
+	     bo->dims[0] > 0 && bo->dims[1] > 0 && bo->dims[2] > 0)
+	bo->volume = 1;
+    else if (strncmp (arg, "--serve=", 8) == 0 && arg[8] != '\0')
+    {
+	bo->serve = 1;
+	bo->serve_path = arg + 8;
+    }
+    else if (strncmp (arg, "--output=", 9) == 0 && arg[9] != '\0')
+	bo->output_path = arg + 9;
+    else if (strncmp (arg, "--checkpoint=", 13) == 0 && arg[13] != '\0')
+	bo->ckpt_path = arg + 13;
+    else if (strcmp (arg, "--progress") == 0)
+	bo->interval = 10.;
+    else if (sscanf (arg, "--progress=%lf", &bo->interval) == 1 &&
+	     bo->interval > 0.)
+	return 1;
+    else if (strncmp (arg, "--trace=", 8) == 0 && arg[8] != '\0')
+	bo->trace_path = arg + 8;
+    else if (strcmp (arg, "--upper") == 0)
+    {
+	bo->layout = READ_UPPER;
+	read_matrix_layout (bo->layout);
+    }
+    else if (strcmp (arg, "--compliance") == 0)
+	bo->compliance = 1;
+    else if (strcmp (arg, "--compliance=both") == 0)
+    {
+	bo->compliance = 1;
+	bo->compliance_out = 1;
+    }
+    else if (strncmp (arg, "--format=", 9) == 0 &&
+	     output_format (arg + 9) >= 0)
+	bo->format = output_format (arg + 9);
+    else if (strncmp (arg, "--fields=", 9) == 0)
+	bo->fields = arg + 9;
+    else if (sscanf (arg, "--threads=%d", &bo->nthreads) == 1 &&
+	     bo->nthreads > 0)
+	return 1;
+    else if (sscanf (arg, "--threshold=%lf%c", val, &junk) == 1 &&
+	     val[0] >= 0.)
+	bo->threshold = val[0];
+    else if (strcmp (arg, "--cache") == 0)
+	bo->cached = 1;
+    else if (strncmp (arg, "--cache=", 8) == 0 && arg[8] != '\0')
+    {
+	bo->cached = 1;
+	bo->cache_path = arg + 8;
+    }
+    else if (sscanf (arg, "--quantize=%lf", val) == 1 && val[0] > 0.)
+    {
+	bo->cached = 1;
+	bo->quantum = val[0];
+    }
+    else if (strncmp (arg, "--budget=", 9) == 0 &&
+	     batch_budget (arg + 9, &bo->opts))
+	return 1;
+    else if (sscanf (arg, "--axis=%lf,%lf", val, val + 1) == 2)
+    {
+	bo->opts.domain = SEARCH_AXIS;
+	bo->opts.theta = val[0];
+	bo->opts.phi = val[1];
+    }
+    else if (prog->symmetry == FIT_TI &&
+	     sscanf (arg, "--cone=%lf,%lf,%lf", val, val + 1, val + 2) == 3)
+    {
+	bo->opts.domain = SEARCH_CONE;
+	bo->opts.theta = val[0];
+	bo->opts.phi = val[1];
+	bo->opts.max_dev = val[2];
+    }
+    else if (prog->symmetry == FIT_TI &&
+	     sscanf (arg, "--box=%lf,%lf,%lf,%lf",
+		     val, val + 1, val + 2, val + 3) == 4)
+    {
+	bo->opts.domain = SEARCH_BOX;
+	bo->opts.theta_min = val[0];
+	bo->opts.theta_max = val[1];
+	bo->opts.phi_min = val[2];
+	bo->opts.phi_max = val[3];
+    }
+    else
+	return 0;
+
+    return 1;
+}
+
+/*
+ * Say how the program is run.
+ */
+static void
+batch_usage (struct batch_program *prog)
+{
+    fprintf (stderr, "Usage: %s [--group | --batch | "
+	     "--threshold=percent |\n"
+	     "       --serve[=socket] | --volume=n1,n2,n3]\n"
+	     "       [--summary[=zone_size]]\n"
+	     "       [--output=file] [--checkpoint=file]\n"
+	     "       [--progress[=seconds]] [--trace=file]\n"
+	     "       [--upper] [--compliance[=both]] "
+	     "[--cache[=file]] [--quantize=q]\n"
+	     "       [--threads=N] [--format=text|csv|json|binary] "
+	     "[--fields=name,...]\n"
+	     "       [--budget=N | --budget=Nms]\n", prog->name);
+    if (prog->symmetry == FIT_TI)
+	fprintf (stderr,
+		 "       [--axis=theta,phi | --cone=theta,phi,max_dev |\n"
+		 "       --box=theta_min,theta_max,phi_min,phi_max] "
+		 "< elastic_constants\n");
+    else
+	fprintf (stderr, "       [--axis=theta,phi] < elastic_constants\n");
+
+    return;
+}
+
+/*
+ * Check that the options go together. Return 0 if they do, else -1
+ * after saying why not.
+ */
+static int
+batch_check (struct batch_program *prog, struct batch_options *bo)
+{
+const char     *name = prog->name;
+struct search_opts *opts = &bo->opts;
+int             searching;
+
+    searching = opts->domain != SEARCH_ALL || search_budgeted (opts);
+
+    if (bo->threshold >= 0.)
+    {
+	if (bo->group || bo->batch || bo->serve || bo->volume || bo->cached ||
+	    bo->compliance || bo->zone_size >= 0 || searching)
+	{
+	    fprintf (stderr, "%s: --threshold can't be combined with other "
+		     "options\n", name);
+	    return -1;
+	}
+	return 0;
+    }
+    if ((bo->format != OUTPUT_TEXT || bo->fields != (char *) 0) &&
+	!bo->batch && !bo->serve && !bo->volume)
+    {
+	fprintf (stderr, "%s: --format and --fields only go with --batch, "
+		 "--serve, or --volume\n", name);
+	return -1;
+    }
+    if (bo->zone_size >= 0 && ((!bo->batch && !bo->volume) ||
+			       bo->format != OUTPUT_TEXT ||
+			       bo->fields != (char *) 0))
+    {
+	fprintf (stderr, "%s: --summary only goes with --batch or --volume, "
+		 "without --format or --fields\n", name);
+	return -1;
+    }
+    if (bo->volume && (bo->group || bo->batch || bo->serve ||
+		       bo->nthreads > 0 || bo->cached || searching))
+    {
+	fprintf (stderr, "%s: --volume can't be combined with --group, "
+		 "--batch, --serve, --threads, --cache, or search options\n",
+		 name);
+	return -1;
+    }
+    if (bo->serve && (bo->group || bo->batch || bo->nthreads > 0 ||
+		      bo->compliance || bo->format == OUTPUT_CSV))
+    {
+	fprintf (stderr, "%s: --serve can't be combined with --group, "
+		 "--batch, --threads, --compliance, or --format=csv\n", name);
+	return -1;
+    }
+    if (bo->nthreads > 0 && !bo->batch)
+    {
+	fprintf (stderr, "%s: --threads only goes with --batch\n", name);
+	return -1;
+    }
+    if ((bo->interval > 0. || bo->trace_path != (char *) 0) && !bo->batch)
+    {
+	fprintf (stderr, "%s: --progress and --trace only go with --batch\n",
+		 name);
+	return -1;
+    }
+    if ((bo->output_path != (char *) 0 || bo->ckpt_path != (char *) 0) &&
+	!bo->batch && !bo->volume)
+    {
+	fprintf (stderr, "%s: --output and --checkpoint only go with "
+		 "--batch or --volume\n", name);
+	return -1;
+    }
+    if (bo->ckpt_path != (char *) 0 && bo->batch &&
+	(bo->output_path == (char *) 0 || bo->zone_size >= 0))
+    {
+	fprintf (stderr, "%s: --checkpoint with --batch needs --output, "
+		 "and can't be combined with --summary\n", name);
+	return -1;
+    }
+    if (bo->fields != (char *) 0 && bo->format == OUTPUT_TEXT && !bo->serve)
+    {
+	fprintf (stderr, "%s: --fields needs --format\n", name);
+	return -1;
+    }
+    if (opts->domain == SEARCH_CONE && opts->max_dev < 0.)
+    {
+	fprintf (stderr, "%s: --cone needs a max_dev of at least 0\n", name);
+	return -1;
+    }
+    if (opts->domain == SEARCH_BOX &&
+	(opts->phi_min < 0. || opts->phi_max > 90. ||
+	 opts->phi_min > opts->phi_max ||
+	 fabs (opts->theta_max - opts->theta_min) > 360.))
+    {
+	fprintf (stderr, "%s: --box needs 0 <= phi_min <= phi_max <= 90, "
+		 "and theta_min and theta_max\n"
+		 "       no more than 360 apart\n", name);
+	return -1;
+    }
+    if (bo->cached && ((!bo->batch && !bo->serve) || searching))
+    {
+	fprintf (stderr, "%s: --cache and --quantize only go with "
+		 "--batch or --serve, without search options\n", name);
+	return -1;
+    }
+    if (bo->group && searching)
+    {
+	fprintf (stderr, "%s: --group can't be combined with search options\n",
+		 name);
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Read the command-line options, and check that they go together.
+ *
+ * Input:
+ *	prog is the program (see cmat.h).
+ *	argc and argv are main's.
+ *
+ * Output:
+ *	bo is the options, starting from their defaults.
+ *
+ * Return value:
+ *	0, or -1 (after saying why) if there is an option that isn't
+ *	known, or the options don't go together.
+ */
+int
+batch_parse (struct batch_program *prog, struct batch_options *bo,
+	     int argc, char **argv)
+{
+int             ii;
+
+    search_defaults (&bo->opts);
+    bo->group = 0;
+    bo->batch = 0;
+    bo->serve = 0;
+    bo->serve_path = (char *) 0;
+    bo->volume = 0;
+    bo->threshold = -1.;
+    bo->zone_size = -1;
+    bo->output_path = (char *) 0;
+    bo->ckpt_path = (char *) 0;
+    bo->interval = 0.;
+    bo->trace_path = (char *) 0;
+    bo->layout = READ_FULL;
+    bo->compliance = 0;
+    bo->compliance_out = 0;
+    bo->format = OUTPUT_TEXT;
+    bo->fields = (char *) 0;
+    bo->nthreads = 0;
+    bo->cached = 0;
+    bo->cache_path = (char *) 0;
+    bo->quantum = 0.;
+
+    for (ii = 1; ii < argc; ii++)
+    {
+	if (!batch_option (prog, bo, argv[ii]))
+	{
+	    fprintf (stderr, "%s: unknown option \"%s\"\n", prog->name,
+		     argv[ii]);
+	    batch_usage (prog);
+	    return -1;
+	}
+    }
+
+    return batch_check (prog, bo);
+}
+
+/*
+ * Read packed stiffness matrices until the input runs out. Return them,
+ * with their number in ncc, or a null pointer (after saying why) if there
+ * are none, or the input is bad, or there isn't room.
+ */
+FLT_DBL        *
+batch_read_all (struct batch_program *prog, int *ncc)
+{
+int             nalloc, status;
+FLT_DBL        *ccs;
+
+    *ncc = 0;
+    nalloc = 64;
+    status = 0;
+    ccs = (FLT_DBL *) malloc (PACKED_SIZE * nalloc * sizeof (FLT_DBL));
+    while (ccs != (FLT_DBL *) 0 &&
+	   (status = read_matrix_packed (ccs + PACKED_SIZE * *ncc)) > 0)
+    {
+	if (++*ncc == nalloc)
+	{
+	    nalloc *= 2;
+	    ccs = (FLT_DBL *) realloc (ccs, PACKED_SIZE * nalloc *
+				       sizeof (FLT_DBL));
+	}
+    }
+
+    if (ccs == (FLT_DBL *) 0)
+    {
+	fprintf (stderr, "%s: out of memory\n", prog->name);
+	return ccs;
+    }
+    if (status < 0 || *ncc == 0)
+    {
+	if (status == 0)
+	    fprintf (stderr, "%s: no input matrices\n", prog->name);
+	free (ccs);
+	return (FLT_DBL *) 0;
+    }
+
+    return ccs;
+}
+
+/*
+ * --compliance: the ncc packed matrices ccs, the first + 1st onwards of
+ * the input, were read in as compliances. Turn them into stiffnesses,
+ * warning about any that aren't positive definite, as no physical medium's
+ * compliances can be.
+ */
+void
+batch_compliance (struct batch_program *prog, int ncc, FLT_DBL * ccs,
+		  long first)
+{
+int             posdef[BATCH_CHUNK];
+int             nn, kk, nbatch;
+
+    for (nn = 0; nn < ncc; nn += nbatch)
+    {
+	nbatch = (ncc - nn < BATCH_CHUNK) ? ncc - nn : BATCH_CHUNK;
+	if (invert_packed_batch (nbatch, ccs + PACKED_SIZE * nn,
+				 ccs + PACKED_SIZE * nn, posdef) == 0)
+	    continue;
+	for (kk = 0; kk < nbatch; kk++)
+	    if (posdef[kk] <= 0)
+		fprintf (stderr, "%s: matrix %ld: the compliance matrix "
+			 "is %s\n", prog->name, first + nn + kk + 1,
+			 (posdef[kk] < 0) ? "singular" :
+			 "not positive definite");
+    }
+
+    return;
+}
+
+/*
+ * Which fields to output, from the list given with --fields (or the
+ * default ones, if there wasn't one). Fill in order as for output_fields,
+ * and return how many there are, or -1 if the list is bad.
+ */
+static int
+batch_choose (struct batch_program *prog, struct search_opts *opts,
+	      char *fields, int *order)
+{
+int             ii, nchosen;
+
+    if (fields != (char *) 0)
+    {
+	nchosen = output_fields (fields, prog->nfield, prog->fields, order);
+	if (nchosen < 0)
+	    return -1;
+	for (ii = 0; ii < nchosen; ii++)
+	{
+	    if (order[ii] >= prog->nfield - prog->nbudget &&
+		!search_budgeted (opts))
+	    {
+		fprintf (stderr, "%s: field \"%s\" needs --budget\n",
+			 prog->name, prog->fields[order[ii]]);
+		return -1;
+	    }
+	}
+	return nchosen;
+    }
+
+    nchosen = prog->ndefault;
+    if (search_budgeted (opts))
+    {
+	for (ii = 0; ii < prog->nbudget; ii++)
+	    order[nchosen++] = prog->nfield - prog->nbudget + ii;
+    }
+    for (ii = 0; ii < prog->ndefault; ii++)
+	order[ii] = ii;
+
+    return nchosen;
+}
+
+/*
+ * Set up run, with the fields to work out: those in order (nchosen of
+ * them), or the default ones for plain text.
+ */
+static void
+batch_start (struct batch_run *run, struct batch_program *prog,
+	     struct search_opts *opts, int format, int nchosen, int *order)
+{
+int             ii;
+
+    run->prog = prog;
+    run->opts = opts;
+    run->cache = (struct result_cache *) 0;
+    run->format = format;
+    run->compliance = 0;
+    run->nread = 0;
+    run->summary = (struct run_summary *) 0;
+    run->nwritten = 0;
+    run->ckpt = (struct checkpoint *) 0;
+    run->tel = (struct telemetry *) 0;
+    for (ii = 0; ii < prog->nfield; ii++)
+	run->chosen[ii] = (format == OUTPUT_TEXT && ii < prog->ndefault);
+    if (format != OUTPUT_TEXT)
+	for (ii = 0; ii < nchosen; ii++)
+	    run->chosen[order[ii]] = 1;
+
+    return;
+}
+
+/*
+ * The value of every chosen field for matrix nn of a chunk.
+ */
+static void
+batch_values (struct batch_run *run, struct batch_chunk *ch, int nn,
+	      double *values)
+{
+int             first;
+
+    run->prog->values (run->chosen, ch, nn, values);
+    if (search_budgeted (run->opts))
+    {
+	first = run->prog->nfield - run->prog->nbudget;
+	values[first] = (double) ch->nevals[nn];
+	values[first + 1] = ch->resolution[nn];
+	values[first + 2] = ch->converged[nn];
+    }
+
+    return;
+}
+
+/*
+ * The stages of batch_mode. Read in the next chunk of matrices.
+ */
+static int
+batch_read (void *data, void *chunk)
+{
+struct batch_run *run = (struct batch_run *) data;
+struct batch_chunk *ch = (struct batch_chunk *) chunk;
+int             status;
+double          start;
+
+    start = (run->tel != (struct telemetry *) 0) ? telemetry_clock () : 0.;
+    status = 1;
+    for (ch->ncc = 0; ch->ncc < BATCH_CHUNK; ch->ncc++)
+    {
+	status = read_matrix_packed (ch->ccs + PACKED_SIZE * ch->ncc);
+	if (status <= 0)
+	    break;
+    }
+
+    if (run->compliance)
+	batch_compliance (run->prog, ch->ncc, ch->ccs, run->nread);
+    run->nread += ch->ncc;
+    if (run->tel != (struct telemetry *) 0)
+	telemetry_span (run->tel, STAGE_PARSE, start, ch->ncc);
+
+    if (status < 0)
+	return -1;
+    return (ch->ncc == BATCH_CHUNK) ? 1 : 0;
+}
+
+/*
+ * Are any of the per-axis TI distances (for FIT_ORTHO) to be output?
+ */
+static int
+batch_tidist (struct batch_run *run)
+{
+int             field = run->prog->tidist_field;
+
+    return field >= 0 && (run->chosen[field] || run->chosen[field + 1] ||
+			  run->chosen[field + 2]);
+}
+
+/*
+ * Find the answers for a chunk. This may run in several threads at once,
+ * so each search gets its own copy of the options to keep count in.
+ */
+static int
+batch_compute (void *data, void *chunk)
+{
+struct batch_run *run = (struct batch_run *) data;
+struct batch_chunk *ch = (struct batch_chunk *) chunk;
+int             ortho = (run->prog->symmetry == FIT_ORTHO);
+struct search_opts opts;
+int             nn, ii, status, ntimed;
+double          start;
+
+    /*
+     * The batched scan is of every orientation. A restricted search is
+     * cheap enough to do one matrix at a time, and with a fixed axis
+     * there is no scan to share. Only the batched searches can tell their
+     * scan from their refinement; the others are timed as refinement
+     * throughout.
+     */
+    ntimed = ch->ncc;
+    start = (run->tel != (struct telemetry *) 0) ? telemetry_clock () : 0.;
+    if (run->cache != (struct result_cache *) 0)
+    {
+	if (ortho)
+	    status = find_ortho_cached (run->cache, ch->ncc, ch->ccs,
+					ch->rmat, ch->dist_best);
+	else
+	    status = find_ti_cached (run->cache, ch->ncc, ch->ccs,
+				     ch->theta_best, ch->phi_best,
+				     ch->dist_best);
+	if (status < 0)
+	{
+	    fprintf (stderr, "%s: out of memory\n", run->prog->name);
+	    return -1;
+	}
+    }
+    else if (run->opts->domain == SEARCH_ALL && !search_budgeted (run->opts))
+    {
+	if (ortho)
+	    find_ortho_timed (ch->ncc, ch->ccs, ch->rmat, ch->dist_best,
+			      run->tel);
+	else
+	    find_ti_timed (ch->ncc, ch->ccs, ch->theta_best, ch->phi_best,
+			   ch->dist_best, run->tel);
+	if (!batch_tidist (run))
+	    return 0;
+	/* Those matrices are counted already; this is only extra time. */
+	ntimed = 0;
+	start = (run->tel != (struct telemetry *) 0) ?
+	 telemetry_clock () : 0.;
+    }
+    else
+    {
+	for (nn = 0; nn < ch->ncc; nn++)
+	{
+	    opts = *run->opts;
+	    if (ortho)
+	    {
+		ch->dist_best[nn] =
+		 search_ortho (rotated_ortho_distance, rotated_ti_distance,
+			       (void *) (ch->ccs + PACKED_SIZE * nn), &opts,
+			       ch->rmat + 9 * nn);
+		for (ii = 0; ii < 3; ii++)
+		    ch->axis_dist[3 * nn + ii] = opts.axis_dist[ii];
+	    }
+	    else
+		ch->dist_best[nn] =
+		 search_ti (rotated_ti_distance,
+			    (void *) (ch->ccs + PACKED_SIZE * nn), &opts,
+			    ch->theta_best + nn, ch->phi_best + nn);
+	    ch->nevals[nn] = opts.nevals;
+	    ch->resolution[nn] = opts.resolution;
+	    ch->converged[nn] = opts.converged;
+	}
+	if (run->tel != (struct telemetry *) 0)
+	    telemetry_span (run->tel, STAGE_REFINE, start, ch->ncc);
+	return 0;
+    }
+
+    /* The batched searches don't leave the per-axis TI distances. */
+    if (batch_tidist (run))
+	for (nn = 0; nn < ch->ncc; nn++)
+	    ortho_axis_distances (ch->ccs + PACKED_SIZE * nn,
+				  ch->rmat + 9 * nn, ch->axis_dist + 3 * nn);
+    if (run->tel != (struct telemetry *) 0)
+	telemetry_span (run->tel, STAGE_REFINE, start, ntimed);
+
+    return 0;
+}
+
+/*
+ * Bring the checkpoint up to date: once the answers written so far are
+ * on disk, how many there are, and where the output got to.
+ */
+static void
+batch_checkpoint (struct batch_run *run)
+{
+long            done[2];
+
+    if (run->format != OUTPUT_TEXT)
+	output_finish ();
+    done[0] = run->nwritten;
+    done[1] = checkpoint_tell ();
+    if (done[1] < 0 || checkpoint_sync (run->ckpt, 1) < 0 ||
+	checkpoint_write (run->ckpt, 0, done, BATCH_CKPT_SIZE) < 0)
+	fprintf (stderr, "%s: can't update the checkpoint\n",
+		 run->prog->name);
+
+    return;
+}
+
+/*
+ * Write out the answers for a chunk.
+ */
+static int
+batch_write (void *data, void *chunk)
+{
+struct batch_run *run = (struct batch_run *) data;
+struct batch_chunk *ch = (struct batch_chunk *) chunk;
+struct batch_program *prog = run->prog;
+int             nn, ii;
+double          values[OUTPUT_FIELDS_MAX];
+FLT_DBL         axis[3];
+double          start;
+
+    start = (run->tel != (struct telemetry *) 0) ? telemetry_clock () : 0.;
+    for (nn = 0; nn < ch->ncc; nn++)
+    {
+	batch_values (run, ch, nn, values);
+
+	if (run->summary != (struct run_summary *) 0)
+	{
+	    for (ii = 0; ii < 3; ii++)
+		axis[ii] = values[prog->axis_field + ii];
+	    if (summary_add (run->summary, run->nwritten + nn, values[0],
+			     axis) < 0)
+	    {
+		fprintf (stderr, "%s: out of memory\n", prog->name);
+		return -1;
+	    }
+	    continue;
+	}
+
+	if (run->format != OUTPUT_TEXT)
+	{
+	    output_record (values);
+	    continue;
+	}
+
+	for (ii = 0; ii < prog->ndefault; ii++)
+	    printf (prog->text[ii], values[ii]);
+	if (search_budgeted (run->opts))
+	    printf ("  %ld %.3g %d", ch->nevals[nn], ch->resolution[nn],
+		    ch->converged[nn]);
+	printf ("\n");
+    }
+
+    run->nwritten += ch->ncc;
+    if (run->ckpt != (struct checkpoint *) 0 && checkpoint_due (run->ckpt))
+	batch_checkpoint (run);
+    if (run->tel != (struct telemetry *) 0)
+    {
+	telemetry_span (run->tel, STAGE_OUTPUT, start, ch->ncc);
+	telemetry_progress (run->tel);
+    }
+
+    return 0;
+}
+
+/*
+ * --batch: read stiffness matrices until the input runs out, and output
+ * one line for each, with the fields the program gives. The matrices are
+ * processed BATCH_CHUNK at a time, so that the initial scans can be done
+ * together. If cache is not a null pointer, each distinct matrix is only
+ * searched once, and answers already in the cache are reused.
+ *
+ * With nthreads positive, chunks are read, searched (by nthreads threads
+ * at once), and written all at the same time; see batch_pipeline.c.
+ *
+ * With --compliance, the matrices read in are compliances, and each
+ * chunk is inverted as it is read.
+ *
+ * With summary, the answers are added to it (see summary.c) instead of
+ * being written out, and it is written out at the end.
+ *
+ * With --output, the answers are written to that file instead of
+ * standard output. With ckpt, how far the run has got is kept there
+ * every so often; if resumed, the run is being taken up again, so the
+ * matrices already written are skipped, and the output goes on from after
+ * them.
+ *
+ * With tel, each stage of the run is timed (see telemetry.c).
+ */
+static int
+batch_mode (struct batch_program *prog, struct batch_options *bo,
+	    struct result_cache *cache, int nthreads,
+	    struct run_summary *summary, struct checkpoint *ckpt,
+	    int resumed, struct telemetry *tel)
+{
+int             ii, nchosen, nchunk, status;
+long            done[2], nskip;
+FLT_DBL         ccp[PACKED_SIZE];
+int             order[OUTPUT_FIELDS_MAX];
+struct batch_run run;
+struct batch_stages stages;
+struct batch_chunk *chunks;
+void          **slots;
+
+    nchosen = 0;
+    if (bo->format != OUTPUT_TEXT)
+    {
+	nchosen = batch_choose (prog, &bo->opts, bo->fields, order);
+	if (nchosen < 0)
+	    return 1;
+    }
+
+    /* Enough chunks for the reader and writer to run ahead and behind */
+    nchunk = (nthreads > 0) ? 2 * (nthreads + 2) : 1;
+    chunks = (struct batch_chunk *) malloc (nchunk *
+					     sizeof (struct batch_chunk));
+    slots = (void **) malloc (nchunk * sizeof (void *));
+    if (chunks == (struct batch_chunk *) 0 || slots == (void **) 0)
+    {
+	fprintf (stderr, "%s: out of memory\n", prog->name);
+	free (chunks);
+	free (slots);
+	return 1;
+    }
+    for (ii = 0; ii < nchunk; ii++)
+	slots[ii] = (void *) (chunks + ii);
+
+    /* How many matrices were written, and how many bytes that came to */
+    done[0] = 0;
+    done[1] = -1;
+    if (resumed && checkpoint_read (ckpt, 0, done, BATCH_CKPT_SIZE) < 0)
+	done[0] = -1;
+    for (nskip = 0; nskip < done[0]; nskip++)
+	if (read_matrix_packed (ccp) <= 0)
+	    break;
+    if (done[0] < 0 || nskip < done[0] ||
+	(bo->output_path != (char *) 0 &&
+	 checkpoint_output (bo->output_path, done[1]) < 0))
+    {
+	if (done[0] < 0 || nskip < done[0])
+	    fprintf (stderr, "%s: the input doesn't go with the checkpoint\n",
+		     prog->name);
+	free (chunks);
+	free (slots);
+	return 1;
+    }
+    if (done[0] > 0)
+	fprintf (stderr, "%s: taking up the run again after %ld "
+		 "matrices\n", prog->name, done[0]);
+
+    if (bo->format != OUTPUT_TEXT && done[0] > 0)
+	output_continue (bo->format, prog->fields, nchosen, order);
+    else if (bo->format != OUTPUT_TEXT)
+	output_start (bo->format, prog->fields, nchosen, order);
+
+    /* Only work out what will be output. */
+    batch_start (&run, prog, &bo->opts, bo->format, nchosen, order);
+    run.cache = cache;
+    run.compliance = bo->compliance;
+    run.nread = done[0];
+    run.summary = summary;
+    run.nwritten = done[0];
+    run.ckpt = ckpt;
+    run.tel = tel;
+
+    /* Build the scan tables now, before there are threads to race for it */
+    if (nthreads > 0)
+    {
+	batch_scan_ti (0, (FLT_DBL *) 0, (FLT_DBL *) 0);
+	if (prog->symmetry == FIT_ORTHO)
+	    batch_scan_ortho (0, (FLT_DBL *) 0, (FLT_DBL *) 0);
+    }
+
+    stages.data = (void *) &run;
+    stages.read = batch_read;
+    stages.compute = batch_compute;
+    stages.write = batch_write;
+    status = batch_pipeline (&stages, nthreads, nchunk, slots);
+
+    if (bo->format != OUTPUT_TEXT)
+	output_finish ();
+    if (summary != (struct run_summary *) 0)
+	summary_print (summary, prog->what, prog->axis);
+
+    free (chunks);
+    free (slots);
+
+    /* Bad input stops the run, after the matrices before it are done. */
+    return status < 0;
+}
+
+/*
+ * Write out the answers volume_mode found, as batch_mode would, a chunk
+ * at a time: for each of the ncc packed matrices ccs, its orientation in
+ * orient (theta and phi for FIT_TI, the rotation matrix for FIT_ORTHO)
+ * and its distance in dist. Return 0, or 1 if there isn't room.
+ */
+static int
+batch_answers (struct batch_program *prog, struct batch_options *bo,
+	       struct run_summary *summary, int nchosen, int *order,
+	       int ncc, FLT_DBL * ccs, FLT_DBL * orient, FLT_DBL * dist)
+{
+int             ii, nn, status;
+struct batch_run run;
+struct batch_chunk *ch;
+
+    ch = (struct batch_chunk *) malloc (sizeof (struct batch_chunk));
+    if (ch == (struct batch_chunk *) 0)
+    {
+	fprintf (stderr, "%s: out of memory\n", prog->name);
+	return 1;
+    }
+
+    batch_start (&run, prog, &bo->opts, bo->format, nchosen, order);
+    run.summary = summary;
+    if (bo->format != OUTPUT_TEXT)
+	output_start (bo->format, prog->fields, nchosen, order);
+
+    status = 0;
+    for (nn = 0; status == 0 && nn < ncc; nn += ch->ncc)
+    {
+	ch->ncc = (ncc - nn < BATCH_CHUNK) ? ncc - nn : BATCH_CHUNK;
+	for (ii = 0; ii < ch->ncc; ii++)
+	{
+	    memcpy (ch->ccs + PACKED_SIZE * ii, ccs + PACKED_SIZE * (nn + ii),
+		    PACKED_SIZE * sizeof (FLT_DBL));
+	    if (prog->symmetry == FIT_ORTHO)
+		memcpy (ch->rmat + 9 * ii, orient + 9 * (nn + ii),
+			9 * sizeof (FLT_DBL));
+	    else
+	    {
+		ch->theta_best[ii] = orient[2 * (nn + ii)];
+		ch->phi_best[ii] = orient[2 * (nn + ii) + 1];
+	    }
+	    ch->dist_best[ii] = dist[nn + ii];
+	}
+
+	/* As after a batched search, the per-axis TI distances only if asked */
+	if (batch_tidist (&run))
+	    for (ii = 0; ii < ch->ncc; ii++)
+		ortho_axis_distances (ch->ccs + PACKED_SIZE * ii,
+				      ch->rmat + 9 * ii, ch->axis_dist + 3 * ii);
+	status = batch_write ((void *) &run, (void *) ch);
+    }
+
+    if (bo->format != OUTPUT_TEXT)
+	output_finish ();
+    if (summary != (struct run_summary *) 0 && status == 0)
+	summary_print (summary, prog->what, prog->axis);
+
+    free (ch);
+
+    return status < 0;
+}
+
+/*
+ * What volume_save needs
+ */
+struct batch_volume
+{
+    struct volume_checkpoint vc;
+    const char     *name;	/* for messages */
+};
+
+/*
+ * Bring a volume's checkpoint up to date, if it is due.
+ */
+static void
+volume_save (void *data)
+{
+struct batch_volume *vol = (struct batch_volume *) data;
+
+    if (checkpoint_due (vol->vc.ckpt) &&
+	volume_checkpoint_write (&vol->vc) < 0)
+	fprintf (stderr, "%s: can't update the checkpoint\n", vol->name);
+
+    return;
+}
+
+/*
+ * --volume=n1,n2,n3: read the stiffness matrices of a volume, n1 by n2 by
+ * n3 points (n1 varying fastest), and find the TI symmetry axis (or the
+ * Orthorhombic principal axes) at every point, coarse to fine (see
+ * volume.c). Output one line per point, as for --batch, in the order they
+ * were read, or with summary, summarize them instead, as for --batch.
+ *
+ * --output is as for --batch. With ckpt, what has been found so far is
+ * kept there every so often (see volume_save), and if resumed, picked up
+ * again from it, so only the points not done yet are solved.
+ */
+static int
+volume_mode (struct batch_program *prog, struct batch_options *bo,
+	     struct run_summary *summary, struct checkpoint *ckpt,
+	     int resumed)
+{
+int            *dims = bo->dims;
+int             ncc, nchosen, status;
+long            ndone;
+int             order[OUTPUT_FIELDS_MAX];
+FLT_DBL        *ccs, *orient, *dist;
+struct batch_volume vol;
+struct volume_progress progress;
+
+    ccs = batch_read_all (prog, &ncc);
+    if (ccs == (FLT_DBL *) 0)
+	return 1;
+    if ((long) ncc != (long) dims[0] * dims[1] * dims[2])
+    {
+	fprintf (stderr, "%s: read %d matrices, but a %d by %d by %d "
+		 "volume has %ld\n", prog->name, ncc, dims[0], dims[1],
+		 dims[2], (long) dims[0] * dims[1] * dims[2]);
+	free (ccs);
+	return 1;
+    }
+    if (bo->compliance)
+	batch_compliance (prog, ncc, ccs, 0);
+
+    nchosen = 0;
+    if (bo->format != OUTPUT_TEXT)
+    {
+	nchosen = batch_choose (prog, &bo->opts, bo->fields, order);
+	if (nchosen < 0)
+	{
+	    free (ccs);
+	    return 1;
+	}
+    }
+
+    if (bo->output_path != (char *) 0 &&
+	checkpoint_output (bo->output_path, -1) < 0)
+    {
+	free (ccs);
+	return 1;
+    }
+
+    orient = (FLT_DBL *) malloc (VOLUME_NORIENT (prog->symmetry) * ncc *
+				 sizeof (FLT_DBL));
+    dist = (FLT_DBL *) malloc (ncc * sizeof (FLT_DBL));
+    vol.vc.done = (unsigned char *) 0;
+    vol.vc.saved = (unsigned char *) 0;
+    if (ckpt != (struct checkpoint *) 0)
+    {
+	vol.vc.done = (unsigned char *) calloc (ncc, 1);
+	vol.vc.saved = (unsigned char *) calloc (ncc, 1);
+    }
+    status = (orient == (FLT_DBL *) 0 || dist == (FLT_DBL *) 0 ||
+	      (ckpt != (struct checkpoint *) 0 &&
+	       (vol.vc.done == (unsigned char *) 0 ||
+		vol.vc.saved == (unsigned char *) 0))) ? -1 : 0;
+
+    /*
+     * With a checkpoint, pick up what an earlier run found (see
+     * volume_save), and keep what this one finds.
+     */
+    if (status == 0 && ckpt != (struct checkpoint *) 0)
+    {
+	vol.vc.ckpt = ckpt;
+	vol.vc.symmetry = prog->symmetry;
+	vol.vc.npoint = ncc;
+	vol.vc.orient = orient;
+	vol.vc.dist = dist;
+	vol.name = prog->name;
+	ndone = resumed ? volume_checkpoint_read (&vol.vc) : 0;
+	if (ndone < 0)
+	{
+	    fprintf (stderr, "%s: can't read the checkpoint\n", prog->name);
+	    status = 1;
+	}
+	if (ndone > 0)
+	    fprintf (stderr, "%s: taking up the run again, with %ld of "
+		     "%d points done\n", prog->name, ndone, ncc);
+
+	progress.done = vol.vc.done;
+	progress.every = VOLUME_EVERY;
+	progress.save = volume_save;
+	progress.data = (void *) &vol;
+    }
+    if (status == 0 &&
+	find_volume (prog->symmetry, dims, ccs, 0., orient, dist,
+		     (struct volume_stats *) 0,
+		     (ckpt != (struct checkpoint *) 0) ? &progress :
+		     (struct volume_progress *) 0) < 0)
+	status = -1;
+    free (vol.vc.done);
+    free (vol.vc.saved);
+    if (status != 0)
+    {
+	if (status < 0)
+	    fprintf (stderr, "%s: out of memory\n", prog->name);
+	free (ccs);
+	free (orient);
+	free (dist);
+	return 1;
+    }
+
+    status = batch_answers (prog, bo, summary, nchosen, order, ncc, ccs,
+			    orient, dist);
+
+    free (ccs);
+    free (orient);
+    free (dist);
+
+    return status;
+}
+
+/*
+ * Answer one --serve request, as a chunk of one matrix.
+ */
+static int
+serve_answer (void *data, FLT_DBL * ccp, double *values)
+{
+struct batch_serve *serve = (struct batch_serve *) data;
+int             kk;
+
+    serve->chunk->ncc = 1;
+    for (kk = 0; kk < PACKED_SIZE; kk++)
+	serve->chunk->ccs[kk] = ccp[kk];
+
+    if (batch_compute ((void *) serve->run, (void *) serve->chunk) < 0)
+	return -1;
+    batch_values (serve->run, serve->chunk, 0, values);
+
+    return 0;
+}
+
+/*
+ * --serve: answer requests (see serve.c), one matrix at a time, with the
+ * same fields as --batch gives. Unlike a fresh run for each matrix, the
+ * scan tables and any cache are built once and kept.
+ */
+static int
+serve_mode (struct batch_program *prog, struct batch_options *bo,
+	    struct result_cache *cache)
+{
+int             nchosen, status;
+int             order[OUTPUT_FIELDS_MAX];
+double          values[OUTPUT_FIELDS_MAX];
+struct batch_run run;
+struct batch_serve serve;
+struct serve_handler handler;
+
+    nchosen = batch_choose (prog, &bo->opts, bo->fields, order);
+    if (nchosen < 0)
+	return 1;
+
+    batch_start (&run, prog, &bo->opts, OUTPUT_JSON, nchosen, order);
+    run.cache = cache;
+
+    serve.run = &run;
+    serve.chunk = (struct batch_chunk *) malloc (sizeof (struct batch_chunk));
+    if (serve.chunk == (struct batch_chunk *) 0)
+    {
+	fprintf (stderr, "%s: out of memory\n", prog->name);
+	return 1;
+    }
+
+    /* Have the scan tables ready before the first request comes. */
+    batch_scan_ti (0, (FLT_DBL *) 0, (FLT_DBL *) 0);
+    if (prog->symmetry == FIT_ORTHO)
+	batch_scan_ortho (0, (FLT_DBL *) 0, (FLT_DBL *) 0);
+
+    handler.data = (void *) &serve;
+    handler.answer = serve_answer;
+    handler.names = prog->fields;
+    handler.nfield = nchosen;
+    handler.order = order;
+    handler.values = values;
+    handler.layout = bo->layout;
+    status = serve_requests (&handler,
+			     (bo->format == OUTPUT_BINARY) ? bo->format :
+			     OUTPUT_JSON, bo->serve_path);
+
+    free (serve.chunk);
+
+    return status < 0;
+}
+
+/*
+ * Run --batch, --serve, or --volume, as the options say.
+ *
+ * Input:
+ *	prog is the program (see cmat.h).
+ *	bo is the options, as read by batch_parse.
+ *	argc and argv are main's, for the checkpoint's signature.
+ *
+ * Return value:
+ *	The program's exit status: 0 if all went well, else 1 (after
+ *	saying why).
+ */
+int
+batch_main (struct batch_program *prog, struct batch_options *bo,
+	    int argc, char **argv)
+{
+int             status, nthreads, resumed;
+long            ckpt_size;
+struct run_summary *summary;
+struct checkpoint *ckpt;
+struct result_cache *cache;
+struct telemetry *tel;
+
+    summary = (struct run_summary *) 0;
+    if (bo->zone_size >= 0)
+    {
+	summary = summary_open (bo->zone_size);
+	if (summary == (struct run_summary *) 0)
+	{
+	    fprintf (stderr, "%s: out of memory\n", prog->name);
+	    return 1;
+	}
+    }
+
+    /*
+     * With --checkpoint, a batch run keeps how many matrices it has
+     * written, and where that got to in the output, and a volume run what
+     * it has found so far at every point.
+     */
+    ckpt = (struct checkpoint *) 0;
+    resumed = 0;
+    if (bo->ckpt_path != (char *) 0)
+    {
+	ckpt_size = BATCH_CKPT_SIZE;
+	if (bo->volume)
+	    ckpt_size = volume_checkpoint_size (prog->symmetry, bo->dims);
+	ckpt = checkpoint_open (bo->ckpt_path,
+				checkpoint_signature (argc, argv),
+				ckpt_size, &resumed);
+	if (ckpt == (struct checkpoint *) 0)
+	{
+	    if (summary != (struct run_summary *) 0)
+		summary_close (summary);
+	    return 1;
+	}
+    }
+
+    if (bo->volume)
+    {
+	status = volume_mode (prog, bo, summary, ckpt, resumed);
+	if (summary != (struct run_summary *) 0)
+	    summary_close (summary);
+	if (ckpt != (struct checkpoint *) 0)
+	    checkpoint_close (ckpt, status == 0);
+	return status;
+    }
+
+    cache = (struct result_cache *) 0;
+    if (bo->cached)
+    {
+	cache = cache_open ((prog->symmetry == FIT_ORTHO) ? 10 : 3,
+			    bo->quantum, bo->cache_path);
+	if (cache == (struct result_cache *) 0)
+	{
+	    if (bo->cache_path != (char *) 0)
+		fprintf (stderr, "%s: can't use cache file \"%s\"\n",
+			 prog->name, bo->cache_path);
+	    else
+		fprintf (stderr, "%s: out of memory\n", prog->name);
+	    return 1;
+	}
+    }
+
+    /*
+     * The cache can't be shared, so only one thread may search.
+     * Otherwise there is one per processor unless asked for otherwise.
+     */
+    nthreads = bo->nthreads;
+    if (cache != (struct result_cache *) 0 && nthreads > 1)
+    {
+	fprintf (stderr, "%s: with --cache only one thread searches, "
+		 "not %d\n", prog->name, nthreads);
+	nthreads = 1;
+    }
+    if (bo->batch && nthreads <= 0)
+    {
+	nthreads = (cache != (struct result_cache *) 0) ? 1 :
+	 (int) sysconf (_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+	    nthreads = 1;
+    }
+
+    if (bo->serve)
+	status = serve_mode (prog, bo, cache);
+    else
+    {
+	tel = (struct telemetry *) 0;
+	if (bo->interval > 0. || bo->trace_path != (char *) 0)
+	{
+	    tel = telemetry_open (prog->name, bo->interval, bo->trace_path);
+	    if (tel == (struct telemetry *) 0)
+		return 1;
+	}
+	status = batch_mode (prog, bo, cache, nthreads, summary, ckpt,
+			     resumed, tel);
+	if (tel != (struct telemetry *) 0)
+	{
+	    if (bo->interval > 0.)
+		telemetry_report (tel);
+	    telemetry_close (tel);
+	}
+    }
+
+    if (cache != (struct result_cache *) 0)
+	cache_close (cache);
+    if (summary != (struct run_summary *) 0)
+	summary_close (summary);
+    if (ckpt != (struct checkpoint *) 0)
+	checkpoint_close (ckpt, status == 0);
+
+    return status;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Run the three stages of a batch run (see struct batch_stages in cmat.h)
+ * over and over, a chunk of matrices at a time, until the input runs out:
+ * read a chunk, do the searches for it, and write out the answers.
+ *
+ * With threads, the stages overlap. One thread reads, nthreads threads
+ * search (each on a chunk of its own), and the calling thread writes.
+ * The chunks go round a ring of nchunk buffers supplied by the caller, so
+ * however long the input, no more than nchunk chunks are ever in memory.
+ * The reader waits for a free buffer, and the searchers take the chunks
+ * in the order they were read. The writer waits for each chunk in turn,
+ * however fast the others are, so the output comes out in the same order
+ * as the input, exactly as it would without threads.
+ *
+ * A chunk is a few hundred matrices, so the stages hand over work only a
+ * few times a second or less, and a single lock around the ring is all
+ * the coordination needed. Only the reader calls stages->read, and only
+ * the writer stages->write, so those need not be thread-safe; compute
+ * must be, as several chunks are searched at once.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "cmat.h"
+
+/* Where each buffer of the ring is */
+#define CHUNK_FREE	0	/* waiting to be read into */
+#define CHUNK_READ	1	/* read, waiting to be searched */
+#define CHUNK_BUSY	2	/* being searched */
+#define CHUNK_DONE	3	/* searched, waiting to be written */
+
+struct pipeline
+{
+    struct batch_stages *stages;
+    int             nchunk;
+    void          **chunks;
+    int            *where;
+    int            *failed;	/* did compute fail for this chunk? */
+
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+
+    long            nread;	/* chunks read so far */
+    long            nstarted;	/* chunks handed to a searcher so far */
+    long            last;	/* the number of the last chunk, once known */
+    int             read_error;
+    int             stop;	/* give up: something went wrong */
+};
+
+static void    *
+pipeline_reader (void *arg)
+{
+struct pipeline *pipe = (struct pipeline *) arg;
+long            kk;
+int             slot, status;
+
+    for (kk = 0;; kk++)
+    {
+	slot = (int) (kk % pipe->nchunk);
+
+	pthread_mutex_lock (&pipe->lock);
+	while (pipe->where[slot] != CHUNK_FREE && !pipe->stop)
+	    pthread_cond_wait (&pipe->changed, &pipe->lock);
+	if (pipe->stop)
+	{
+	    pthread_mutex_unlock (&pipe->lock);
+	    break;
+	}
+	pthread_mutex_unlock (&pipe->lock);
+
+	status = pipe->stages->read (pipe->stages->data, pipe->chunks[slot]);
+
+	pthread_mutex_lock (&pipe->lock);
+	pipe->where[slot] = CHUNK_READ;
+	pipe->nread = kk + 1;
+	if (status <= 0)
+	{
+	    pipe->last = kk;
+	    pipe->read_error = (status < 0);
+	}
+	pthread_cond_broadcast (&pipe->changed);
+	pthread_mutex_unlock (&pipe->lock);
+
+	if (status <= 0)
+	    break;
+    }
+
+    return (void *) 0;
+}
+
+static void    *
+pipeline_searcher (void *arg)
+{
+struct pipeline *pipe = (struct pipeline *) arg;
+int             slot, status;
+
+    pthread_mutex_lock (&pipe->lock);
+    for (;;)
+    {
+	while (!pipe->stop && pipe->nstarted == pipe->nread &&
+	       (pipe->last < 0 || pipe->nstarted <= pipe->last))
+	    pthread_cond_wait (&pipe->changed, &pipe->lock);
+	if (pipe->stop || (pipe->last >= 0 && pipe->nstarted > pipe->last))
+	    break;
+
+	slot = (int) (pipe->nstarted % pipe->nchunk);
+	pipe->nstarted++;
+	pipe->where[slot] = CHUNK_BUSY;
+	pthread_mutex_unlock (&pipe->lock);
+
+	status = pipe->stages->compute (pipe->stages->data, pipe->chunks[slot]);
+
+	pthread_mutex_lock (&pipe->lock);
+	pipe->where[slot] = CHUNK_DONE;
+	pipe->failed[slot] = (status < 0);
+	pthread_cond_broadcast (&pipe->changed);
+    }
+    pthread_mutex_unlock (&pipe->lock);
+
+    return (void *) 0;
+}
+
+/*
+ * The writer, run by the calling thread.
+ */
+static int
+pipeline_writer (struct pipeline *pipe)
+{
+long            kk;
+int             slot, finished;
+
+    for (kk = 0;; kk++)
+    {
+	slot = (int) (kk % pipe->nchunk);
+
+	pthread_mutex_lock (&pipe->lock);
+	while (pipe->where[slot] != CHUNK_DONE &&
+	       (pipe->last < 0 || kk <= pipe->last))
+	    pthread_cond_wait (&pipe->changed, &pipe->lock);
+	finished = (pipe->last >= 0 && kk > pipe->last);
+	pthread_mutex_unlock (&pipe->lock);
+
+	if (finished)
+	    return pipe->read_error ? -1 : 0;
+
+	if (pipe->failed[slot] ||
+	    pipe->stages->write (pipe->stages->data, pipe->chunks[slot]) < 0)
+	    return -1;
+
+	pthread_mutex_lock (&pipe->lock);
+	pipe->where[slot] = CHUNK_FREE;
+	pthread_cond_broadcast (&pipe->changed);
+	pthread_mutex_unlock (&pipe->lock);
+    }
+}
+
+/*
+ * Input:
+ *	stages gives the three stages. read fills in a chunk and returns 1
+ *	if there may be more input after it, 0 if it is the last (it may
+ *	be empty), or -1 if bad input was found: the chunk then holds what
+ *	came before it and is the last. compute and write return 0, or -1
+ *	if they failed (and said why).
+ *	nthreads is the number of threads to search with, or 0 to do
+ *	everything in the calling thread, one stage after another.
+ *	chunks are nchunk buffers for chunks, at least 1 (for no threads)
+ *	or nthreads + 2 (so every thread can be busy). Twice that lets the
+ *	reader and writer get ahead and fall behind.
+ *
+ * Return value:
+ *	0 if all went well, or -1 if any stage failed. Even then, every chunk
+ *	before the one that failed has been written.
+ */
+int
+batch_pipeline (struct batch_stages *stages, int nthreads, int nchunk,
+		void **chunks)
+{
+struct pipeline pipe;
+pthread_t       reader;
+pthread_t      *searchers;
+int             ii, nstarted, status;
+
+    if (nthreads <= 0)
+    {
+	do
+	{
+	    status = stages->read (stages->data, chunks[0]);
+	    if (stages->compute (stages->data, chunks[0]) < 0 ||
+		stages->write (stages->data, chunks[0]) < 0)
+		return -1;
+	} while (status > 0);
+
+	return (status < 0) ? -1 : 0;
+    }
+
+    pipe.stages = stages;
+    pipe.nchunk = nchunk;
+    pipe.chunks = chunks;
+    pipe.nread = 0;
+    pipe.nstarted = 0;
+    pipe.last = -1;
+    pipe.read_error = 0;
+    pipe.stop = 0;
+    pipe.where = (int *) malloc (nchunk * sizeof (int));
+    pipe.failed = (int *) malloc (nchunk * sizeof (int));
+    searchers = (pthread_t *) malloc (nthreads * sizeof (pthread_t));
+    if (pipe.where == (int *) 0 || pipe.failed == (int *) 0 ||
+	searchers == (pthread_t *) 0)
+    {
+	free (pipe.where);
+	free (pipe.failed);
+	free (searchers);
+	return -1;
+    }
+    for (ii = 0; ii < nchunk; ii++)
+    {
+	pipe.where[ii] = CHUNK_FREE;
+	pipe.failed[ii] = 0;
+    }
+    pthread_mutex_init (&pipe.lock, (pthread_mutexattr_t *) 0);
+    pthread_cond_init (&pipe.changed, (pthread_condattr_t *) 0);
+
+    status = -1;
+    nstarted = 0;
+    if (pthread_create (&reader, (pthread_attr_t *) 0, pipeline_reader,
+			(void *) &pipe) == 0)
+    {
+	for (nstarted = 0; nstarted < nthreads; nstarted++)
+	    if (pthread_create (searchers + nstarted, (pthread_attr_t *) 0,
+				pipeline_searcher, (void *) &pipe) != 0)
+		break;
+
+	/* Make do with however many searchers could be started. */
+	if (nstarted > 0)
+	    status = pipeline_writer (&pipe);
+
+	pthread_mutex_lock (&pipe.lock);
+	pipe.stop = 1;
+	pthread_cond_broadcast (&pipe.changed);
+	pthread_mutex_unlock (&pipe.lock);
+
+	pthread_join (reader, (void **) 0);
+	for (ii = 0; ii < nstarted; ii++)
+	    pthread_join (searchers[ii], (void **) 0);
+    }
+
+    pthread_cond_destroy (&pipe.changed);
+    pthread_mutex_destroy (&pipe.lock);
+    free (pipe.where);
+    free (pipe.failed);
+    free (searchers);
+
+    return status;
+}
@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Do the initial scans of search_ti and search_ortho for many input
+ * matrices at once.
+ *
+ * Rotation is linear in the elastic constants, and so is projecting onto
+ * the nearest VTI (or canonical orthorhombic) medium. Writing a medium as
+ * a 21-vector x (see vector21.c), and the symmetric subspace as having
+ * orthonormal basis b_1, ..., b_K (K = 5 or 9), the squared distance after
+ * rotating by R is
+ *
+ *	d^2 = |x|^2 - sum_k (a_k . x)^2,	a_k = R^T b_k .
+ *
+ * The scan grids are fixed, so the a_k for every grid point can be worked
+ * out once and for all. Stacking them up, the whole initial scan for a
+ * whole block of inputs is then a single dense matrix product,
+ * (K * number of grid points) x 21 times 21 x (number of inputs), which is
+ * far cheaper than rotating every input to every grid point. The best
+ * point of each input's scan is then refined by the usual search.
+ *
+ * The tables are built the first time they are needed, and kept. (So
+ * the first call should not be made from several threads at once. A call
+ * for no inputs just builds the table, ready for threads to share.)
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * How many inputs to scan at once. The inputs for one block are kept
+ * transposed in a 21 x BATCH_BLOCK array, which should fit in cache.
+ */
+#define BATCH_BLOCK	64
+
+/*
+ * The precomputed linear maps for one scan grid.
+ */
+struct scan_table
+{
+    int             npoint;	/* Number of grid points */
+    int             nbasis;	/* Rows per grid point */
+    FLT_DBL        *rows;	/* npoint * nbasis rows of 21 */
+};
+
+static struct scan_table ti_table;
+static struct scan_table ortho_table;
+
+/*
+ * Fill in the rows for one grid point, given the rotation matrix rmat
+ * for that point.
+ */
+static void
+table_rows (FLT_DBL * rows, int nbasis,
+	    FLT_DBL basis[MAX_BASIS][PACKED_SIZE], FLT_DBL * rmat)
+{
+int             kk;
+FLT_DBL         rmat_transp[9];
+FLT_DBL         ccp1[PACKED_SIZE];
+
+    transpose_matrix (rmat_transp, rmat);
+
+    for (kk = 0; kk < nbasis; kk++)
+    {
+	rotate_packed (ccp1, basis[kk], rmat_transp);
+	packed_to_vector21 (rows + 21 * kk, ccp1);
+    }
+
+    return;
+}
+
+/*
+ * Build the table for the TI scan, if we haven't already.
+ */
+static struct scan_table *
+ti_scan_table (void)
+{
+int             ii;
+FLT_DBL         basis[MAX_BASIS][PACKED_SIZE];
+FLT_DBL        *theta_scan, *phi_scan;
+FLT_DBL         rmat[9];
+
+    if (ti_table.rows != (FLT_DBL *) 0)
+	return &ti_table;
+
+    ti_table.npoint = ti_scan_points ((struct search_opts *) 0,
+				      (FLT_DBL *) 0, (FLT_DBL *) 0);
+    ti_table.nbasis = projection_basis (ti_distance_packed, basis);
+
+    theta_scan = (FLT_DBL *) malloc (ti_table.npoint * sizeof (FLT_DBL));
+    phi_scan = (FLT_DBL *) malloc (ti_table.npoint * sizeof (FLT_DBL));
+    ti_table.rows = (FLT_DBL *) malloc (ti_table.npoint * ti_table.nbasis *
+					21 * sizeof (FLT_DBL));
+    if (theta_scan == (FLT_DBL *) 0 || phi_scan == (FLT_DBL *) 0 ||
+	ti_table.rows == (FLT_DBL *) 0)
+    {
+	free (theta_scan);
+	free (phi_scan);
+	free (ti_table.rows);
+	ti_table.rows = (FLT_DBL *) 0;
+	return (struct scan_table *) 0;
+    }
+
+    ti_scan_points ((struct search_opts *) 0, theta_scan, phi_scan);
+
+    for (ii = 0; ii < ti_table.npoint; ii++)
+    {
+	make_rotation_matrix (theta_scan[ii], phi_scan[ii], 0., rmat);
+	table_rows (ti_table.rows + 21 * ti_table.nbasis * ii,
+		    ti_table.nbasis, basis, rmat);
+    }
+
+    free (theta_scan);
+    free (phi_scan);
+
+    return &ti_table;
+}
+
+/*
+ * Build the table for the Orthorhombic scan, if we haven't already.
+ */
+static struct scan_table *
+ortho_scan_table (void)
+{
+int             ii;
+FLT_DBL         basis[MAX_BASIS][PACKED_SIZE];
+FLT_DBL        *qq_scan;
+FLT_DBL         rmat[9];
+
+    if (ortho_table.rows != (FLT_DBL *) 0)
+	return &ortho_table;
+
+    ortho_table.npoint = ortho_scan_points ((FLT_DBL *) 0);
+    ortho_table.nbasis = projection_basis (ortho_distance_packed, basis);
+
+    qq_scan = (FLT_DBL *) malloc (4 * ortho_table.npoint * sizeof (FLT_DBL));
+    ortho_table.rows =
+     (FLT_DBL *) malloc (ortho_table.npoint * ortho_table.nbasis * 21 *
+			 sizeof (FLT_DBL));
+    if (qq_scan == (FLT_DBL *) 0 || ortho_table.rows == (FLT_DBL *) 0)
+    {
+	free (qq_scan);
+	free (ortho_table.rows);
+	ortho_table.rows = (FLT_DBL *) 0;
+	return (struct scan_table *) 0;
+    }
+
+    ortho_scan_points (qq_scan);
+
+    for (ii = 0; ii < ortho_table.npoint; ii++)
+    {
+	quaternion_to_matrix (qq_scan + 4 * ii, rmat);
+	table_rows (ortho_table.rows + 21 * ortho_table.nbasis * ii,
+		    ortho_table.nbasis, basis, rmat);
+    }
+
+    free (qq_scan);
+
+    return &ortho_table;
+}
+
+/*
+ * The kernel: scan one block of at most BATCH_BLOCK inputs.
+ *
+ * Input:
+ *	table is the scan table.
+ *	nblock is the number of inputs in this block.
+ *	xt is the block of inputs as 21-vectors, transposed:
+ *	xt[BATCH_BLOCK * jj + nn] is element jj of input nn.
+ *	xnorm2 holds the squared norms of the inputs.
+ *
+ * Output:
+ *	scan[table->npoint * nn + ii] is the distance of input nn at
+ *	scan point ii.
+ */
+static void
+scan_block (struct scan_table *table, int nblock, FLT_DBL * xt,
+	    FLT_DBL * xnorm2, FLT_DBL * scan)
+{
+int             ii, jj, kk, nn;
+FLT_DBL        *row;
+FLT_DBL        *xrow;
+FLT_DBL         aa;
+FLT_DBL         yy[BATCH_BLOCK];
+FLT_DBL         energy[BATCH_BLOCK];
+FLT_DBL         temp;
+
+    for (ii = 0; ii < table->npoint; ii++)
+    {
+	for (nn = 0; nn < nblock; nn++)
+	    energy[nn] = 0.;
+
+	for (kk = 0; kk < table->nbasis; kk++)
+	{
+	    row = table->rows + 21 * (table->nbasis * ii + kk);
+
+	    /*
+	     * yy = row . x for every input in the block at once. The inner
+	     * loop runs along the block, with unit stride.
+	     */
+	    for (nn = 0; nn < nblock; nn++)
+		yy[nn] = 0.;
+	    for (jj = 0; jj < 21; jj++)
+	    {
+		aa = row[jj];
+		xrow = xt + BATCH_BLOCK * jj;
+		for (nn = 0; nn < nblock; nn++)
+		    yy[nn] += aa * xrow[nn];
+	    }
+
+	    for (nn = 0; nn < nblock; nn++)
+		energy[nn] += yy[nn] * yy[nn];
+	}
+
+	for (nn = 0; nn < nblock; nn++)
+	{
+	    temp = xnorm2[nn] - energy[nn];
+	    scan[table->npoint * nn + ii] = sqrt (temp > 0. ? temp : 0.);
+	}
+    }
+
+    return;
+}
+
+/*
+ * Scan any number of inputs, a block at a time.
+ */
+static void
+batch_scan (struct scan_table *table, int ncc, FLT_DBL * ccs, FLT_DBL * scan)
+{
+int             jj, nn, nstart, nblock;
+FLT_DBL         xx[21];
+FLT_DBL         xt[21 * BATCH_BLOCK];
+FLT_DBL         xnorm2[BATCH_BLOCK];
+
+    for (nstart = 0; nstart < ncc; nstart += BATCH_BLOCK)
+    {
+	nblock = ncc - nstart;
+	if (nblock > BATCH_BLOCK)
+	    nblock = BATCH_BLOCK;
+
+	for (nn = 0; nn < nblock; nn++)
+	{
+	    packed_to_vector21 (xx, ccs + PACKED_SIZE * (nstart + nn));
+	    xnorm2[nn] = 0.;
+	    for (jj = 0; jj < 21; jj++)
+	    {
+		xt[BATCH_BLOCK * jj + nn] = xx[jj];
+		xnorm2[nn] += xx[jj] * xx[jj];
+	    }
+	}
+
+	scan_block (table, nblock, xt, xnorm2,
+		    scan + table->npoint * nstart);
+    }
+
+    return;
+}
+
+/*
+ * Do search_ti's initial scan for ncc inputs.
+ *
+ * Input:
+ *	ccs holds the ncc packed stiffness matrices one after the other.
+ *
+ * Output:
+ *	scan holds the default ti_scan_points () distances for each input,
+ *	one input after another, suitable for passing to search_ti in
+ *	opts->scan.
+ */
+void
+batch_scan_ti (int ncc, FLT_DBL * ccs, FLT_DBL * scan)
+{
+struct scan_table *table;
+
+    table = ti_scan_table ();
+    if (table != (struct scan_table *) 0)
+	batch_scan (table, ncc, ccs, scan);
+
+    return;
+}
+
+/*
+ * Do search_ortho's initial scan for ncc inputs.
+ *
+ * Input:
+ *	ccs holds the ncc packed stiffness matrices one after the other.
+ *
+ * Output:
+ *	scan holds ortho_scan_points () distances for each input, one input
+ *	after another, suitable for passing to search_ortho in opts->scan.
+ */
+void
+batch_scan_ortho (int ncc, FLT_DBL * ccs, FLT_DBL * scan)
+{
+struct scan_table *table;
+
+    table = ortho_scan_table ();
+    if (table != (struct scan_table *) 0)
+	batch_scan (table, ncc, ccs, scan);
+
+    return;
+}
+
+/*
+ * find_ti for many inputs at once.
+ *
+ * Input:
+ *	ccs holds the ncc packed stiffness matrices one after the other.
+ *
+ * Output:
+ *	theta_best, phi_best, dist_best hold the results of find_ti for
+ *	each input.
+ */
+void
+find_ti_batch (int ncc, FLT_DBL * ccs, FLT_DBL * theta_best,
+	       FLT_DBL * phi_best, FLT_DBL * dist_best)
+{
+    find_ti_timed (ncc, ccs, theta_best, phi_best, dist_best,
+		   (struct telemetry *) 0);
+
+    return;
+}
+
+/*
+ * find_ti_batch, reporting to tel (if it is not a null pointer) how long
+ * the scan and the refinement of each block of inputs take.
+ */
+void
+find_ti_timed (int ncc, FLT_DBL * ccs, FLT_DBL * theta_best,
+	       FLT_DBL * phi_best, FLT_DBL * dist_best, struct telemetry *tel)
+{
+int             nn, nscan;
+FLT_DBL        *scan;
+struct search_opts opts;
+double          start;
+
+    search_defaults (&opts);
+    start = 0.;
+
+    nscan = ti_scan_points ((struct search_opts *) 0,
+			    (FLT_DBL *) 0, (FLT_DBL *) 0);
+    scan = (FLT_DBL *) malloc (BATCH_BLOCK * nscan * sizeof (FLT_DBL));
+
+    for (nn = 0; nn < ncc; nn++)
+    {
+	/*
+	 * If we are short of memory, or the tables could not be built, the
+	 * scan will simply be done the slow way.
+	 */
+	if (tel != (struct telemetry *) 0 && nn % BATCH_BLOCK == 0)
+	{
+	    if (nn > 0)
+		telemetry_span (tel, STAGE_REFINE, start, BATCH_BLOCK);
+	    start = telemetry_clock ();
+	}
+	if (scan != (FLT_DBL *) 0 && nn % BATCH_BLOCK == 0)
+	{
+	    batch_scan_ti ((ncc - nn < BATCH_BLOCK) ? ncc - nn : BATCH_BLOCK,
+			   ccs + PACKED_SIZE * nn, scan);
+	    opts.scan = (ti_table.rows != (FLT_DBL *) 0) ? scan : (FLT_DBL *) 0;
+	    if (tel != (struct telemetry *) 0)
+	    {
+		telemetry_span (tel, STAGE_SCAN, start,
+				(ncc - nn < BATCH_BLOCK) ? ncc - nn :
+				BATCH_BLOCK);
+		start = telemetry_clock ();
+	    }
+	}
+	if (opts.scan != (FLT_DBL *) 0)
+	    opts.scan = scan + nscan * (nn % BATCH_BLOCK);
+
+	dist_best[nn] = search_ti (rotated_ti_distance,
+				   (void *) (ccs + PACKED_SIZE * nn), &opts,
+				   theta_best + nn, phi_best + nn);
+    }
+    if (tel != (struct telemetry *) 0 && ncc > 0)
+	telemetry_span (tel, STAGE_REFINE, start,
+			ncc - BATCH_BLOCK * ((ncc - 1) / BATCH_BLOCK));
+
+    free (scan);
+
+    return;
+}
+
+/*
+ * find_ortho for many inputs at once.
+ *
+ * Input:
+ *	ccs holds the ncc packed stiffness matrices one after the other.
+ *
+ * Output:
+ *	rmat holds the ncc 3x3 rotation matrices found by find_ortho, one
+ *	after another, and dist_best the distances.
+ */
+void
+find_ortho_batch (int ncc, FLT_DBL * ccs, FLT_DBL * rmat, FLT_DBL * dist_best)
+{
+    find_ortho_timed (ncc, ccs, rmat, dist_best, (struct telemetry *) 0);
+
+    return;
+}
+
+/*
+ * find_ortho_batch, reporting to tel as for find_ti_timed.
+ */
+void
+find_ortho_timed (int ncc, FLT_DBL * ccs, FLT_DBL * rmat, FLT_DBL * dist_best,
+		  struct telemetry *tel)
+{
+int             nn, nscan;
+FLT_DBL        *scan;
+struct search_opts opts;
+double          start;
+
+    search_defaults (&opts);
+    start = 0.;
+
+    nscan = ortho_scan_points ((FLT_DBL *) 0);
+    scan = (FLT_DBL *) malloc (BATCH_BLOCK * nscan * sizeof (FLT_DBL));
+
+    for (nn = 0; nn < ncc; nn++)
+    {
+	if (tel != (struct telemetry *) 0 && nn % BATCH_BLOCK == 0)
+	{
+	    if (nn > 0)
+		telemetry_span (tel, STAGE_REFINE, start, BATCH_BLOCK);
+	    start = telemetry_clock ();
+	}
+	if (scan != (FLT_DBL *) 0 && nn % BATCH_BLOCK == 0)
+	{
+	    batch_scan_ortho ((ncc - nn < BATCH_BLOCK) ? ncc - nn :
+			      BATCH_BLOCK, ccs + PACKED_SIZE * nn, scan);
+	    opts.scan =
+	     (ortho_table.rows != (FLT_DBL *) 0) ? scan : (FLT_DBL *) 0;
+	    if (tel != (struct telemetry *) 0)
+	    {
+		telemetry_span (tel, STAGE_SCAN, start,
+				(ncc - nn < BATCH_BLOCK) ? ncc - nn :
+				BATCH_BLOCK);
+		start = telemetry_clock ();
+	    }
+	}
+	if (opts.scan != (FLT_DBL *) 0)
+	    opts.scan = scan + nscan * (nn % BATCH_BLOCK);
+
+	dist_best[nn] =
+	 search_ortho (rotated_ortho_distance, rotated_ti_distance,
+		       (void *) (ccs + PACKED_SIZE * nn), &opts, rmat + 9 * nn);
+    }
+    if (tel != (struct telemetry *) 0 && ncc > 0)
+	telemetry_span (tel, STAGE_REFINE, start,
+			ncc - BATCH_BLOCK * ((ncc - 1) / BATCH_BLOCK));
+
+    free (scan);
+
+    return;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Checkpoint files, so that a long run that is cut short (killed, or its
+ * machine taken away) can be taken up again where it left off instead of
+ * being started over.
+ *
+ * A checkpoint file is a short header, then size bytes that are the
+ * caller's to use: how far a batch run has got, say, or the state of
+ * every point of a volume. They are written in place, only the parts
+ * that changed, so keeping a checkpoint up costs little even when it is
+ * large. The header holds a signature of the run (see
+ * checkpoint_signature), so that a run is only taken up again by the
+ * same run.
+ *
+ * Writing to the file costs a system call, and making sure it is on disk
+ * (checkpoint_sync) a good deal more, so callers only do either every
+ * CHECKPOINT_SECONDS (see checkpoint_due).
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cmat.h"
+
+#define CHECKPOINT_MAGIC	"cmat checkpoint 1"
+
+/* How often to bring a checkpoint up to date */
+#define CHECKPOINT_SECONDS	30.
+
+struct checkpoint_header
+{
+    char            magic[sizeof (CHECKPOINT_MAGIC)];
+    unsigned long   signature;
+    long            size;
+};
+
+struct checkpoint
+{
+    int             fd;
+    char           *path;
+    double          last;	/* when it was last brought up to date */
+};
+
+static double
+checkpoint_clock (void)
+{
+struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1.e-9 * (double) ts.tv_nsec;
+}
+
+/*
+ * A signature for a run, from its command-line arguments: a hash of all
+ * of them except those that don't change the answers (--threads=).
+ */
+unsigned long
+checkpoint_signature (int argc, char **argv)
+{
+unsigned long   hash;
+const char     *cp;
+int             ii;
+
+    /* FNV-1a */
+    hash = 2166136261UL;
+    for (ii = 1; ii < argc; ii++)
+    {
+	if (strncmp (argv[ii], "--threads=", 10) == 0)
+	    continue;
+	for (cp = argv[ii]; *cp != '\0'; cp++)
+	    hash = ((hash ^ (unsigned char) *cp) * 16777619UL) & 0xffffffffUL;
+	hash = (hash * 16777619UL) & 0xffffffffUL;
+    }
+
+    return hash;
+}
+
+/*
+ * Open a checkpoint.
+ *
+ * Input:
+ *	path is the checkpoint file.
+ *	signature is the run's signature.
+ *	size is the number of bytes the caller keeps in it.
+ *
+ * Output:
+ *	resumed is 1 if the file was there already, from the same run (its
+ *	contents are then as the run left them), or 0 if it is new (and its
+ *	contents are all zero bytes).
+ *
+ * Return value:
+ *	The checkpoint, or a null pointer (after saying why on standard
+ *	error) if the file can't be used: it can't be made, or it is a
+ *	checkpoint of some other run, or not a checkpoint at all.
+ */
+struct checkpoint *
+checkpoint_open (const char *path, unsigned long signature, long size,
+		 int *resumed)
+{
+struct checkpoint *ckpt;
+struct checkpoint_header header, found;
+ssize_t         nn;
+
+    memset (&header, 0, sizeof (header));
+    strcpy (header.magic, CHECKPOINT_MAGIC);
+    header.signature = signature;
+    header.size = size;
+
+    ckpt = (struct checkpoint *) malloc (sizeof (struct checkpoint));
+    if (ckpt != (struct checkpoint *) 0)
+	ckpt->path = (char *) malloc (strlen (path) + 1);
+    if (ckpt == (struct checkpoint *) 0 || ckpt->path == (char *) 0)
+    {
+	fprintf (stderr, "checkpoint: out of memory\n");
+	free (ckpt);
+	return (struct checkpoint *) 0;
+    }
+    strcpy (ckpt->path, path);
+    ckpt->last = checkpoint_clock ();
+
+    ckpt->fd = open (path, O_RDWR | O_CREAT, 0666);
+    if (ckpt->fd < 0)
+    {
+	perror (path);
+	free (ckpt->path);
+	free (ckpt);
+	return (struct checkpoint *) 0;
+    }
+
+    nn = pread (ckpt->fd, &found, sizeof (found), (off_t) 0);
+    if (nn == 0)
+    {
+	/* A new one */
+	*resumed = 0;
+	if (ftruncate (ckpt->fd, (off_t) (sizeof (header) + size)) == 0 &&
+	    pwrite (ckpt->fd, &header, sizeof (header), (off_t) 0) ==
+	    (ssize_t) sizeof (header))
+	    return ckpt;
+	perror (path);
+    }
+    else if (nn == (ssize_t) sizeof (found) &&
+	     memcmp (&found, &header, sizeof (header)) == 0)
+    {
+	*resumed = 1;
+	return ckpt;
+    }
+    else
+	fprintf (stderr, "checkpoint: \"%s\" is not a checkpoint of this "
+		 "run\n", path);
+
+    close (ckpt->fd);
+    free (ckpt->path);
+    free (ckpt);
+    return (struct checkpoint *) 0;
+}
+
+/*
+ * Read or write nbytes of the caller's part of the checkpoint, from
+ * offset bytes into it. Return 0, or -1 if that failed.
+ */
+int
+checkpoint_read (struct checkpoint *ckpt, long offset, void *buf,
+		 long nbytes)
+{
+    return (pread (ckpt->fd, buf, (size_t) nbytes,
+		   (off_t) (sizeof (struct checkpoint_header) + offset)) ==
+	    (ssize_t) nbytes) ? 0 : -1;
+}
+
+int
+checkpoint_write (struct checkpoint *ckpt, long offset, void *buf,
+		  long nbytes)
+{
+    return (pwrite (ckpt->fd, buf, (size_t) nbytes,
+		    (off_t) (sizeof (struct checkpoint_header) + offset)) ==
+	    (ssize_t) nbytes) ? 0 : -1;
+}
+
+/*
+ * Is it time to bring the checkpoint up to date again?
+ */
+int
+checkpoint_due (struct checkpoint *ckpt)
+{
+    return checkpoint_clock () - ckpt->last >= CHECKPOINT_SECONDS;
+}
+
+/*
+ * Make sure everything written to the checkpoint so far is on disk, and
+ * first, if output, everything written to standard output (the answers;
+ * see checkpoint_output). Anything written after this that says how far
+ * the run has got then never claims more than is there, even if the
+ * machine goes down. Return 0, or -1 if that failed.
+ */
+int
+checkpoint_sync (struct checkpoint *ckpt, int output)
+{
+    ckpt->last = checkpoint_clock ();
+
+    if (output && (fflush (stdout) != 0 || fsync (fileno (stdout)) != 0))
+	return -1;
+    return fsync (ckpt->fd);
+}
+
+/*
+ * Where standard output is now, in bytes from the start of the file it
+ * goes to, with everything before that written out; or -1 if that can't
+ * be found.
+ */
+long
+checkpoint_tell (void)
+{
+    if (fflush (stdout) != 0)
+	return -1;
+    return ftell (stdout);
+}
+
+/*
+ * Send standard output to the file path from now on. If keep is negative
+ * the file starts out empty, else the first keep bytes of it (what a run
+ * that is being taken up again had written, as checkpoint_tell said) are
+ * kept, and anything after them thrown away. Return 0, or -1 (after
+ * saying why on standard error) if that failed.
+ */
+int
+checkpoint_output (const char *path, long keep)
+{
+    if (freopen (path, (keep < 0) ? "w" : "r+", stdout) == (FILE *) 0 ||
+	(keep >= 0 && (ftruncate (fileno (stdout), (off_t) keep) != 0 ||
+		       fseek (stdout, keep, SEEK_SET) != 0)))
+    {
+	perror (path);
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Close a checkpoint. If the run is finished, the checkpoint is removed
+ * as well, so that the next run starts afresh.
+ */
+void
+checkpoint_close (struct checkpoint *ckpt, int finished)
+{
+    close (ckpt->fd);
+    if (finished)
+	unlink (ckpt->path);
+    free (ckpt->path);
+    free (ckpt);
+
+    return;
+}
@@ -0,0 +1,554 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Decide whether a medium is within a given distance of TI (or of
+ * Orthorhombic) without necessarily finding the nearest one.
+ *
+ * Often the answer follows from quantities that do not depend on the
+ * orientation of the medium at all, or from trying just a few likely
+ * orientations:
+ *
+ * Upper bounds. The distance at any particular orientation is an upper
+ * bound. So is the distance from isotropy, since an isotropic medium is
+ * both TI and Orthorhombic. The likely orientations tried are the principal
+ * axes of the two second-order tensors that can be formed by contracting
+ * the stiffness tensor,
+ *
+ *	d_ij = C_ijkk (the dilatational tensor) and v_ij = C_ikjk (Voigt),
+ *
+ * since for an exactly TI medium the symmetry axis is a principal axis of
+ * both, and for an exactly Orthorhombic medium so are all its axes.
+ *
+ * Lower bounds. Contraction is linear and commutes with rotation, so if
+ * the medium is C = S + E, with S symmetric and |E| = dist, then each
+ * contracted tensor is that of S plus at most (its operator norm) times
+ * dist. For TI S, any combination a d + b v of the contracted tensors has
+ * two equal eigenvalues; how far it is from having two gives a lower
+ * bound on dist. For Orthorhombic S (and so for TI S too) the contracted
+ * tensors of S commute, and how far those of C are from commuting gives
+ * another. Only the deviatoric parts of d and v are used, since adding a
+ * multiple of the identity changes neither test.
+ *
+ * If the bounds do not settle it, fall back to the orientation search,
+ * stopping as soon as any trial orientation is close enough.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * How many combinations a d + b v of the contracted tensors to test
+ * for having a repeated eigenvalue.
+ */
+#define N_COMB		12
+
+/*
+ * Find the eigenvalues and eigenvectors of the symmetric nn x nn matrix
+ * aa (destroyed) by Jacobi rotations. The eigenvectors are the columns
+ * of vv: vv[ii + nn * kk] is component ii of eigenvector kk.
+ */
+void
+jacobi_eigen (int nn, double *aa, double *evals, double *vv)
+{
+int             ii, jj, kk, sweep;
+double          off, theta, tt, cs, sn, temp1, temp2;
+
+    for (ii = 0; ii < nn; ii++)
+	for (jj = 0; jj < nn; jj++)
+	    vv[ii + nn * jj] = (ii == jj) ? 1. : 0.;
+
+    for (sweep = 0; sweep < 50; sweep++)
+    {
+	off = 0.;
+	for (ii = 0; ii < nn; ii++)
+	    for (jj = ii + 1; jj < nn; jj++)
+		off += aa[ii + nn * jj] * aa[ii + nn * jj];
+	if (off == 0.)
+	    break;
+
+	for (ii = 0; ii < nn; ii++)
+	    for (jj = ii + 1; jj < nn; jj++)
+	    {
+		if (aa[ii + nn * jj] == 0.)
+		    continue;
+
+		theta = (aa[jj + nn * jj] - aa[ii + nn * ii]) /
+		 (2. * aa[ii + nn * jj]);
+		tt = ((theta >= 0.) ? 1. : -1.) /
+		 (fabs (theta) + sqrt (theta * theta + 1.));
+		cs = 1. / sqrt (tt * tt + 1.);
+		sn = tt * cs;
+
+		/* aa = J^T aa J, acting on rows and columns ii and jj */
+		for (kk = 0; kk < nn; kk++)
+		{
+		    temp1 = aa[kk + nn * ii];
+		    temp2 = aa[kk + nn * jj];
+		    aa[kk + nn * ii] = cs * temp1 - sn * temp2;
+		    aa[kk + nn * jj] = sn * temp1 + cs * temp2;
+		}
+		for (kk = 0; kk < nn; kk++)
+		{
+		    temp1 = aa[ii + nn * kk];
+		    temp2 = aa[jj + nn * kk];
+		    aa[ii + nn * kk] = cs * temp1 - sn * temp2;
+		    aa[jj + nn * kk] = sn * temp1 + cs * temp2;
+		}
+		for (kk = 0; kk < nn; kk++)
+		{
+		    temp1 = vv[kk + nn * ii];
+		    temp2 = vv[kk + nn * jj];
+		    vv[kk + nn * ii] = cs * temp1 - sn * temp2;
+		    vv[kk + nn * jj] = sn * temp1 + cs * temp2;
+		}
+	    }
+    }
+
+    for (ii = 0; ii < nn; ii++)
+	evals[ii] = aa[ii + nn * ii];
+
+    return;
+}
+
+/*
+ * The deviatoric parts of the contracted tensors d and v (see above),
+ * as 3x3 matrices.
+ */
+static void
+contracted_tensors (FLT_DBL * cc, double *dd, double *vv)
+{
+int             ii, jj, kk;
+double          trace_d, trace_v;
+
+    for (ii = 0; ii < 3; ii++)
+	for (jj = 0; jj < 3; jj++)
+	{
+	    dd[jj + 3 * ii] = 0.;
+	    vv[jj + 3 * ii] = 0.;
+	    for (kk = 0; kk < 3; kk++)
+	    {
+		dd[jj + 3 * ii] += CCT (ii, jj, kk, kk);
+		vv[jj + 3 * ii] += CCT (ii, kk, jj, kk);
+	    }
+	}
+
+    trace_d = (dd[0] + dd[4] + dd[8]) / 3.;
+    trace_v = (vv[0] + vv[4] + vv[8]) / 3.;
+    for (ii = 0; ii < 3; ii++)
+    {
+	dd[ii + 3 * ii] -= trace_d;
+	vv[ii + 3 * ii] -= trace_v;
+    }
+
+    return;
+}
+
+/*
+ * The largest factor by which the map from a stiffness tensor to
+ * alpha dev(d) + beta dev(v) can grow the norm: the largest singular
+ * value of that linear map, going from the Federov norm to the Frobenius
+ * norm of the 3x3 result. Found from its action on the 21 orthonormal
+ * basis tensors of vector21.c.
+ */
+static double
+contraction_norm (double alpha, double beta)
+{
+int             ii, jj, kk;
+FLT_DBL         xx[21];
+FLT_DBL         cc[6 * 6];
+double          dd[9], vv[9];
+double          aa[6 * 21];
+double          gram[6 * 6];
+double          evals[6], evecs[6 * 6];
+double          biggest;
+
+    for (kk = 0; kk < 21; kk++)
+    {
+	for (ii = 0; ii < 21; ii++)
+	    xx[ii] = (ii == kk) ? 1. : 0.;
+	vector21_to_matrix (cc, xx);
+	contracted_tensors (cc, dd, vv);
+
+	/* Orthonormal coordinates for a symmetric 3x3 matrix */
+	for (ii = 0; ii < 3; ii++)
+	    for (jj = ii; jj < 3; jj++)
+		aa[kk + 21 * extern_voigt[ii][jj]] =
+		 ((ii == jj) ? 1. : sqrt (2.)) *
+		 (alpha * dd[jj + 3 * ii] + beta * vv[jj + 3 * ii]);
+    }
+
+    for (ii = 0; ii < 6; ii++)
+	for (jj = 0; jj < 6; jj++)
+	{
+	    gram[jj + 6 * ii] = 0.;
+	    for (kk = 0; kk < 21; kk++)
+		gram[jj + 6 * ii] += aa[kk + 21 * ii] * aa[kk + 21 * jj];
+	}
+
+    jacobi_eigen (6, gram, evals, evecs);
+
+    biggest = 0.;
+    for (ii = 0; ii < 6; ii++)
+	if (evals[ii] > biggest)
+	    biggest = evals[ii];
+
+    return sqrt (biggest);
+}
+
+/*
+ * The norms of the combinations tried, worked out once.
+ */
+static double   comb_norm[N_COMB];
+static int      comb_norm_set = 0;
+
+static void
+set_comb_norms (void)
+{
+int             ii;
+double          angle;
+
+    if (comb_norm_set)
+	return;
+
+    for (ii = 0; ii < N_COMB; ii++)
+    {
+	angle = 180. * DEGTORAD * ii / N_COMB;
+	comb_norm[ii] = contraction_norm (cos (angle), sin (angle));
+    }
+    comb_norm_set = 1;
+
+    return;
+}
+
+static double
+frobenius (double *aa)
+{
+int             ii;
+double          temp;
+
+    temp = 0.;
+    for (ii = 0; ii < 9; ii++)
+	temp += aa[ii] * aa[ii];
+
+    return sqrt (temp);
+}
+
+/*
+ * Distance from isotropy. The isotropic tensors are spanned by
+ * I1 = delta_ij delta_kl and I2 = delta_ik delta_jl + delta_il delta_jk,
+ * with I1.I1 = 9, I1.I2 = 6, I2.I2 = 24, C.I1 = C_iijj, C.I2 = 2 C_ijij.
+ */
+static FLT_DBL
+iso_distance (FLT_DBL * cc)
+{
+int             ii, jj;
+double          aa, bb, lambda, mu, norm, temp;
+
+    aa = 0.;
+    bb = 0.;
+    for (ii = 0; ii < 3; ii++)
+	for (jj = 0; jj < 3; jj++)
+	{
+	    aa += CCT (ii, ii, jj, jj);
+	    bb += 2. * CCT (ii, jj, ii, jj);
+	}
+
+    /* Solve [9 6; 6 24] (lambda, mu) = (aa, bb) */
+    lambda = (24. * aa - 6. * bb) / 180.;
+    mu = (9. * bb - 6. * aa) / 180.;
+
+    norm = norm_matrix_6x6 (cc);
+    temp = norm * norm - (lambda * aa + mu * bb);
+
+    return (FLT_DBL) sqrt (temp > 0. ? temp : 0.);
+}
+
+/*
+ * Lower bound on the distance from Orthorhombic: how far the deviatoric
+ * contracted tensors D and V are from commuting. For C = S + E as above,
+ * |[D,V]| <= sqrt(2) (nv |D| + nd |V|) dist + 3 sqrt(2) nd nv dist^2
+ * (using |[A,B]| <= sqrt(2) |A| |B| for the Frobenius norm), where nd and
+ * nv are the norms of the contractions. Solve that for dist.
+ */
+static FLT_DBL
+commutator_bound (double *dd, double *vv)
+{
+int             ii, jj, kk;
+double          comm[9];
+double          nd, nv, qa, qb, qc;
+
+    for (ii = 0; ii < 3; ii++)
+	for (jj = 0; jj < 3; jj++)
+	{
+	    comm[jj + 3 * ii] = 0.;
+	    for (kk = 0; kk < 3; kk++)
+		comm[jj + 3 * ii] += dd[kk + 3 * ii] * vv[jj + 3 * kk] -
+		 vv[kk + 3 * ii] * dd[jj + 3 * kk];
+	}
+
+    nd = comb_norm[0];
+    nv = comb_norm[N_COMB / 2];
+
+    qa = 3. * sqrt (2.) * nd * nv;
+    qb = sqrt (2.) * (nv * frobenius (dd) + nd * frobenius (vv));
+    qc = frobenius (comm);
+
+    return (FLT_DBL) ((-qb + sqrt (qb * qb + 4. * qa * qc)) / (2. * qa));
+}
+
+/*
+ * Lower bound on the distance from TI: each combination a D + b V must be
+ * within (its norm) times dist of a matrix with a repeated eigenvalue, and
+ * the nearest such is a distance |gap| / sqrt(2) away, gap being the
+ * smaller difference between adjacent eigenvalues.
+ */
+static FLT_DBL
+uniaxial_bound (double *dd, double *vv)
+{
+int             ii, kk;
+double          aa[9], evals[3], evecs[9];
+double          angle, gap, temp, best;
+
+    best = 0.;
+    for (ii = 0; ii < N_COMB; ii++)
+    {
+	angle = 180. * DEGTORAD * ii / N_COMB;
+	for (kk = 0; kk < 9; kk++)
+	    aa[kk] = cos (angle) * dd[kk] + sin (angle) * vv[kk];
+
+	jacobi_eigen (3, aa, evals, evecs);
+
+	/* Sort the three eigenvalues */
+	if (evals[0] > evals[1])
+	{
+	    temp = evals[0];
+	    evals[0] = evals[1];
+	    evals[1] = temp;
+	}
+	if (evals[1] > evals[2])
+	{
+	    temp = evals[1];
+	    evals[1] = evals[2];
+	    evals[2] = temp;
+	}
+	if (evals[0] > evals[1])
+	{
+	    temp = evals[0];
+	    evals[0] = evals[1];
+	    evals[1] = temp;
+	}
+
+	gap = evals[1] - evals[0];
+	if (evals[2] - evals[1] < gap)
+	    gap = evals[2] - evals[1];
+
+	temp = gap / (sqrt (2.) * comb_norm[ii]);
+	if (temp > best)
+	    best = temp;
+    }
+
+    return (FLT_DBL) best;
+}
+
+/*
+ * Try the principal axes of the 3x3 symmetric matrix aa as orientations.
+ * Returns the least distance from TI with any of them as the symmetry axis,
+ * and sets rmat to the rotation to canonical orthorhombic orientation with
+ * them as the principal axes.
+ */
+static FLT_DBL
+try_axes (FLT_DBL * cc, double *aa, FLT_DBL * rmat)
+{
+int             ii, kk;
+double          temp[9], evals[3], evecs[9];
+FLT_DBL         vec[3];
+FLT_DBL         theta, phi, dist, best;
+
+    for (kk = 0; kk < 9; kk++)
+	temp[kk] = aa[kk];
+    jacobi_eigen (3, temp, evals, evecs);
+
+    best = -1.;
+    for (kk = 0; kk < 3; kk++)
+    {
+	for (ii = 0; ii < 3; ii++)
+	{
+	    vec[ii] = evecs[ii + 3 * kk];
+	    /* Principal axis kk goes to coordinate axis kk. */
+	    RMAT (ii, kk) = evecs[ii + 3 * kk];
+	}
+
+	vector_to_angles (vec, &phi, &theta);
+	dist = find_ti_axis (cc, theta, phi);
+	if (dist < best || best < 0.)
+	    best = dist;
+    }
+
+    return best;
+}
+
+/*
+ * Bounds on the distance from TI, or from Orthorhombic, that need no
+ * search.
+ *
+ * Input:
+ *	cc is a 6x6 array of Voigt-notation elastic stiffness constants.
+ *
+ * Output:
+ *	bounds[0] and bounds[1] are a lower and an upper bound on the
+ *	distance, in the same absolute units as find_ti and find_ortho.
+ */
+void
+ti_bounds (FLT_DBL * cc, FLT_DBL * bounds)
+{
+double          dd[9], vv[9];
+FLT_DBL         rmat[9];
+FLT_DBL         lower, upper, dist;
+
+    set_comb_norms ();
+    contracted_tensors (cc, dd, vv);
+
+    lower = uniaxial_bound (dd, vv);
+    dist = commutator_bound (dd, vv);
+    if (dist > lower)
+	lower = dist;
+
+    upper = iso_distance (cc);
+    dist = try_axes (cc, dd, rmat);
+    if (dist < upper)
+	upper = dist;
+    dist = try_axes (cc, vv, rmat);
+    if (dist < upper)
+	upper = dist;
+
+    /* The bounds are only as good as the arithmetic. */
+    bounds[0] = (lower < upper) ? lower : upper;
+    bounds[1] = upper;
+
+    return;
+}
+
+void
+ortho_bounds (FLT_DBL * cc, FLT_DBL * bounds)
+{
+double          dd[9], vv[9];
+FLT_DBL         rmat[9];
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         lower, upper, dist;
+
+    set_comb_norms ();
+    contracted_tensors (cc, dd, vv);
+
+    lower = commutator_bound (dd, vv);
+
+    pack_matrix_6x6 (ccp, cc);
+    upper = iso_distance (cc);
+    try_axes (cc, dd, rmat);
+    dist = rotated_ortho_distance ((void *) ccp, rmat);
+    if (dist < upper)
+	upper = dist;
+    try_axes (cc, vv, rmat);
+    dist = rotated_ortho_distance ((void *) ccp, rmat);
+    if (dist < upper)
+	upper = dist;
+
+    bounds[0] = (lower < upper) ? lower : upper;
+    bounds[1] = upper;
+
+    return;
+}
+
+/*
+ * Is the medium within threshold of TI (or of Orthorhombic)?
+ *
+ * Input:
+ *	cc is a 6x6 array of Voigt-notation elastic stiffness constants.
+ *	threshold is the largest acceptable distance, in the same absolute
+ *	units as find_ti and find_ortho (not normalized).
+ *
+ * Output:
+ *	bounds, if not a null pointer, is set to the lower and upper bounds
+ *	on the distance that decided the question. If it took a full search
+ *	to decide, both are the distance that search found.
+ *
+ * Return value:
+ *	1 if the distance is no more than threshold, 0 if not.
+ */
+int
+classify_ti (FLT_DBL * cc, FLT_DBL threshold, FLT_DBL * bounds)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         bb[2];
+FLT_DBL         theta, phi, dist;
+
+    ti_bounds (cc, bb);
+
+    if (bb[0] > threshold || bb[1] <= threshold)
+    {
+	if (bounds != (FLT_DBL *) 0)
+	{
+	    bounds[0] = bb[0];
+	    bounds[1] = bb[1];
+	}
+	return (bb[1] <= threshold);
+    }
+
+    /* The bounds straddle the threshold. Search until we know. */
+    search_defaults (&opts);
+    opts.stop_below = threshold;
+    pack_matrix_6x6 (ccp, cc);
+    dist = search_ti (rotated_ti_distance, (void *) ccp, &opts, &theta, &phi);
+
+    if (bounds != (FLT_DBL *) 0)
+    {
+	bounds[0] = (dist <= threshold) ? bb[0] : dist;
+	bounds[1] = dist;
+    }
+
+    return (dist <= threshold);
+}
+
+int
+classify_ortho (FLT_DBL * cc, FLT_DBL threshold, FLT_DBL * bounds)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         bb[2];
+FLT_DBL         rmat[9];
+FLT_DBL         dist;
+
+    ortho_bounds (cc, bb);
+
+    if (bb[0] > threshold || bb[1] <= threshold)
+    {
+	if (bounds != (FLT_DBL *) 0)
+	{
+	    bounds[0] = bb[0];
+	    bounds[1] = bb[1];
+	}
+	return (bb[1] <= threshold);
+    }
+
+    search_defaults (&opts);
+    opts.stop_below = threshold;
+    pack_matrix_6x6 (ccp, cc);
+    dist = search_ortho (rotated_ortho_distance, rotated_ti_distance,
+			 (void *) ccp, &opts, rmat);
+
+    if (bounds != (FLT_DBL *) 0)
+    {
+	bounds[0] = (dist <= threshold) ? bb[0] : dist;
+	bounds[1] = dist;
+    }
+
+    return (dist <= threshold);
+}
@@ -26,6 +26,17 @@
 #define FLT_DBL	float
 #endif
 
+/*
+ * The typed kernels (see typed_kernels.c) come in float (_f), double (_d),
+ * and long double (_l) versions. FLT_DBL_KERNEL(name) is the one that
+ * matches FLT_DBL.
+ */
+#ifdef DOUBLE_PRECISION
+#define FLT_DBL_KERNEL(name)	name ## _d
+#else
+#define FLT_DBL_KERNEL(name)	name ## _f
+#endif
+
 /* Pi / 180. */
 #define DEGTORAD (3.14159265358979323846264338327950288419716939937511/180.)
 
@@ -60,6 +71,20 @@ extern int      extern_voigt[3][3];
 #define CCT2(A,B,C,D)		CC2( (extern_voigt[(A)][(B)]) , (extern_voigt[(C)][(D)]) )
 
 
+/*
+ * Packed stiffness matrices (see packed_matrix.c): the 21 elements on and
+ * above the diagonal, C11 C12 ... C16 C22 ... C66. CCP(A,B) uses "C"
+ * Voigt notation, with the indices in either order. Batches of matrices
+ * ("ccs" arguments) hold PACKED_SIZE numbers per matrix.
+ */
+#define PACKED_SIZE	21
+extern int      extern_packed[6][6];
+
+#define CCP(A,B)		ccp[extern_packed[(A)][(B)]]
+#define CCP1(A,B)		ccp1[extern_packed[(A)][(B)]]
+#define CCP2(A,B)		ccp2[extern_packed[(A)][(B)]]
+
+
 /*
  * 3x3 rotation matrices
  */
@@ -68,25 +93,646 @@ extern int      extern_voigt[3][3];
 #define RMAT2(A,B)	rmat2[(B)+3*(A)]
 #define RMAT3(A,B)	rmat3[(B)+3*(A)]
 
+/*
+ * The orientation searches minimize a distance function. Given a trial
+ * rotation matrix rmat, it returns the distance from symmetry of the
+ * medium (or media) described by data, after applying that rotation.
+ */
+typedef FLT_DBL (*DIST_FUNC) (void *data, FLT_DBL * rmat);
+
+/*
+ * Options for the orientation searches (search_ti and search_ortho).
+ * Passing a null pointer instead gets the default behavior;
+ * search_defaults fills in the defaults.
+ */
+struct search_opts
+{
+    /*
+     * If not a null pointer, the distances at every point of the initial
+     * scan have already been found (see batch_scan.c). They are taken from
+     * here instead of being recalculated.
+     */
+    FLT_DBL        *scan;
+
+    /*
+     * The range of TI symmetry axes to search over (see find_ti.c), one of
+     *	SEARCH_ALL	every direction (the default);
+     *	SEARCH_AXIS	only the axis (theta, phi): no search is needed
+     *			(for search_ortho, one principal axis is fixed there
+     *			and only the azimuth about it is searched);
+     *	SEARCH_CONE	axes within max_dev degrees of the axis (theta, phi);
+     *	SEARCH_BOX	axes with phi (the angle from vertical, 0 to 90)
+     *			between phi_min and phi_max, and theta (the azimuth)
+     *			between theta_min and theta_max (going through 0 if
+     *			theta_max is the smaller).
+     * All angles are in degrees.
+     */
+    int             domain;
+    FLT_DBL         theta, phi, max_dev;
+    FLT_DBL         theta_min, theta_max, phi_min, phi_max;
+
+    /*
+     * If not negative, stop as soon as any trial orientation is found
+     * with a distance no more than this, and return that one. The answer
+     * is then only known to be good enough, not to be the best.
+     */
+    FLT_DBL         stop_below;
+
+    /*
+     * A budget for the search: if positive, the most distance evaluations
+     * it may make, and the most seconds (of elapsed time) it may take.
+     * When the budget runs out the best orientation found so far is
+     * returned. With a budget, the initial scan visits its points in a
+     * scattered order, so that a scan cut short still covers the domain.
+     * search_ortho makes three more evaluations after that, to put the
+     * principal axes in order.
+     */
+    long            max_evals;
+    double          max_seconds;
+
+    /*
+     * If positive, there is no initial scan: the search starts from the
+     * orientation passed in (*theta_best and *phi_best for search_ti,
+     * rmat for search_ortho) and refines it, starting with a grid spacing
+     * of this many degrees (or, if it is close enough to the answer for
+     * that to work, by Newton's method; see newton_refine.c). The answer
+     * can then move only a few times that far from where it started, so
+     * this is for when the medium has changed only a little since that
+     * orientation was found (see fit_state.c).
+     */
+    FLT_DBL         warm_inc;
+
+    /*
+     * Filled in by the search: the number of distance evaluations made,
+     * the angular resolution reached (in degrees), and whether the
+     * search ran to completion (1) or was cut short (0).
+     */
+    long            nevals;
+    FLT_DBL         resolution;
+    int             converged;
+
+    /*
+     * Filled in by search_ortho: how far (by ti_func) each of the X, Y,
+     * and Z principal axes it found is from being a TI symmetry axis.
+     */
+    FLT_DBL         axis_dist[3];
+
+    /* For the searches' own use */
+    double          start_time;
+    int             spent;
+};
+
+#define SEARCH_ALL	0
+#define SEARCH_AXIS	1
+#define SEARCH_CONE	2
+#define SEARCH_BOX	3
+
+/*
+ * Everything find_ti_result and find_ortho_result (see find_result.c) work
+ * out about the best-fitting medium. The matrices past rmat are only
+ * filled in if asked for, as shown by the RESULT_ bits in have:
+ *	RESULT_ROTATED		ccrot, the input rotated to canonical
+ *				orientation;
+ *	RESULT_APPROX		ccsym, the nearest symmetric medium to that;
+ *	RESULT_APPROX_ORIG	ccorig, ccsym rotated back to the original
+ *				coordinates;
+ *	RESULT_DEVIATION	ccdev, the input minus ccorig, as a percent
+ *				of norm.
+ */
+#define RESULT_ROTATED		1
+#define RESULT_APPROX		2
+#define RESULT_APPROX_ORIG	4
+#define RESULT_DEVIATION	8
+#define RESULT_ALL		15
+
+struct ti_result
+{
+    FLT_DBL         dist;	/* distance from TI */
+    FLT_DBL         norm;	/* norm of the input */
+    FLT_DBL         theta, phi;	/* the symmetry axis, as for find_ti */
+    FLT_DBL         axis[3];	/* ... and as a unit vector */
+    FLT_DBL         rmat[9];	/* rotation taking the axis to +Z */
+    int             have;
+    FLT_DBL         ccrot[6 * 6];
+    FLT_DBL         ccsym[6 * 6];
+    FLT_DBL         ccorig[6 * 6];
+    FLT_DBL         ccdev[6 * 6];
+};
+
+struct ortho_result
+{
+    FLT_DBL         dist;	/* distance from Orthorhombic */
+    FLT_DBL         norm;	/* norm of the input */
+    FLT_DBL         rmat[9];	/* rotation to canonical orientation */
+    FLT_DBL         axis[3][3];	/* the X, Y, and Z principal axes */
+    FLT_DBL         theta[3], phi[3];	/* ... in angles */
+    FLT_DBL         axis_dist[3];	/* distance from TI about each axis */
+    int             have;
+    FLT_DBL         ccrot[6 * 6];
+    FLT_DBL         ccsym[6 * 6];
+    FLT_DBL         ccorig[6 * 6];
+    FLT_DBL         ccdev[6 * 6];
+};
+
+/*
+ * A cache of search results (see result_cache.c), and the most numbers
+ * a result can have.
+ */
+struct result_cache;
+#define CACHE_RESULT_MAX	10
+
+/*
+ * The summary of a batch run (see summary.c).
+ */
+struct run_summary;
+
+/*
+ * A checkpoint file, for taking up a run again where it left off (see
+ * checkpoint.c).
+ */
+struct checkpoint;
+
+/*
+ * Telemetry for a batch run (see telemetry.c), and the stages of the run
+ * it times.
+ */
+struct telemetry;
+#define STAGE_PARSE	0	/* reading the matrices in */
+#define STAGE_SCAN	1	/* the batched coarse scan */
+#define STAGE_REFINE	2	/* refining what the scan found */
+#define STAGE_OUTPUT	3	/* writing the answers out */
+#define N_STAGES	4
+
+/*
+ * A pool of threads for searching in the background, and a search
+ * submitted to it (see search_pool.c).
+ */
+struct search_pool;
+struct search_job;
+
+/*
+ * How read_matrix_6x6 expects each matrix to be laid out
+ * (see read_matrix_layout): all 36 elements, or the 21 on and above
+ * the diagonal.
+ */
+#define READ_FULL	0
+#define READ_UPPER	1
+
+/*
+ * Output formats for batch runs (see write_records.c), the most fields a
+ * record can have, and the longest a field name can be.
+ */
+#define OUTPUT_TEXT	0
+#define OUTPUT_CSV	1
+#define OUTPUT_JSON	2
+#define OUTPUT_BINARY	3
+#define OUTPUT_FIELDS_MAX	64
+#define OUTPUT_NAME_MAX	32
+
+/*
+ * The most basis vectors a symmetric subspace can need (Orthorhombic).
+ * See projection_basis in vector21.c.
+ */
+#define MAX_BASIS	9
+
+/*
+ * A solved orientation search that can be updated cheaply as the medium
+ * changes a few constants at a time (see fit_state.c).
+ */
+#define FIT_TI		0
+#define FIT_ORTHO	1
+
+struct fit_state
+{
+    int             symmetry;	/* FIT_TI or FIT_ORTHO */
+    FLT_DBL         reach;	/* how far updates look, in degrees */
+    FLT_DBL         dist;	/* distance from symmetry */
+    FLT_DBL         theta, phi;	/* for FIT_TI, the symmetry axis */
+    FLT_DBL         rmat[9];	/* rotation to canonical orientation */
+    FLT_DBL         ccp[PACKED_SIZE];	/* the medium, packed */
+    FLT_DBL         ccrot[PACKED_SIZE];	/* ... rotated by rmat */
+    long            nevals;	/* evaluations made by the last call */
+};
+
+/*
+ * How find_volume (see volume.c) solved a volume: how many points had a
+ * full search to start with, how many were refined from their neighbors,
+ * and how many needed a full search after all.
+ */
+struct volume_stats
+{
+    long            ncoarse;
+    long            nwarm;
+    long            nglobal;
+};
+
+/*
+ * How far find_volume has got, so that a run that is cut short can be
+ * taken up again. done[nn] is nonzero once the answer at point nn is
+ * final; find_volume skips such points, and after marking about every
+ * more of them done, calls save with data.
+ */
+struct volume_progress
+{
+    unsigned char  *done;
+    long            every;
+    void            (*save) (void *data);
+    void           *data;
+};
+
+/*
+ * How many numbers find_volume gives the orientation at each point in:
+ * theta and phi for FIT_TI, and rmat for FIT_ORTHO
+ */
+#define VOLUME_NORIENT(symmetry)	(((symmetry) == FIT_ORTHO) ? 9 : 2)
+
+/*
+ * A volume run kept in a checkpoint (see volume_checkpoint_size in
+ * volume.c): the npoint answers (orient and dist, as for find_volume) and
+ * done flags (as for struct volume_progress) in memory, and which of the
+ * done points the checkpoint knows are done.
+ */
+struct volume_checkpoint
+{
+    struct checkpoint *ckpt;
+    int             symmetry;	/* FIT_TI or FIT_ORTHO */
+    long            npoint;
+    FLT_DBL        *orient;
+    FLT_DBL        *dist;
+    unsigned char  *done;
+    unsigned char  *saved;
+};
+
+/*
+ * The stages of a batch run, for batch_pipeline (see batch_pipeline.c).
+ * Each is passed data and one chunk of matrices in memory of the
+ * caller's choosing.
+ */
+struct batch_stages
+{
+    void           *data;
+    int             (*read) (void *data, void *chunk);
+    int             (*compute) (void *data, void *chunk);
+    int             (*write) (void *data, void *chunk);
+};
+
+/*
+ * A caller's array, for find_strided (see strided_batch.c): where its
+ * first element is, whether the elements are floats or doubles, and how
+ * many bytes apart successive elements are along each of its dimensions
+ * (as for NumPy's strides). Unused dimensions' strides are ignored.
+ */
+#define ARRAY_FLOAT	0
+#define ARRAY_DOUBLE	1
+
+struct strided_array
+{
+    void           *data;
+    int             type;	/* ARRAY_FLOAT or ARRAY_DOUBLE */
+    long            stride[3];
+};
+
+/*
+ * The answers find_strided can give; data a null pointer for any that
+ * aren't wanted. New members will only ever be added at the end.
+ */
+struct strided_results
+{
+    struct strided_array dist;
+    struct strided_array norm;
+    struct strided_array axis;
+    struct strided_array angles;
+    struct strided_array rmat;
+    struct strided_array approx;
+};
+
+/*
+ * How serve_requests (see serve.c) answers a request.
+ */
+struct serve_handler
+{
+    void           *data;	/* passed to answer */
+    int             (*answer) (void *data, FLT_DBL * ccp, double *values);
+    const char    **names;	/* the names of all the values */
+    int             nfield;	/* how many of them to send back */
+    int            *order;	/* ... and which */
+    double         *values;	/* room for all the values */
+    int             layout;	/* READ_FULL or READ_UPPER */
+};
+
+/*
+ * One chunk of a batch run (see batch_driver.c): up to BATCH_CHUNK
+ * matrices, and the answers for them. The orientation is in theta_best
+ * and phi_best for FIT_TI, and in rmat for FIT_ORTHO. axis_dist (only for
+ * FIT_ORTHO) and the last three are only filled in when they will be
+ * output.
+ */
+#define BATCH_CHUNK	256
+
+struct batch_chunk
+{
+    int             ncc;
+    FLT_DBL         ccs[PACKED_SIZE * BATCH_CHUNK];
+    FLT_DBL         theta_best[BATCH_CHUNK];
+    FLT_DBL         phi_best[BATCH_CHUNK];
+    FLT_DBL         rmat[9 * BATCH_CHUNK];
+    FLT_DBL         dist_best[BATCH_CHUNK];
+    FLT_DBL         axis_dist[3 * BATCH_CHUNK];
+    long            nevals[BATCH_CHUNK];
+    FLT_DBL         resolution[BATCH_CHUNK];
+    int             converged[BATCH_CHUNK];
+};
+
+/*
+ * What titest or orthotest tells the batch driver about itself: which
+ * symmetry it fits, and the fields it can output. The last nbudget
+ * fields are the number of evaluations, the resolution, and whether the
+ * search converged, only output with a budget, and filled in by the
+ * driver; values fills in the others that are chosen, for matrix nn of a
+ * chunk. The first ndefault are output by default, with the printf
+ * formats in text (each with the spaces that go before it) as plain text.
+ */
+struct batch_program
+{
+    const char     *name;	/* for messages */
+    int             symmetry;	/* FIT_TI or FIT_ORTHO */
+    const char    **fields;	/* the names of the fields */
+    const char    **text;	/* how to print the default ones */
+    int             nfield;	/* how many fields there are */
+    int             ndefault;	/* ... how many of them are the default */
+    int             nbudget;	/* ... and how many need a budget */
+    int             axis_field;	/* the first of the axis summarized */
+    int             tidist_field;	/* the first of the axis TI distances */
+    const char     *what;	/* the symmetry, for summary_print */
+    const char     *axis;	/* ... and the axis summarized */
+    void            (*values) (int *chosen, struct batch_chunk *ch, int nn,
+			       double *values);
+};
+
+/*
+ * The command-line options titest and orthotest share (see batch_parse).
+ */
+struct batch_options
+{
+    struct search_opts opts;	/* the search options */
+    int             group;	/* --group */
+    int             batch;	/* --batch */
+    int             serve;	/* --serve */
+    char           *serve_path;	/* ... and its socket, if any */
+    int             volume;	/* --volume */
+    int             dims[3];	/* ... and its size */
+    FLT_DBL         threshold;	/* --threshold, or -1 */
+    long            zone_size;	/* --summary, or -1 */
+    char           *output_path;	/* --output */
+    char           *ckpt_path;	/* --checkpoint */
+    double          interval;	/* --progress, or 0 */
+    char           *trace_path;	/* --trace */
+    int             layout;	/* READ_FULL, or READ_UPPER with --upper */
+    int             compliance;	/* --compliance */
+    int             compliance_out;	/* --compliance=both */
+    int             format;	/* --format */
+    char           *fields;	/* --fields */
+    int             nthreads;	/* --threads, or 0 */
+    int             cached;	/* --cache or --quantize */
+    char           *cache_path;	/* ... the cache file, if any */
+    double          quantum;	/* ... and --quantize, or 0 */
+};
+
 /*
  * Subroutines
  */
+void            rotate_packed_f (float *ccp2, float *ccp1, float *rmat);
+void            rotate_packed_d (double *ccp2, double *ccp1, double *rmat);
+void            rotate_packed_l (long double *ccp2, long double *ccp1,
+				 long double *rmat);
+float           norm_packed_f (float *ccp);
+double          norm_packed_d (double *ccp);
+long double     norm_packed_l (long double *ccp);
+float           packed_distance_f (float *ccp1, float *ccp2);
+double          packed_distance_d (double *ccp1, double *ccp2);
+long double     packed_distance_l (long double *ccp1, long double *ccp2);
+float           ti_distance_packed_f (float *ccp2, float *ccp1);
+double          ti_distance_packed_d (double *ccp2, double *ccp1);
+long double     ti_distance_packed_l (long double *ccp2, long double *ccp1);
+float           ortho_distance_packed_f (float *ccp2, float *ccp1);
+double          ortho_distance_packed_d (double *ccp2, double *ccp1);
+long double     ortho_distance_packed_l (long double *ccp2,
+					 long double *ccp1);
 void            rotate_tensor (FLT_DBL *, FLT_DBL *, FLT_DBL *);
+void            rotate_packed (FLT_DBL *, FLT_DBL *, FLT_DBL *);
+void            rotate_packed_sparse (FLT_DBL * ccp2, int nn, int *index,
+				      FLT_DBL * delta, FLT_DBL * rmat);
+void            pack_matrix_6x6 (FLT_DBL * ccp, FLT_DBL * cc);
+void            unpack_matrix_6x6 (FLT_DBL * cc, FLT_DBL * ccp);
+FLT_DBL         norm_packed (FLT_DBL * ccp);
+FLT_DBL         packed_distance (FLT_DBL * ccp1, FLT_DBL * ccp2);
+int             invert_packed_batch (int ncc, FLT_DBL * ccps2, FLT_DBL * ccps1,
+				     int *posdef);
+int             invert_matrix_6x6 (FLT_DBL * cc2, FLT_DBL * cc1);
+int             find_volume (int symmetry, int *dims, FLT_DBL * ccs,
+			     FLT_DBL agree, FLT_DBL * orient, FLT_DBL * dist,
+			     struct volume_stats *stats,
+			     struct volume_progress *progress);
+long            volume_checkpoint_size (int symmetry, int *dims);
+long            volume_checkpoint_read (struct volume_checkpoint *vc);
+int             volume_checkpoint_write (struct volume_checkpoint *vc);
 void            make_rotation_matrix (FLT_DBL, FLT_DBL, FLT_DBL, FLT_DBL *);
 void            transpose_matrix (FLT_DBL *, FLT_DBL *);
 void            quaternion_to_matrix (FLT_DBL *, FLT_DBL *);
+void            matrix_to_quaternion (FLT_DBL * rmat, FLT_DBL * qq);
+void            quaternion_multiply (FLT_DBL * qq, FLT_DBL * qq1,
+				     FLT_DBL * qq2);
+void            axis_to_rotation (FLT_DBL * vec, FLT_DBL * rmat);
 void            matrix_times_vector (FLT_DBL *, FLT_DBL *, FLT_DBL *);
 void            matrix_times_matrix (FLT_DBL *, FLT_DBL *, FLT_DBL *);
 void            print_matrix_6x6 (FLT_DBL *);
 void            format_print_matrix_6x6 (char *format, FLT_DBL *);
 void            print_matrix_3x3 (FLT_DBL *);
-void            read_matrix_6x6 (FLT_DBL *);
+int             read_matrix_6x6 (FLT_DBL *);
+int             read_matrix_packed (FLT_DBL * ccp);
+void            read_matrix_layout (int layout);
+int             format_double (char *buf, double value);
+int             output_format (const char *name);
+int             output_fields (const char *list, int nfield,
+			       const char **names, int *order);
+void            output_start (int format, const char **names, int nchosen,
+			      int *order);
+void            output_continue (int format, const char **names,
+				 int nchosen, int *order);
+void            output_record (double *values);
+void            output_finish (void);
 FLT_DBL         ti_distance (FLT_DBL *, FLT_DBL *);
 FLT_DBL         ortho_distance (FLT_DBL *, FLT_DBL *);
+FLT_DBL         ti_distance_packed (FLT_DBL *, FLT_DBL *);
+FLT_DBL         ortho_distance_packed (FLT_DBL *, FLT_DBL *);
 FLT_DBL         norm_matrix_6x6 (FLT_DBL *);
 void            vector_to_angles (FLT_DBL v[3], FLT_DBL *, FLT_DBL *);
+void            angles_to_vector (FLT_DBL phi, FLT_DBL theta, FLT_DBL v[3]);
+void            matrix_to_vector21 (FLT_DBL * xx, FLT_DBL * cc);
+void            vector21_to_matrix (FLT_DBL * cc, FLT_DBL * xx);
+void            packed_to_vector21 (FLT_DBL * xx, FLT_DBL * ccp);
+void            vector21_to_packed (FLT_DBL * ccp, FLT_DBL * xx);
+int             projection_basis (FLT_DBL (*project) (FLT_DBL *, FLT_DBL *),
+				  FLT_DBL basis[MAX_BASIS][PACKED_SIZE]);
+void            batch_scan_ti (int ncc, FLT_DBL * ccs, FLT_DBL * scan);
+void            batch_scan_ortho (int ncc, FLT_DBL * ccs, FLT_DBL * scan);
+void            find_ti_batch (int ncc, FLT_DBL * ccs, FLT_DBL * theta_best,
+			       FLT_DBL * phi_best, FLT_DBL * dist_best);
+void            find_ortho_batch (int ncc, FLT_DBL * ccs, FLT_DBL * rmat,
+				  FLT_DBL * dist_best);
+void            find_ti_timed (int ncc, FLT_DBL * ccs, FLT_DBL * theta_best,
+			       FLT_DBL * phi_best, FLT_DBL * dist_best,
+			       struct telemetry *tel);
+void            find_ortho_timed (int ncc, FLT_DBL * ccs, FLT_DBL * rmat,
+				  FLT_DBL * dist_best,
+				  struct telemetry *tel);
+FLT_DBL         rotated_ti_distance (void *ccp, FLT_DBL * rmat);
+FLT_DBL         rotated_ortho_distance (void *ccp, FLT_DBL * rmat);
 FLT_DBL         find_ti (FLT_DBL * cc, FLT_DBL * theta_best, FLT_DBL * phi_best);
+FLT_DBL         search_ti (DIST_FUNC ti_func, void *data,
+			   struct search_opts *opts,
+			   FLT_DBL * theta_best, FLT_DBL * phi_best);
+int             ti_scan_points (struct search_opts *opts,
+				FLT_DBL * theta_scan, FLT_DBL * phi_scan);
+FLT_DBL         find_ti_axis (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi);
+FLT_DBL         find_ti_cone (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi,
+			      FLT_DBL max_dev, FLT_DBL * theta_best,
+			      FLT_DBL * phi_best);
+FLT_DBL         find_ti_box (FLT_DBL * cc, FLT_DBL theta_min,
+			     FLT_DBL theta_max, FLT_DBL phi_min,
+			     FLT_DBL phi_max, FLT_DBL * theta_best,
+			     FLT_DBL * phi_best);
 FLT_DBL         find_ortho (FLT_DBL * cc, FLT_DBL * rmat);
+FLT_DBL         find_ti_result (FLT_DBL * cc, struct search_opts *opts,
+				int want, struct ti_result *res);
+FLT_DBL         find_ortho_result (FLT_DBL * cc, struct search_opts *opts,
+				   int want, struct ortho_result *res);
+FLT_DBL         ti_result_at (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi,
+			      FLT_DBL dist, int want, struct ti_result *res);
+FLT_DBL         ortho_result_at (FLT_DBL * cc, FLT_DBL * rmat, FLT_DBL dist,
+				 FLT_DBL * axis_dist, int want,
+				 struct ortho_result *res);
+void            ortho_axis_distances (FLT_DBL * ccp, FLT_DBL * rmat,
+				      FLT_DBL * dists);
+FLT_DBL         find_ortho_axis (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi,
+				 FLT_DBL * rmat);
+FLT_DBL         search_ortho (DIST_FUNC ortho_func, DIST_FUNC ti_func,
+			      void *data, struct search_opts *opts,
+			      FLT_DBL * rmat);
+int             ortho_scan_points (FLT_DBL * qq_scan);
+void            search_defaults (struct search_opts *opts);
+struct result_cache *cache_open (int nresult, double quantum,
+				 const char *path);
+void            cache_close (struct result_cache *cache);
+long            cache_count (struct result_cache *cache);
+int             cache_lookup (struct result_cache *cache, FLT_DBL * ccp,
+			      FLT_DBL * result);
+void            cache_insert (struct result_cache *cache, FLT_DBL * ccp,
+			      FLT_DBL * result);
+int             find_ti_cached (struct result_cache *cache, int ncc,
+				FLT_DBL * ccs, FLT_DBL * theta_best,
+				FLT_DBL * phi_best, FLT_DBL * dist_best);
+int             find_ortho_cached (struct result_cache *cache, int ncc,
+				   FLT_DBL * ccs, FLT_DBL * rmat,
+				   FLT_DBL * dist_best);
+void            search_start (struct search_opts *opts);
+int             search_spend (struct search_opts *opts);
+void            search_finish (struct search_opts *opts,
+			       FLT_DBL resolution, int converged);
+int             search_stride (struct search_opts *opts, int nscan);
+int             search_budgeted (struct search_opts *opts);
+FLT_DBL         find_ti_budget (FLT_DBL * cc, long max_evals,
+				double max_seconds, FLT_DBL * theta_best,
+				FLT_DBL * phi_best, FLT_DBL * resolution,
+				int *converged);
+FLT_DBL         find_ortho_budget (FLT_DBL * cc, long max_evals,
+				   double max_seconds, FLT_DBL * rmat,
+				   FLT_DBL * resolution, int *converged);
+void            ti_bounds (FLT_DBL * cc, FLT_DBL * bounds);
+void            ortho_bounds (FLT_DBL * cc, FLT_DBL * bounds);
+int             classify_ti (FLT_DBL * cc, FLT_DBL threshold,
+			     FLT_DBL * bounds);
+int             classify_ortho (FLT_DBL * cc, FLT_DBL threshold,
+				FLT_DBL * bounds);
+void            jacobi_eigen (int nn, double *aa, double *evals,
+			      double *vv);
+FLT_DBL         find_ti_group (int ncc, FLT_DBL * ccs, FLT_DBL * theta_best,
+			       FLT_DBL * phi_best, FLT_DBL * dists);
+FLT_DBL         find_ortho_group (int ncc, FLT_DBL * ccs, FLT_DBL * rmat,
+				  FLT_DBL * dists);
+FLT_DBL         ti_gradient (FLT_DBL * grad, FLT_DBL * cc, FLT_DBL * rmat);
+FLT_DBL         ortho_gradient (FLT_DBL * grad, FLT_DBL * cc, FLT_DBL * rmat);
+FLT_DBL         find_ti_gradient (FLT_DBL * cc, FLT_DBL * theta_best,
+				  FLT_DBL * phi_best, FLT_DBL * grad,
+				  FLT_DBL * daxis);
+FLT_DBL         find_ortho_gradient (FLT_DBL * cc, FLT_DBL * rmat,
+				     FLT_DBL * grad);
+int             newton_refine (FLT_DBL (*objective) (void *, FLT_DBL *),
+			       void *data, int npar, FLT_DBL max_step,
+			       struct search_opts *opts, FLT_DBL * par,
+			       FLT_DBL * dist, FLT_DBL * resolution);
+FLT_DBL         fit_start (struct fit_state *state, int symmetry,
+			   FLT_DBL * cc);
+FLT_DBL         fit_update (struct fit_state *state, int nn, int *ii,
+			    int *jj, FLT_DBL * delta);
+int             batch_pipeline (struct batch_stages *stages, int nthreads,
+				int nchunk, void **chunks);
+struct search_pool *pool_open (int nthreads, int njobs);
+void            pool_close (struct search_pool *pool);
+struct search_job *pool_submit (struct search_pool *pool, int symmetry,
+				FLT_DBL * cc, struct search_opts *opts,
+				int want, void *res);
+struct search_job *pool_submit_batch (struct search_pool *pool,
+				      int symmetry, int ncc, FLT_DBL * cc,
+				      struct search_opts *opts, int want,
+				      void *res);
+int             pool_ready (struct search_pool *pool,
+			    struct search_job *job);
+void            pool_wait (struct search_pool *pool,
+			   struct search_job *job);
+int             serve_requests (struct serve_handler *handler, int format,
+				const char *path);
+int             find_strided (int symmetry, long ncc,
+			      struct strided_array *cc, int layout,
+			      struct search_opts *opts, int nthreads,
+			      struct strided_results *res);
+struct run_summary *summary_open (long zone_size);
+void            summary_close (struct run_summary *sum);
+int             summary_add (struct run_summary *sum, long index,
+			     FLT_DBL percent, FLT_DBL * axis);
+int             summary_merge (struct run_summary *sum,
+			       struct run_summary *part);
+FLT_DBL         summary_quantile (struct run_summary *sum, double qq);
+void            summary_print (struct run_summary *sum, const char *what,
+			       const char *axis);
+unsigned long   checkpoint_signature (int argc, char **argv);
+struct checkpoint *checkpoint_open (const char *path,
+				    unsigned long signature, long size,
+				    int *resumed);
+int             checkpoint_read (struct checkpoint *ckpt, long offset,
+				 void *buf, long nbytes);
+int             checkpoint_write (struct checkpoint *ckpt, long offset,
+				  void *buf, long nbytes);
+int             checkpoint_due (struct checkpoint *ckpt);
+int             checkpoint_sync (struct checkpoint *ckpt, int output);
+long            checkpoint_tell (void);
+int             checkpoint_output (const char *path, long keep);
+void            checkpoint_close (struct checkpoint *ckpt, int finished);
+struct telemetry *telemetry_open (const char *name, double interval,
+				  const char *trace_path);
+void            telemetry_close (struct telemetry *tel);
+double          telemetry_clock (void);
+void            telemetry_span (struct telemetry *tel, int stage,
+				double start, long nitems);
+void            telemetry_progress (struct telemetry *tel);
+void            telemetry_report (struct telemetry *tel);
+int             batch_parse (struct batch_program *prog,
+			     struct batch_options *bo, int argc, char **argv);
+int             batch_main (struct batch_program *prog,
+			    struct batch_options *bo, int argc, char **argv);
+FLT_DBL        *batch_read_all (struct batch_program *prog, int *ncc);
+void            batch_compliance (struct batch_program *prog, int ncc,
+				  FLT_DBL * ccs, long first);
 
 /*
  * Author Joe Dellinger, February 1997
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Compliance matrices. In Voigt notation (with the usual factors of 2
+ * and 4 in the shear compliances) the compliance matrix S is simply the
+ * inverse of the stiffness matrix C, and C the inverse of S, so one
+ * routine converts either way.
+ *
+ * A physical medium's S and C are both positive definite, so the inverse
+ * is found from the factorization S = L D L^T (L unit lower triangular,
+ * D diagonal), which also tells us whether S is positive definite: it is
+ * if every element of D is positive. No pivoting is needed for that. An
+ * input that isn't positive definite is still inverted, if it can be,
+ * and flagged.
+ *
+ * Many matrices are inverted at once, COMPLIANCE_LANES at a time, with
+ * each element of the factorization held for all of them side by side.
+ * Every step of the factorization is then the same operation applied
+ * across the lanes, which the compiler can turn into vector instructions.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/* How many matrices are inverted together */
+#define COMPLIANCE_LANES	8
+
+/*
+ * A pivot no bigger than this, relative to the largest diagonal element,
+ * makes the matrix singular.
+ */
+#define COMPLIANCE_TINY	1.e-12
+
+/*
+ * Invert the packed matrices ccps1[0 ... nn-1], nn no more than
+ * COMPLIANCE_LANES, as for invert_packed_batch.
+ */
+static int
+invert_lanes (int nn, FLT_DBL * ccps2, FLT_DBL * ccps1, int *posdef)
+{
+double          aa[PACKED_SIZE][COMPLIANCE_LANES];
+double          ll[6][6][COMPLIANCE_LANES];
+double          xx[6][6][COMPLIANCE_LANES];
+double          dd[6][COMPLIANCE_LANES];
+double          dinv[6][COMPLIANCE_LANES];
+double          scale[COMPLIANCE_LANES];
+double          sum[COMPLIANCE_LANES];
+int             bad[COMPLIANCE_LANES];
+int             singular[COMPLIANCE_LANES];
+int             ii, jj, kk, lane, nbad;
+
+    /*
+     * Lay the matrices out side by side. Lanes beyond the last matrix get
+     * the identity, so they do no harm.
+     */
+    for (kk = 0; kk < PACKED_SIZE; kk++)
+	for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+	    aa[kk][lane] = (lane < nn) ?
+	     (double) ccps1[PACKED_SIZE * lane + kk] : 0.;
+    for (ii = 0; ii < 6; ii++)
+	for (lane = nn; lane < COMPLIANCE_LANES; lane++)
+	    aa[extern_packed[ii][ii]][lane] = 1.;
+
+    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+    {
+	scale[lane] = 0.;
+	bad[lane] = 0;
+	singular[lane] = 0;
+    }
+    for (ii = 0; ii < 6; ii++)
+	for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+	    if (fabs (aa[extern_packed[ii][ii]][lane]) > scale[lane])
+		scale[lane] = fabs (aa[extern_packed[ii][ii]][lane]);
+
+    /* S = L D L^T, a column at a time */
+    for (jj = 0; jj < 6; jj++)
+    {
+	for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+	    sum[lane] = aa[extern_packed[jj][jj]][lane];
+	for (kk = 0; kk < jj; kk++)
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		sum[lane] -= ll[jj][kk][lane] * ll[jj][kk][lane] * dd[kk][lane];
+
+	for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+	{
+	    dd[jj][lane] = sum[lane];
+	    bad[lane] |= (sum[lane] <= COMPLIANCE_TINY * scale[lane]);
+	    singular[lane] |= (fabs (sum[lane]) <= COMPLIANCE_TINY * scale[lane]);
+	    dinv[jj][lane] = singular[lane] ? 0. : 1. / sum[lane];
+	}
+
+	for (ii = jj + 1; ii < 6; ii++)
+	{
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		sum[lane] = aa[extern_packed[ii][jj]][lane];
+	    for (kk = 0; kk < jj; kk++)
+		for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		    sum[lane] -= ll[ii][kk][lane] * ll[jj][kk][lane] *
+		     dd[kk][lane];
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		ll[ii][jj][lane] = sum[lane] * dinv[jj][lane];
+	}
+    }
+
+    /* X = L^-1, also unit lower triangular */
+    for (jj = 0; jj < 6; jj++)
+    {
+	for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+	    xx[jj][jj][lane] = 1.;
+	for (ii = jj + 1; ii < 6; ii++)
+	{
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		sum[lane] = -ll[ii][jj][lane];
+	    for (kk = jj + 1; kk < ii; kk++)
+		for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		    sum[lane] -= ll[ii][kk][lane] * xx[kk][jj][lane];
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		xx[ii][jj][lane] = sum[lane];
+	}
+    }
+
+    /* S^-1 = X^T D^-1 X */
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	{
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		sum[lane] = 0.;
+	    for (kk = jj; kk < 6; kk++)
+		for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		    sum[lane] += xx[kk][ii][lane] * xx[kk][jj][lane] *
+		     dinv[kk][lane];
+	    for (lane = 0; lane < COMPLIANCE_LANES; lane++)
+		aa[extern_packed[ii][jj]][lane] = singular[lane] ? 0. :
+		 sum[lane];
+	}
+
+    nbad = 0;
+    for (lane = 0; lane < nn; lane++)
+    {
+	for (kk = 0; kk < PACKED_SIZE; kk++)
+	    ccps2[PACKED_SIZE * lane + kk] = (FLT_DBL) aa[kk][lane];
+	if (posdef != (int *) 0)
+	    posdef[lane] = singular[lane] ? -1 : !bad[lane];
+	nbad += bad[lane];
+    }
+
+    return nbad;
+}
+
+/*
+ * Invert a batch of packed symmetric matrices: compliances to stiffnesses,
+ * or back again.
+ *
+ * Input:
+ *	ccps1 holds ncc packed matrices.
+ *
+ * Output:
+ *	ccps2 holds their inverses. It may be the same as ccps1.
+ *	posdef, if not a null pointer, says for each matrix: 1 if it was
+ *	positive definite, 0 if it wasn't (but its inverse was still found),
+ *	or -1 if it was singular (and its "inverse" is all zeros).
+ *
+ * Return value:
+ *	How many of the matrices were not positive definite.
+ */
+int
+invert_packed_batch (int ncc, FLT_DBL * ccps2, FLT_DBL * ccps1, int *posdef)
+{
+int             nn, nbad;
+
+    nbad = 0;
+    for (nn = 0; nn < ncc; nn += COMPLIANCE_LANES)
+	nbad += invert_lanes ((ncc - nn < COMPLIANCE_LANES) ?
+			      ncc - nn : COMPLIANCE_LANES,
+			      ccps2 + PACKED_SIZE * nn,
+			      ccps1 + PACKED_SIZE * nn,
+			      (posdef != (int *) 0) ? posdef + nn :
+			      (int *) 0);
+
+    return nbad;
+}
+
+/*
+ * Invert a single 6x6 matrix cc1 (only its upper triangle is used) into
+ * cc2. Return as for posdef in invert_packed_batch.
+ */
+int
+invert_matrix_6x6 (FLT_DBL * cc2, FLT_DBL * cc1)
+{
+FLT_DBL         ccp[PACKED_SIZE];
+int             posdef;
+
+    pack_matrix_6x6 (ccp, cc1);
+    invert_lanes (1, ccp, ccp, &posdef);
+    unpack_matrix_6x6 (cc2, ccp);
+
+    return posdef;
+}
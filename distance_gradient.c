@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Sensitivities of the distance from TI or Orthorhombic with respect to
+ * the 21 input elastic constants.
+ *
+ * The distance is found by minimizing over orientation, so at the optimum
+ * the distance is stationary with respect to small changes in orientation.
+ * To first order a change in the elastic constants thus changes the
+ * distance only through the projection residual at the optimal
+ * orientation, and the orientation itself can be held fixed:
+ *
+ * d = | Crot - P(Crot) |,   Crot = R C,
+ *
+ * where R is the optimal rotation and P is the (orthogonal) projection
+ * onto VTI or canonically oriented Orthorhombic media. Differentiating,
+ *
+ * dd/dCpqrs = [ R^T (Crot - P(Crot)) ]pqrs / d .
+ *
+ * In Voigt notation each independent constant C_IJ stands for several
+ * tensor elements at once, and the tensor derivatives must be summed over
+ * all of them.
+ *
+ * The gradients are returned as a 6x6 Voigt array grad, with
+ * grad(I,J) = grad(J,I) the derivative with respect to the single
+ * independent constant C_IJ = C_JI.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * Step, in radians, for the finite differences in orientation used
+ * to find the sensitivity of the TI symmetry axis.
+ */
+#define AXIS_STEP	(1.e-4)
+
+/*
+ * How many tensor elements a single independent Voigt constant C_IJ
+ * stands for.
+ */
+static FLT_DBL
+voigt_multiplicity (int ii, int jj)
+{
+FLT_DBL         mult;
+
+    mult = 1.;
+    if (ii >= 3)
+	mult *= 2.;
+    if (jj >= 3)
+	mult *= 2.;
+    if (ii != jj)
+	mult *= 2.;
+
+    return mult;
+}
+
+/*
+ * Given the rotated medium ccrot, its nearest symmetric approximation
+ * ccsym, and the rotation rmat that produced ccrot, find the gradient
+ * of the SQUARED distance with respect to the unrotated constants.
+ */
+static void
+residual_gradient (FLT_DBL * grad, FLT_DBL * ccrot, FLT_DBL * ccsym,
+		   FLT_DBL * rmat)
+{
+int             ii, jj;
+FLT_DBL         cc1[6 * 6];
+FLT_DBL         cc2[6 * 6];
+FLT_DBL         rmat_transp[9];
+
+    for (ii = 0; ii < 36; ii++)
+	cc1[ii] = ccrot[ii] - ccsym[ii];
+
+    /* Rotate the residual back to the original coordinate system. */
+    transpose_matrix (rmat_transp, rmat);
+    rotate_tensor (cc2, cc1, rmat_transp);
+
+    for (ii = 0; ii < 6; ii++)
+	for (jj = 0; jj < 6; jj++)
+	    grad[jj + 6 * ii] =
+	     2. * voigt_multiplicity (ii, jj) * CC2 (ii, jj);
+
+    return;
+}
+
+/*
+ * Gradient of the distance from VTI, for the rotation rmat that takes
+ * the optimal TI symmetry axis to +Z.
+ *
+ * Input:
+ *	cc is the unrotated 6x6 elastic stiffness matrix.
+ *	rmat is the optimal rotation, as found by find_ti.
+ *
+ * Output:
+ *	grad is the 6x6 array of sensitivities.
+ *
+ * Return value:
+ *	The distance from TI.
+ */
+FLT_DBL
+ti_gradient (FLT_DBL * grad, FLT_DBL * cc, FLT_DBL * rmat)
+{
+int             ii;
+FLT_DBL         ccrot[6 * 6];
+FLT_DBL         ccti[6 * 6];
+FLT_DBL         dist;
+
+    rotate_tensor (ccrot, cc, rmat);
+    dist = ti_distance (ccti, ccrot);
+    residual_gradient (grad, ccrot, ccti, rmat);
+
+    /*
+     * d(dist) = d(dist^2) / (2 dist). At zero distance the distance has
+     * a kink; return the zero subgradient.
+     */
+    for (ii = 0; ii < 36; ii++)
+	grad[ii] = (dist > 0.) ? grad[ii] / (2. * dist) : 0.;
+
+    return dist;
+}
+
+/*
+ * Gradient of the distance from Orthorhombic, for the rotation rmat that
+ * takes the medium to its canonical orientation.
+ *
+ * Input:
+ *	cc is the unrotated 6x6 elastic stiffness matrix.
+ *	rmat is the optimal rotation, as found by find_ortho.
+ *
+ * Output:
+ *	grad is the 6x6 array of sensitivities.
+ *
+ * Return value:
+ *	The distance from Orthorhombic.
+ */
+FLT_DBL
+ortho_gradient (FLT_DBL * grad, FLT_DBL * cc, FLT_DBL * rmat)
+{
+int             ii;
+FLT_DBL         ccrot[6 * 6];
+FLT_DBL         ccortho[6 * 6];
+FLT_DBL         dist;
+
+    rotate_tensor (ccrot, cc, rmat);
+    dist = ortho_distance (ccortho, ccrot);
+    residual_gradient (grad, ccrot, ccortho, rmat);
+
+    for (ii = 0; ii < 36; ii++)
+	grad[ii] = (dist > 0.) ? grad[ii] / (2. * dist) : 0.;
+
+    return dist;
+}
+
+/*
+ * Squared distance from TI, and its gradient with respect to the elastic
+ * constants, for the trial symmetry axis v0 + alpha v1 + beta v2.
+ */
+static FLT_DBL
+ti_perturbed (FLT_DBL * grad, FLT_DBL * cc, FLT_DBL * v0, FLT_DBL * v1,
+	      FLT_DBL * v2, FLT_DBL alpha, FLT_DBL beta)
+{
+int             kk;
+FLT_DBL         vv[3];
+FLT_DBL         rmat[9];
+FLT_DBL         ccrot[6 * 6];
+FLT_DBL         ccti[6 * 6];
+FLT_DBL         dist;
+
+    for (kk = 0; kk < 3; kk++)
+	vv[kk] = v0[kk] + alpha * v1[kk] + beta * v2[kk];
+
+    axis_to_rotation (vv, rmat);
+    rotate_tensor (ccrot, cc, rmat);
+    dist = ti_distance (ccti, ccrot);
+
+    if (grad != (FLT_DBL *) 0)
+	residual_gradient (grad, ccrot, ccti, rmat);
+
+    return dist * dist;
+}
+
+/*
+ * Find the best-approximating TI medium, as find_ti does, and also the
+ * sensitivities of the result to the input elastic constants.
+ *
+ * On input:
+ *	cc is a 6x6 array of Voigt-notation elastic stiffness constants.
+ *
+ * On output:
+ *	theta_best, phi_best are as for find_ti.
+ *	grad is the 6x6 array of distance sensitivities (see above).
+ *	daxis, if not a null pointer, is three consecutive 6x6 arrays;
+ *	daxis[36*k + 6*I + J] is the sensitivity of the k'th cartesian
+ *	component of the unit symmetry axis vector to C_IJ.
+ *
+ * The axis sensitivities come from the implicit-function theorem: the
+ * gradient of the distance with respect to orientation vanishes at the
+ * optimum, so the change in optimal orientation is minus the inverse of
+ * the orientation Hessian times the mixed orientation / constant second
+ * derivatives. Those few second derivatives are found by finite
+ * differences at the optimum, so no further search is needed.
+ *
+ * Return value:
+ *	The distance from TI, as for find_ti.
+ */
+FLT_DBL
+find_ti_gradient (FLT_DBL * cc, FLT_DBL * theta_best, FLT_DBL * phi_best,
+		  FLT_DBL * grad, FLT_DBL * daxis)
+{
+int             ii, kk;
+FLT_DBL         rmat[9];
+FLT_DBL         rmat_transp[9];
+FLT_DBL         vec[3];
+FLT_DBL         v0[3], v1[3], v2[3];
+FLT_DBL         dist;
+FLT_DBL         f0, fpa, fma, fpb, fmb, fpp, fpm, fmp, fmm;
+FLT_DBL         haa, hab, hbb, det;
+FLT_DBL         gpa[6 * 6], gma[6 * 6], gpb[6 * 6], gmb[6 * 6];
+FLT_DBL         ga, gb, dalpha, dbeta;
+FLT_DBL         hh;
+
+    dist = find_ti (cc, theta_best, phi_best);
+
+    make_rotation_matrix (*theta_best, *phi_best, 0., rmat);
+    ti_gradient (grad, cc, rmat);
+
+    if (daxis == (FLT_DBL *) 0)
+	return dist;
+
+    for (ii = 0; ii < 3 * 36; ii++)
+	daxis[ii] = 0.;
+
+    /*
+     * v0 is the symmetry axis; v1 and v2 are perpendicular to it and to
+     * each other. Perturb the axis in the directions of v1 and v2.
+     */
+    transpose_matrix (rmat_transp, rmat);
+    vec[0] = 0.;
+    vec[1] = 0.;
+    vec[2] = 1.;
+    matrix_times_vector (v0, rmat_transp, vec);
+    vec[0] = 1.;
+    vec[1] = 0.;
+    vec[2] = 0.;
+    matrix_times_vector (v1, rmat_transp, vec);
+    vec[0] = 0.;
+    vec[1] = 1.;
+    vec[2] = 0.;
+    matrix_times_vector (v2, rmat_transp, vec);
+
+    hh = tan (AXIS_STEP);
+
+    /* The orientation Hessian of the squared distance */
+    f0 = ti_perturbed ((FLT_DBL *) 0, cc, v0, v1, v2, 0., 0.);
+    fpa = ti_perturbed (gpa, cc, v0, v1, v2, hh, 0.);
+    fma = ti_perturbed (gma, cc, v0, v1, v2, -hh, 0.);
+    fpb = ti_perturbed (gpb, cc, v0, v1, v2, 0., hh);
+    fmb = ti_perturbed (gmb, cc, v0, v1, v2, 0., -hh);
+    fpp = ti_perturbed ((FLT_DBL *) 0, cc, v0, v1, v2, hh, hh);
+    fpm = ti_perturbed ((FLT_DBL *) 0, cc, v0, v1, v2, hh, -hh);
+    fmp = ti_perturbed ((FLT_DBL *) 0, cc, v0, v1, v2, -hh, hh);
+    fmm = ti_perturbed ((FLT_DBL *) 0, cc, v0, v1, v2, -hh, -hh);
+
+    haa = (fpa - 2. * f0 + fma) / (hh * hh);
+    hbb = (fpb - 2. * f0 + fmb) / (hh * hh);
+    hab = (fpp - fpm - fmp + fmm) / (4. * hh * hh);
+
+    /*
+     * If the Hessian is singular the axis is not well determined (for
+     * example, the medium is isotropic), and its sensitivity is undefined.
+     * Leave it zero.
+     */
+    det = haa * hbb - hab * hab;
+    if (det <= 0. || det <= 1.e-12 * (haa * haa + hbb * hbb))
+	return dist;
+
+    for (ii = 0; ii < 36; ii++)
+    {
+	/* Mixed derivatives: how the constant-gradient turns the axis */
+	ga = (gpa[ii] - gma[ii]) / (2. * hh);
+	gb = (gpb[ii] - gmb[ii]) / (2. * hh);
+
+	dalpha = -(hbb * ga - hab * gb) / det;
+	dbeta = -(haa * gb - hab * ga) / det;
+
+	for (kk = 0; kk < 3; kk++)
+	    daxis[36 * kk + ii] = dalpha * v1[kk] + dbeta * v2[kk];
+    }
+
+    return dist;
+}
+
+/*
+ * Find the best-approximating Orthorhombic medium, as find_ortho does,
+ * and also the sensitivities of the distance to the input elastic
+ * constants.
+ *
+ * On input:
+ *	cc is a 6x6 array of Voigt-notation elastic stiffness constants.
+ *
+ * On output:
+ *	rmat is as for find_ortho.
+ *	grad is the 6x6 array of distance sensitivities (see above).
+ *
+ * Return value:
+ *	The distance from Orthorhombic, as for find_ortho.
+ */
+FLT_DBL
+find_ortho_gradient (FLT_DBL * cc, FLT_DBL * rmat, FLT_DBL * grad)
+{
+FLT_DBL         dist;
+
+    dist = find_ortho (cc, rmat);
+    ortho_gradient (grad, cc, rmat);
+
+    return dist;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Find the single TI symmetry axis, or the single orthorhombic frame,
+ * shared by a whole group of stiffness matrices: the orientation that
+ * minimizes the sum of the squared distances of all of them from
+ * symmetry.
+ *
+ * Trying each trial orientation by rotating every matrix in the group
+ * would cost N tensor rotations per trial. Instead we precombine the group.
+ * Write each medium as a 21-vector x_i (see vector21.c), so that squared
+ * distances are ordinary squared Euclidean lengths. The nearest VTI (or
+ * canonical orthorhombic) medium is an orthogonal projection onto a
+ * subspace, with orthonormal basis b_1, ..., b_K (K = 5 or 9). Rotating by
+ * R preserves lengths, so
+ *
+ *	sum_i d_i(R)^2 = sum_i |x_i|^2 - sum_i sum_k (b_k . R x_i)^2
+ *		       = trace(M) - sum_k (R^T b_k) . M (R^T b_k),
+ *
+ * where M = sum_i x_i x_i^T is a fixed 21x21 matrix. Each trial rotation
+ * then only needs K basis tensors rotated, however big the group is.
+ *
+ * Because the objective is found as a difference, when the group is
+ * extremely close to symmetric it is only accurate to about the square root
+ * of machine precision relative to the norm; the distances reported are
+ * recalculated directly from the rotated matrices once the orientation
+ * is found.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * Everything the distance functions need to know about the group.
+ */
+struct group_data
+{
+    FLT_DBL         moment[21 * 21];
+    FLT_DBL         total;
+    int             nti;
+    FLT_DBL         ti_basis[MAX_BASIS][PACKED_SIZE];
+    int             northo;
+    FLT_DBL         ortho_basis[MAX_BASIS][PACKED_SIZE];
+};
+
+/*
+ * Root-sum-square distance of the group from symmetry after rotating
+ * by rmat, given the basis for the symmetric subspace.
+ */
+static FLT_DBL
+group_distance (struct group_data *group, int nbasis,
+		FLT_DBL basis[MAX_BASIS][PACKED_SIZE], FLT_DBL * rmat)
+{
+int             ii, jj, kk;
+FLT_DBL         rmat_transp[9];
+FLT_DBL         ccp1[PACKED_SIZE];
+FLT_DBL         yy[21];
+double          energy, temp;
+
+    transpose_matrix (rmat_transp, rmat);
+
+    energy = 0.;
+    for (kk = 0; kk < nbasis; kk++)
+    {
+	rotate_packed (ccp1, basis[kk], rmat_transp);
+	packed_to_vector21 (yy, ccp1);
+
+	for (ii = 0; ii < 21; ii++)
+	{
+	    temp = 0.;
+	    for (jj = 0; jj < 21; jj++)
+		temp += group->moment[jj + 21 * ii] * yy[jj];
+	    energy += yy[ii] * temp;
+	}
+    }
+
+    temp = group->total - energy;
+    return (FLT_DBL) sqrt (temp > 0. ? temp : 0.);
+}
+
+/*
+ * Distance functions for search_ti and search_ortho.
+ */
+static FLT_DBL
+group_ti_distance (void *data, FLT_DBL * rmat)
+{
+struct group_data *group = (struct group_data *) data;
+
+    return group_distance (group, group->nti, group->ti_basis, rmat);
+}
+
+static FLT_DBL
+group_ortho_distance (void *data, FLT_DBL * rmat)
+{
+struct group_data *group = (struct group_data *) data;
+
+    return group_distance (group, group->northo, group->ortho_basis, rmat);
+}
+
+/*
+ * Precombine the group.
+ */
+static void
+group_setup (struct group_data *group, int ncc, FLT_DBL * ccs)
+{
+int             ii, jj, nn;
+FLT_DBL         xx[21];
+
+    for (ii = 0; ii < 21 * 21; ii++)
+	group->moment[ii] = 0.;
+
+    for (nn = 0; nn < ncc; nn++)
+    {
+	packed_to_vector21 (xx, ccs + PACKED_SIZE * nn);
+	for (ii = 0; ii < 21; ii++)
+	    for (jj = 0; jj < 21; jj++)
+		group->moment[jj + 21 * ii] += xx[ii] * xx[jj];
+    }
+
+    group->total = 0.;
+    for (ii = 0; ii < 21; ii++)
+	group->total += group->moment[ii + 21 * ii];
+
+    group->nti = projection_basis (ti_distance_packed, group->ti_basis);
+    group->northo = projection_basis (ortho_distance_packed,
+				      group->ortho_basis);
+
+    return;
+}
+
+/*
+ * Find the distance of each member of the group from symmetry once the
+ * shared orientation rmat is known.
+ *
+ * Return value: the root-sum-square of those distances.
+ */
+static FLT_DBL
+group_residuals (DIST_FUNC dist_func, int ncc, FLT_DBL * ccs,
+		 FLT_DBL * rmat, FLT_DBL * dists)
+{
+int             nn;
+FLT_DBL         dist;
+double          temp;
+
+    temp = 0.;
+    for (nn = 0; nn < ncc; nn++)
+    {
+	dist = dist_func ((void *) (ccs + PACKED_SIZE * nn), rmat);
+	if (dists != (FLT_DBL *) 0)
+	    dists[nn] = dist;
+	temp += dist * dist;
+    }
+
+    return (FLT_DBL) sqrt (temp);
+}
+
+/*
+ * Find the TI symmetry axis shared by a group of media.
+ *
+ * On input:
+ *	ncc is the number of stiffness matrices in the group.
+ *	ccs holds the ncc packed stiffness matrices one after the other.
+ *
+ * On output:
+ *	theta_best, phi_best give the shared symmetry axis, as for find_ti.
+ *	dists, if not a null pointer, holds the distance from TI of each
+ *	member of the group, using that shared axis.
+ *
+ * Return value:
+ *	The square root of the sum of the squared distances.
+ */
+FLT_DBL
+find_ti_group (int ncc, FLT_DBL * ccs, FLT_DBL * theta_best,
+	       FLT_DBL * phi_best, FLT_DBL * dists)
+{
+struct group_data group;
+FLT_DBL         rmat[9];
+
+    group_setup (&group, ncc, ccs);
+
+    search_ti (group_ti_distance, (void *) &group, (struct search_opts *) 0,
+	       theta_best, phi_best);
+
+    make_rotation_matrix (*theta_best, *phi_best, 0., rmat);
+    return group_residuals (rotated_ti_distance, ncc, ccs, rmat, dists);
+}
+
+/*
+ * Find the orthorhombic frame shared by a group of media.
+ *
+ * On input:
+ *	ncc is the number of stiffness matrices in the group.
+ *	ccs holds the ncc packed stiffness matrices one after the other.
+ *
+ * On output:
+ *	rmat is the shared rotation to canonical orientation, as for
+ *	find_ortho. The axes are ordered by how well they serve as a
+ *	TI symmetry axis for the group as a whole.
+ *	dists, if not a null pointer, holds the distance from Orthorhombic
+ *	of each member of the group, in that shared frame.
+ *
+ * Return value:
+ *	The square root of the sum of the squared distances.
+ */
+FLT_DBL
+find_ortho_group (int ncc, FLT_DBL * ccs, FLT_DBL * rmat, FLT_DBL * dists)
+{
+struct group_data group;
+
+    group_setup (&group, ncc, ccs);
+
+    search_ortho (group_ortho_distance, group_ti_distance, (void *) &group,
+		  (struct search_opts *) 0, rmat);
+
+    return group_residuals (rotated_ortho_distance, ncc, ccs, rmat, dists);
+}
@@ -15,9 +15,10 @@
  *
  * We want to find the nearest Orthorhombic medium regardless of the
  * orientation of the symmetry planes. This subroutine scans over all possible
- * unique orientations, and finds a trial orthorhombic orientation that
- * produces a minimum distance. It then refines the search in that vicinity
- * until it converges to an optimal answer.
+ * unique orientations, and finds the few best distinct trial orthorhombic
+ * orientations that produce a local minimum distance. It then refines the
+ * search in the vicinity of each until it converges to an optimal answer,
+ * and keeps the best of those.
  *
  * On input:
  *	cc is a 6x6 array of Voigt-notation elastic stiffness constants.
@@ -41,126 +42,379 @@
 
 /* How much to refine after each successive search */
 #define SUBDIVIDE	5
+/*
+ * The most times in a row refine_ortho may move its grid over without
+ * shrinking it, following a minimum that lies off the edge.
+ */
+#define MAX_SLIDE	50
+/*
+ * Once refine_ortho's grid spacing is below this it tries to finish by
+ * Newton's method (see newton_refine.c), which is much quicker than going
+ * on by grid.
+ */
+#define POLISH_INC	1.e-3
 /* How much to subdivide the rotation around the axis */
 #define SUB_ROT		29
 /* How much to subdivide the choice of axis */
 #define SUB_POS		5
 
+/*
+ * How many distinct local minima of the initial scan to refine.
+ * For weakly orthorhombic media several basins can be nearly equally
+ * good at the resolution of the initial scan, and the best point found
+ * by the initial scan does not always lie in the basin that refines
+ * to the global minimum.
+ */
+#define N_BASIN		4
+/*
+ * Two orientations whose principal axes all agree to within BASIN_SEP
+ * degrees, allowing for any relabeling of the axes, are in the same basin.
+ */
+#define BASIN_SEP	10.
+
 #ifdef DOUBLE_PRECISION
 #define END_RES		(1.e-9)
 #else
 #define END_RES		(1.e-6)
 #endif
 
-#define NOT_SET_YET	1000.
 #define NO_NORM		-1.
 
-FLT_DBL
-find_ortho (FLT_DBL * cc, FLT_DBL * rmat)
+/*
+ * How many trial azimuths to use when one principal axis is fixed
+ * (see azimuth_ortho). At least 5 are needed.
+ */
+#define N_AZIM		8
+
+/* The number of points in the initial scan */
+#define N_SCAN		(SUB_ROT * SUB_POS * SUB_POS * SUB_POS)
+
+/*
+ * Calculate the quaternion for one point of a 4-dimensional search grid.
+ */
+static void
+grid_quaternion (FLT_DBL * qq, int *qindex, int *count,
+		 double *center, double *range)
 {
 int             kk;
-FLT_DBL         ccrot[6 * 6];
-FLT_DBL         ccortho[6 * 6];
-FLT_DBL         ccrot2[6 * 6];
-FLT_DBL         ccti[6 * 6];
-FLT_DBL         rmat_transp[9];
-FLT_DBL         rmat_temp[9];
-FLT_DBL         rmat_temp2[9];
-FLT_DBL         vec[3];
-FLT_DBL         vec2[3];
-FLT_DBL         dist;
-FLT_DBL         dista[3];
-FLT_DBL         qq[4], qq_best[4];
-double          center[4];
-double          range[4];
-int             count[4];
-int             qindex[4];
-double          inc[4];
-FLT_DBL         phi, theta;
-FLT_DBL         temp;
-FLT_DBL         dist_best;
 
+    for (kk = 0; kk < 4; kk++)
+    {
+	/*
+	 * The term in parenthesis ranges from -1 to +1, inclusive, so qq
+	 * ranges from (-range+center) to (+range + center).
+	 */
+	qq[kk] =
+	 range[kk] *
+	 (((FLT_DBL)
+	   (2 * qindex[kk] -
+	    (count[kk] -
+	     1))) / ((FLT_DBL) (count[kk] - 1))) + center[kk];
+    }
+
+    return;
+}
 
 /*
- * Keep the compiler from complaining that this may be uninitialized.
+ * Find the distance from orthorhombic after rotating by the quaternion qq.
  */
-    dist_best = NO_NORM;
+static FLT_DBL
+quaternion_distance (DIST_FUNC ortho_func, void *data, FLT_DBL * qq)
+{
+FLT_DBL         rmat[9];
+
+    /*
+     * Convert from a quaternion to a rotation matrix. The subroutine also
+     * takes care of normalizing the quaternion.
+     */
+    quaternion_to_matrix (qq, rmat);
+
+    /*
+     * Find the distance of the rotated medium from orthorhombic aligned with
+     * the coordinate axes.
+     */
+    return ortho_func (data, rmat);
+}
 
 /*
- * Search over all possible orientations.
- *
- * Any orientation in 3-space can be specified by a unit vector,
- * giving an axis to rotate around, and an angle to rotate about
- * the given axis. The orientation is given with respect to some
- * fixed reference orientation.
- *
- * Since rotating by theta degrees about (A,B,C) produces the same
- * result as rotating -theta degrees about (-A,-B,-C), we only
- * need to consider 180 degrees worth of angles, not 360.
- *
- * In this application, we are finding the orientation of an orthorhombic
- * medium. Orthorhombic symmetry has three orthogonal symmetry planes,
- * so any one octant defines the whole. We thus only need to search
- * over rotation axes within one octant.
- *
- * Following the article in EDN, March 2, 1995, on page 95, author
- * "Do-While Jones" (a pen name of R. David Pogge),
- * "Quaternions quickly transform coordinates without error buildup",
- * we use quaternions to express the rotation. The article can be read
- * online here:
- * http://www.reed-electronics.com/ednmag/archives/1995/030295/05df3.htm
- *
- * If (A,B,C) is a unit vector to rotate theta degrees about, then:
- *
- * q0 = Cos (theta/2)
- * q1 = A * Sin(theta/2)
- * q2 = B * Sin(theta/2)
- * q3 = C * Sin(theta/2)
+ * For a warm start (see newton_refine.c): the distance with the
+ * orientation qq turned further by a small rotation par (about the X, Y,
+ * and Z axes, in radians).
+ */
+struct ortho_chart
+{
+    DIST_FUNC       ortho_func;
+    void           *data;
+    FLT_DBL         qq[4];
+};
+
+static void
+ortho_chart_quaternion (struct ortho_chart *chart, FLT_DBL * par,
+			FLT_DBL * qq)
+{
+FLT_DBL         qq_small[4];
+
+    qq_small[0] = 1.;
+    qq_small[1] = par[0] / 2.;
+    qq_small[2] = par[1] / 2.;
+    qq_small[3] = par[2] / 2.;
+    quaternion_multiply (qq, qq_small, chart->qq);
+    return;
+}
+
+static FLT_DBL
+ortho_chart_distance (void *data, FLT_DBL * par)
+{
+struct ortho_chart *chart = (struct ortho_chart *) data;
+FLT_DBL         qq[4];
+
+    ortho_chart_quaternion (chart, par, qq);
+    return quaternion_distance (chart->ortho_func, chart->data, qq);
+}
+
+/*
+ * Decide whether two orientations, given as quaternions, describe the
+ * same orthorhombic frame to within BASIN_SEP degrees. Since any
+ * relabeling of the principal axes (with any change of sign) gives an
+ * equivalent orthorhombic medium, they do if the relative rotation
+ * between them takes each coordinate axis close to plus or minus some
+ * coordinate axis.
+ */
+static int
+same_basin (FLT_DBL * qq1, FLT_DBL * qq2)
+{
+int             ii, jj;
+FLT_DBL         qq2_inv[4], qq3[4];
+FLT_DBL         rmat3[9];
+FLT_DBL         biggest;
+
+    /*
+     * The relative rotation, qq1 after undoing qq2. The conjugate of a
+     * quaternion is the inverse rotation (quaternion_to_matrix takes care
+     * of the normalization).
+     */
+    qq2_inv[0] = qq2[0];
+    qq2_inv[1] = -qq2[1];
+    qq2_inv[2] = -qq2[2];
+    qq2_inv[3] = -qq2[3];
+    quaternion_multiply (qq3, qq1, qq2_inv);
+    quaternion_to_matrix (qq3, rmat3);
+
+    for (ii = 0; ii < 3; ii++)
+    {
+	biggest = 0.;
+	for (jj = 0; jj < 3; jj++)
+	{
+	    if (fabs (RMAT3 (ii, jj)) > biggest)
+		biggest = fabs (RMAT3 (ii, jj));
+	}
+
+	if (biggest < cos (BASIN_SEP * DEGTORAD))
+	    return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Pick out the best N_BASIN distinct local minima of the initial scan.
  *
- * so that q0^2 + q1^2 + q2^2 + q3^2 = 1. (A unit magnitude quaternion
- * represents a pure rotation, with no change in scale).
+ * Input:
+ *	dscan holds the distances for the initial scan, with qindex[0]
+ *	varying fastest. count, center, and range define the scan grid.
  *
- * For our case, taking advantage of the orthorhombic symmetry to
- * restrict the search space, we have:
- * 0 <= A <= 1
- * 0 <= B <= 1
- * 0 <= C <= 1
- * 0 <= theta <= 180 degrees.
- * The rotation axis direction is limited to within one octant,
- * and the rotation about that axis is limited to half of the full circle.
+ * Output:
+ *	basin_qq and basin_dist are the quaternions and distances of the
+ *	local minima found, sorted best first.
  *
- * In terms of quaternions, this bounds all four elements between 0 and 1,
- * inclusive.
+ * Return value:
+ *	The number of local minima found (at least 1, at most N_BASIN).
  */
+static int
+scan_minima (FLT_DBL * dscan, int *count, double *center, double *range,
+	     FLT_DBL basin_qq[N_BASIN][4], FLT_DBL * basin_dist)
+{
+int             ii, jj, kk, nn;
+int             nbasin, nmin;
+int             qindex[4];
+int             nindex[4];
+int             ineigh;
+int             mins[N_SCAN];
+FLT_DBL         qq[4];
 
     /*
-     * How much to subdivide each quaternion axis in the original scan. These
-     * were somewhat arbitrarily chosen. These choices appear to be overkill,
-     * but that ensures we won't accidentally miss the correct result by
-     * insufficient sampling of the search space.
+     * Find the local minima, comparing each point against all 80 of its
+     * neighbors in the 4-dimensional grid. Ties are broken by grid index
+     * so that a flat region yields only a single minimum.
      */
+    nmin = 0;
+    for (ii = 0; ii < N_SCAN; ii++)
+    {
+	qindex[0] = ii % count[0];
+	qindex[1] = (ii / count[0]) % count[1];
+	qindex[2] = (ii / (count[0] * count[1])) % count[2];
+	qindex[3] = ii / (count[0] * count[1] * count[2]);
+
+	for (nn = 0; nn < 81; nn++)
+	{
+	    nindex[0] = qindex[0] + nn % 3 - 1;
+	    nindex[1] = qindex[1] + (nn / 3) % 3 - 1;
+	    nindex[2] = qindex[2] + (nn / 9) % 3 - 1;
+	    nindex[3] = qindex[3] + nn / 27 - 1;
+
+	    for (kk = 0; kk < 4; kk++)
+	    {
+		if (nindex[kk] < 0 || nindex[kk] >= count[kk])
+		    break;
+	    }
+	    if (kk < 4)
+		continue;
+
+	    ineigh = nindex[0] + count[0] *
+	     (nindex[1] + count[1] * (nindex[2] + count[2] * nindex[3]));
+
+	    if (dscan[ineigh] < dscan[ii] ||
+		(dscan[ineigh] == dscan[ii] && ineigh < ii))
+		break;
+	}
+
+	if (nn == 81)
+	    mins[nmin++] = ii;
+    }
+
     /*
-     * We sample the rotation angle more finely than the rotation axis.
+     * Repeatedly take the best remaining local minimum. Points on opposite
+     * faces of the search box can be equivalent by symmetry, so skip any
+     * that duplicate a better one we already have.
      */
-    count[0] = SUB_ROT;
-    count[1] = SUB_POS;
-    count[2] = SUB_POS;
-    count[3] = SUB_POS;
+    nbasin = 0;
+    while (nbasin < N_BASIN && nmin > 0)
+    {
+	jj = 0;
+	for (ii = 1; ii < nmin; ii++)
+	{
+	    if (dscan[mins[ii]] < dscan[mins[jj]])
+		jj = ii;
+	}
+
+	ii = mins[jj];
+	mins[jj] = mins[--nmin];
+
+	qindex[0] = ii % count[0];
+	qindex[1] = (ii / count[0]) % count[1];
+	qindex[2] = (ii / (count[0] * count[1])) % count[2];
+	qindex[3] = ii / (count[0] * count[1] * count[2]);
+	grid_quaternion (qq, qindex, count, center, range);
+
+	for (jj = 0; jj < nbasin; jj++)
+	{
+	    if (same_basin (qq, basin_qq[jj]))
+		break;
+	}
+	if (jj < nbasin)
+	    continue;
+
+	for (kk = 0; kk < 4; kk++)
+	    basin_qq[nbasin][kk] = qq[kk];
+	basin_dist[nbasin] = dscan[ii];
+	nbasin++;
+    }
+
+    return nbasin;
+}
+
+/*
+ * Roughly the angular resolution, in degrees, of a quaternion grid with
+ * increments inc: a small change dq in a unit quaternion is a rotation
+ * by about 2 |dq| radians.
+ */
+static FLT_DBL
+quaternion_resolution (double *inc)
+{
+int             kk;
+double          biggest;
+
+    biggest = 0.;
+    for (kk = 0; kk < 4; kk++)
+	if (inc[kk] > biggest)
+	    biggest = inc[kk];
+
+    return (FLT_DBL) (2. * biggest / DEGTORAD);
+}
+
+/*
+ * Refine the search around qq_best, progressively shrinking the search
+ * grid until the required accuracy is achieved.
+ *
+ * On input:
+ *	qq_best is the starting point, dist_best its distance, and inc the
+ *	grid increments of the search that found it.
+ *	opts, if not a null pointer, may end the search early, either
+ *	because a distance no more than opts->stop_below was found or
+ *	because the budget ran out (opts->spent is then set).
+ *
+ * On output:
+ *	qq_best is the refined answer.
+ *	resolution is the angular resolution reached, in degrees.
+ *
+ * Return value:
+ *	The distance at qq_best.
+ *
+ * The grid starts out with the finest of the increments inc along every
+ * axis. If the best point of a round is on the edge of its grid, the
+ * minimum may well lie beyond it; then the grid is only moved over to
+ * center on it, not shrunk, and searched again at the same spacing (up
+ * to MAX_SLIDE times in a row). Edges along an axis that is close to the
+ * direction of the quaternion itself don't count: moving that way mostly
+ * just rescales the quaternion, which doesn't change the rotation, so
+ * which end of the grid wins there is down to rounding. Once the grid is
+ * fine enough (POLISH_INC), Newton's method takes over.
+ */
+static FLT_DBL
+refine_ortho (DIST_FUNC ortho_func, void *data, FLT_DBL * qq_best,
+	      FLT_DBL dist_best, double *inc_start,
+	      struct search_opts *opts, FLT_DBL * resolution)
+{
+int             kk;
+int             edge, nslide;
+FLT_DBL         dist;
+FLT_DBL         res;
+FLT_DBL         par[3];
+struct ortho_chart chart;
+FLT_DBL         dist_prev;
+FLT_DBL         stop_below;
+FLT_DBL         qq[4];
+FLT_DBL         qq_prev[4];
+double          center[4];
+double          range[4];
+double          qq_size;
+int             count[4];
+int             qindex[4];
+int             qindex_best[4];
+double          inc[4];
+double          inc_min;
 
     /*
-     * Between 0. and 1. for all 4 Q's   (That is .5 +- .5.)
+     * To avoid any possible problem caused by the optimal solution landing
+     * at an edge, we search over twice the distance between the two search
+     * points from the previous iteration.
      */
+    inc_min = inc_start[0];
+    for (kk = 1; kk < 4; kk++)
+    {
+	if (inc_start[kk] < inc_min)
+	    inc_min = inc_start[kk];
+    }
     for (kk = 0; kk < 4; kk++)
     {
-	range[kk] = .5;
-	center[kk] = .5;
-	/*
-	 * A number meaning "not set yet", to get us through the loop the
-	 * first time. Needs to be much bigger than END_RES.
-	 */
-	inc[kk] = NOT_SET_YET;
+	inc[kk] = inc_min;
+	center[kk] = qq_best[kk];
+	count[kk] = SUBDIVIDE;
+	range[kk] = inc[kk];
     }
-
+    stop_below = (opts != (struct search_opts *) 0) ? opts->stop_below : -1.;
+    *resolution = quaternion_resolution (inc);
+    nslide = 0;
 
     while (inc[0] > END_RES && inc[1] > END_RES &&
 	   inc[2] > END_RES && inc[3] > END_RES)
@@ -173,11 +427,9 @@ FLT_DBL         dist_best;
 	    inc[kk] = (2. * range[kk]) / (FLT_DBL) (count[kk] - 1);
 	}
 
-	/*
-	 * Start the 4-dimensional search. Keep track of the best result
-	 * found so far. The distance must be non-negative; we use -1 to mean
-	 * "not set yet".
-	 */
+	dist_prev = dist_best;
+	for (kk = 0; kk < 4; kk++)
+	    qq_prev[kk] = qq_best[kk];
 	dist_best = NO_NORM;
 
 	for (qindex[3] = 0; qindex[3] < count[3]; qindex[3]++)
@@ -185,42 +437,9 @@ FLT_DBL         dist_best;
 		for (qindex[1] = 0; qindex[1] < count[1]; qindex[1]++)
 		    for (qindex[0] = 0; qindex[0] < count[0]; qindex[0]++)
 		    {
-			/*
-			 * Calculate the quaternion for this search point.
-			 */
-			for (kk = 0; kk < 4; kk++)
-			{
-			    /*
-			     * The term in parenthesis ranges from -1 to +1,
-			     * inclusive, so qq ranges from (-range+center)
-			     * to (+range + center).
-			     */
-			    qq[kk] =
-			     range[kk] *
-			     (((FLT_DBL)
-			       (2 * qindex[kk] -
-				(count[kk] -
-				 1))) / ((FLT_DBL) (count[kk] - 1))) +
-			     center[kk];
-			}
-
-			/*
-			 * Convert from a quaternion to a rotation matrix.
-			 * The subroutine also takes care of normalizing the
-			 * quaternion.
-			 */
-			quaternion_to_matrix (qq, rmat);
-			/*
-			 * Apply the rotation matrix to the elastic stiffness
-			 * matrix.
-			 */
-			rotate_tensor (ccrot, cc, rmat);
-
-			/*
-			 * Find the distance of the rotated medium from
-			 * orthorhombic aligned with the coordinate axes.
-			 */
-			dist = ortho_distance (ccortho, ccrot);
+			grid_quaternion (qq, qindex, count, center, range);
+			dist = quaternion_distance (ortho_func, data, qq);
+			search_spend (opts);
 
 			/*
 			 * If it's the best found so far, or the first time
@@ -230,90 +449,122 @@ FLT_DBL         dist_best;
 			{
 			    dist_best = dist;
 			    for (kk = 0; kk < 4; kk++)
+			    {
 				qq_best[kk] = qq[kk];
+				qindex_best[kk] = qindex[kk];
+			    }
+			}
+
+			/*
+			 * Good enough, or out of time? If so, don't lose
+			 * the previous round's answer if it was better.
+			 */
+			if ((stop_below >= 0. && dist_best <= stop_below) ||
+			    (opts != (struct search_opts *) 0 && opts->spent))
+			{
+			    if (dist_prev < dist_best)
+			    {
+				dist_best = dist_prev;
+				for (kk = 0; kk < 4; kk++)
+				    qq_best[kk] = qq_prev[kk];
+			    }
+			    return dist_best;
 			}
 		    }
 
 	/*
-	 * Refine for the next, finer, search. To avoid any possible problem
-	 * caused by the optimal solution landing at an edge, we search over
-	 * twice the distance between the two search points from the previous
-	 * iteration.
+	 * Center the next search on the new best point. If that was on the
+	 * edge of the grid (and better than where we started), search the
+	 * same range again around it; otherwise search a finer grid.
 	 */
+	qq_size = 0.;
+	for (kk = 0; kk < 4; kk++)
+	    qq_size += center[kk] * center[kk];
+	edge = 0;
 	for (kk = 0; kk < 4; kk++)
 	{
-	    center[kk] = qq_best[kk];
-	    count[kk] = SUBDIVIDE;
-	    range[kk] = inc[kk];
+	    if ((qindex_best[kk] == 0 || qindex_best[kk] == count[kk] - 1) &&
+		center[kk] * center[kk] < .75 * qq_size)
+		edge = 1;
+	}
+	if (edge && dist_best < dist_prev && nslide < MAX_SLIDE)
+	    nslide++;
+	else
+	{
+	    nslide = 0;
+	    for (kk = 0; kk < 4; kk++)
+		range[kk] = inc[kk];
 	}
+	for (kk = 0; kk < 4; kk++)
+	    center[kk] = qq_best[kk];
+	*resolution = quaternion_resolution (inc);
 
 	/*
-	 * We keep refining and searching the ever finer grid until we
-	 * achieve the required accuracy, at which point we fall out the
-	 * bottom of the loop here.
+	 * Close enough in to finish by Newton's method? If that doesn't
+	 * work, carry on by grid.
 	 */
+	if (nslide == 0 && inc[0] < POLISH_INC && inc[1] < POLISH_INC &&
+	    inc[2] < POLISH_INC && inc[3] < POLISH_INC)
+	{
+	    chart.ortho_func = ortho_func;
+	    chart.data = data;
+	    for (kk = 0; kk < 4; kk++)
+		chart.qq[kk] = qq_best[kk];
+	    if (newton_refine (ortho_chart_distance, (void *) &chart, 3,
+			       8. * POLISH_INC, opts, par, &dist, &res) &&
+		dist <= dist_best)
+	    {
+		ortho_chart_quaternion (&chart, par, qq_best);
+		*resolution = res;
+		return dist;
+	    }
+	}
     }
 
-    /*
-     * We've got the answer to sufficient resolution... clean it up a bit,
-     * then output it.
-     */
+    return dist_best;
+}
 
-    /*
-     * Convert the best answer from a Quaternion back to a rotation matrix
-     */
-    quaternion_to_matrix (qq_best, rmat);
+/*
+ * To make the order of the axes unique, we sort the principal axes
+ * according to how well they work as a TI symmetry axis, as measured by
+ * ti_func. rmat is the rotation to canonical orientation found by the
+ * search; on output the axes it maps to X, Y, and Z have been relabeled
+ * in that order. If opts is not a null pointer, the three distances are
+ * left in opts->axis_dist, in the new order, and counted in opts->nevals.
+ * They are made even when the search's budget has run out: without them
+ * the answer can't be put in order.
+ */
+static void
+order_axes (DIST_FUNC ti_func, void *data, FLT_DBL * rmat,
+	    struct search_opts *opts)
+{
+int             ii, kk;
+FLT_DBL         rmat_temp[9];
+FLT_DBL         rmat_temp2[9];
+FLT_DBL         vec[3];
+FLT_DBL         dista[3];
+FLT_DBL         temp;
 
     /*
-     * To make the order of the axes unique, we sort the principal axes
-     * according to how well they work as a TI symmetry axis.
-     * 
-     * Specifically, since after rotation the medium is canonically oriented,
+     * Since after rotation the medium is canonically oriented,
      * with the X, Y, and Z axes the principal axes, the INVERSE rotation
      * must take the X, Y, and Z axes to the original arbitrarily oriented
-     * principal axes. So we first inverse-rotate a coordinate axis back to a
-     * principal axis. We then use vector_to_angles to give us the Euler
-     * angles theta and phi for the principal axis. make_rotation_matrix then
-     * constructs a rotation matrix that rotates that principal axis to +Z.
-     * We then use that matrix to rotate the tensor. We then measure its
-     * distance from VTI, and remember that distance.
-     */
-
-    /*
-     * First we need to find the inverse (the same as the transpose, because
-     * it's _unitary_) of the rotation matrix rmat.
+     * principal axes. The inverse is the transpose (rmat is _unitary_), so
+     * the principal axis that rmat takes to the k'th coordinate axis is
+     * simply rmat[k], rmat[3+k], rmat[6+k]. axis_to_rotation constructs a
+     * rotation matrix that rotates that principal axis to +Z. We then use
+     * that matrix to rotate the tensor. We then measure its distance from
+     * VTI, and remember that distance.
      */
-    transpose_matrix (rmat_transp, rmat);
-
-    /* Test the X axis */
-    vec[0] = 1.;
-    vec[1] = 0.;
-    vec[2] = 0.;
-    matrix_times_vector (vec2, rmat_transp, vec);
-    vector_to_angles (vec2, &phi, &theta);
-    make_rotation_matrix (theta, phi, 0., rmat_temp);
-    rotate_tensor (ccrot2, cc, rmat_temp);
-    dista[0] = ti_distance (ccti, ccrot2);
-
-    /* Test the Y axis */
-    vec[0] = 0.;
-    vec[1] = 1.;
-    vec[2] = 0.;
-    matrix_times_vector (vec2, rmat_transp, vec);
-    vector_to_angles (vec2, &phi, &theta);
-    make_rotation_matrix (theta, phi, 0., rmat_temp);
-    rotate_tensor (ccrot2, cc, rmat_temp);
-    dista[1] = ti_distance (ccti, ccrot2);
-
-    /* Test the Z axis */
-    vec[0] = 0.;
-    vec[1] = 0.;
-    vec[2] = 1.;
-    matrix_times_vector (vec2, rmat_transp, vec);
-    vector_to_angles (vec2, &phi, &theta);
-    make_rotation_matrix (theta, phi, 0., rmat_temp);
-    rotate_tensor (ccrot2, cc, rmat_temp);
-    dista[2] = ti_distance (ccti, ccrot2);
+    for (kk = 0; kk < 3; kk++)
+    {
+	for (ii = 0; ii < 3; ii++)
+	    vec[ii] = rmat[kk + 3 * ii];
+	axis_to_rotation (vec, rmat_temp);
+	dista[kk] = ti_func (data, rmat_temp);
+    }
+    if (opts != (struct search_opts *) 0)
+	opts->nevals += 3;
 
 
     /*
@@ -372,5 +623,499 @@ FLT_DBL         dist_best;
      */
     matrix_times_matrix (rmat, rmat_temp, rmat_temp2);
 
+    if (opts != (struct search_opts *) 0)
+    {
+	opts->axis_dist[0] = dista[0];
+	opts->axis_dist[1] = dista[1];
+	opts->axis_dist[2] = dista[2];
+    }
+
+    return;
+}
+
+/*
+ * Search only over rotations that keep one principal axis in the direction
+ * given by theta and phi (as for find_ti), so that the only unknown is the
+ * azimuth psi of the other two axes about it.
+ *
+ * make_rotation_matrix (theta, phi, psi) first takes the fixed axis to +Z,
+ * then turns the medium by psi about Z. Each rotated elastic constant is a
+ * trigonometric polynomial of degree at most 4 in psi, so the squared
+ * distance from Orthorhombic is one of degree at most 8. Turning a
+ * canonically oriented orthorhombic medium by 90 degrees about Z leaves it
+ * canonically oriented, so the squared distance also has period 90 degrees.
+ * Only the constant and the 4 psi and 8 psi harmonics are left: five
+ * coefficients, found exactly from N_AZIM equally spaced trial azimuths.
+ * The minimum of that is then found with one more distance evaluation.
+ *
+ * The evaluations are counted in opts, if not a null pointer, and the
+ * search is finished there. If the budget runs out, or opts->stop_below is
+ * reached, before all the trial azimuths are done, the best of those tried
+ * is returned instead.
+ *
+ * Return value: the distance at the best azimuth, with rmat set to the
+ * rotation that produced it.
+ */
+static FLT_DBL
+azimuth_ortho (DIST_FUNC ortho_func, void *data, FLT_DBL theta, FLT_DBL phi,
+	       struct search_opts *opts, FLT_DBL * rmat)
+{
+int             kk, nn, kbest;
+double          dist2[N_AZIM];
+double          aa[3], bb[3];
+double          uu, uu_best, gg, gg_best, dg, ddg, step;
+FLT_DBL         dist;
+FLT_DBL         stop_below;
+
+    stop_below = (opts != (struct search_opts *) 0) ? opts->stop_below : -1.;
+
+    kbest = 0;
+    for (kk = 0; kk < N_AZIM; kk++)
+    {
+	make_rotation_matrix (theta, phi, 90. * kk / N_AZIM, rmat);
+	dist = ortho_func (data, rmat);
+	dist2[kk] = dist * dist;
+	search_spend (opts);
+
+	if (dist2[kk] < dist2[kbest])
+	    kbest = kk;
+
+	/*
+	 * Good enough, or out of time? The widest gap left between the
+	 * azimuths tried is 90 (N_AZIM - kk) / N_AZIM degrees, so the best
+	 * so far is only known to within about half that.
+	 */
+	if ((stop_below >= 0. && dist <= stop_below) ||
+	    (opts != (struct search_opts *) 0 && opts->spent))
+	{
+	    make_rotation_matrix (theta, phi, 90. * kbest / N_AZIM, rmat);
+	    search_finish (opts, 45. * (N_AZIM - kk) / N_AZIM, 0);
+	    return sqrt (dist2[kbest]);
+	}
+    }
+
+    /*
+     * In terms of uu = 4 psi (in radians), the squared distance is
+     * aa[0] + aa[1] cos(uu) + bb[1] sin(uu) + aa[2] cos(2 uu) + bb[2] sin(2 uu).
+     * The constant term doesn't matter for finding the minimum.
+     */
+    for (nn = 1; nn < 3; nn++)
+    {
+	aa[nn] = 0.;
+	bb[nn] = 0.;
+	for (kk = 0; kk < N_AZIM; kk++)
+	{
+	    uu = 360. * DEGTORAD * kk / N_AZIM;
+	    aa[nn] += 2. * dist2[kk] * cos (nn * uu) / N_AZIM;
+	    bb[nn] += 2. * dist2[kk] * sin (nn * uu) / N_AZIM;
+	}
+    }
+
+    /*
+     * Find the lowest point on a fine grid, then polish it with Newton's
+     * method. The polynomial has at most two minima, so a grid of 360 can't
+     * miss the right one.
+     */
+    uu_best = 0.;
+    gg_best = 0.;
+    for (kk = 0; kk < 360; kk++)
+    {
+	uu = kk * DEGTORAD;
+	gg = aa[1] * cos (uu) + bb[1] * sin (uu) +
+	 aa[2] * cos (2. * uu) + bb[2] * sin (2. * uu);
+	if (kk == 0 || gg < gg_best)
+	{
+	    gg_best = gg;
+	    uu_best = uu;
+	}
+    }
+
+    for (kk = 0; kk < 20; kk++)
+    {
+	dg = -aa[1] * sin (uu_best) + bb[1] * cos (uu_best) -
+	 2. * aa[2] * sin (2. * uu_best) + 2. * bb[2] * cos (2. * uu_best);
+	ddg = -aa[1] * cos (uu_best) - bb[1] * sin (uu_best) -
+	 4. * aa[2] * cos (2. * uu_best) - 4. * bb[2] * sin (2. * uu_best);
+
+	/* Flat or not convex here; the grid answer is as good as any. */
+	if (ddg <= 0.)
+	    break;
+
+	step = dg / ddg;
+	if (fabs (step) > DEGTORAD)
+	    break;
+	uu_best -= step;
+	if (fabs (step) < 1.e-15)
+	    break;
+    }
+
+    make_rotation_matrix (theta, phi, uu_best / (4. * DEGTORAD), rmat);
+    dist = ortho_func (data, rmat);
+    search_spend (opts);
+    search_finish (opts, 0., 1);
+
+    return dist;
+}
+
+FLT_DBL
+find_ortho (FLT_DBL * cc, FLT_DBL * rmat)
+{
+FLT_DBL         ccp[PACKED_SIZE];
+
+    pack_matrix_6x6 (ccp, cc);
+    return search_ortho (rotated_ortho_distance, rotated_ti_distance,
+			 (void *) ccp, (struct search_opts *) 0, rmat);
+}
+
+/*
+ * find_ortho, but giving up when a budget of max_evals distance
+ * evaluations or max_seconds of elapsed time (either, if positive) runs
+ * out, as for find_ti_budget.
+ */
+FLT_DBL
+find_ortho_budget (FLT_DBL * cc, long max_evals, double max_seconds,
+		   FLT_DBL * rmat, FLT_DBL * resolution, int *converged)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         dist;
+
+    search_defaults (&opts);
+    opts.max_evals = max_evals;
+    opts.max_seconds = max_seconds;
+
+    pack_matrix_6x6 (ccp, cc);
+    dist = search_ortho (rotated_ortho_distance, rotated_ti_distance,
+			 (void *) ccp, &opts, rmat);
+
+    *resolution = opts.resolution;
+    *converged = opts.converged;
+    return dist;
+}
+
+/*
+ * As find_ortho, but with one principal axis fixed in the direction
+ * given by theta and phi (as for find_ti). The axes are still ordered as
+ * for find_ortho, so the fixed one may end up as any of X, Y, or Z.
+ */
+FLT_DBL
+find_ortho_axis (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi, FLT_DBL * rmat)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+
+    search_defaults (&opts);
+    opts.domain = SEARCH_AXIS;
+    opts.theta = theta;
+    opts.phi = phi;
+
+    pack_matrix_6x6 (ccp, cc);
+    return search_ortho (rotated_ortho_distance, rotated_ti_distance,
+			 (void *) ccp, &opts, rmat);
+}
+
+/*
+ * Set up the grid for the initial scan (see the discussion in search_ortho
+ * below).
+ */
+static void
+scan_grid (int *count, double *center, double *range)
+{
+int             kk;
+
+    /*
+     * How much to subdivide each quaternion axis in the original scan. These
+     * were somewhat arbitrarily chosen. These choices appear to be overkill,
+     * but that ensures we won't accidentally miss the correct result by
+     * insufficient sampling of the search space.
+     */
+    /*
+     * We sample the rotation angle more finely than the rotation axis.
+     */
+    count[0] = SUB_ROT;
+    count[1] = SUB_POS;
+    count[2] = SUB_POS;
+    count[3] = SUB_POS;
+
+    /*
+     * Between 0. and 1. for all 4 Q's   (That is .5 +- .5.)
+     */
+    for (kk = 0; kk < 4; kk++)
+    {
+	range[kk] = .5;
+	center[kk] = .5;
+    }
+
+    return;
+}
+
+/*
+ * List the quaternions of the initial scan, in the order that search_ortho
+ * tries them.
+ *
+ * On output:
+ *	qq_scan holds 4 elements for each point, one point after another.
+ *	If it is a null pointer the points are only counted.
+ *
+ * Return value: the number of points in the scan.
+ */
+int
+ortho_scan_points (FLT_DBL * qq_scan)
+{
+int             nscan;
+double          center[4];
+double          range[4];
+int             count[4];
+int             qindex[4];
+
+    scan_grid (count, center, range);
+
+    nscan = 0;
+    for (qindex[3] = 0; qindex[3] < count[3]; qindex[3]++)
+	for (qindex[2] = 0; qindex[2] < count[2]; qindex[2]++)
+	    for (qindex[1] = 0; qindex[1] < count[1]; qindex[1]++)
+		for (qindex[0] = 0; qindex[0] < count[0]; qindex[0]++)
+		{
+		    if (qq_scan != (FLT_DBL *) 0)
+			grid_quaternion (qq_scan + 4 * nscan, qindex, count,
+					 center, range);
+		    nscan++;
+		}
+
+    return nscan;
+}
+
+/*
+ * The search itself. This is the same as find_ortho, except that the
+ * distance from orthorhombic of a trial rotation is found by calling
+ * ortho_func, and the distance from VTI (used to order the axes) by calling
+ * ti_func, passing each data. See for example find_ortho_group.
+ *
+ * opts, if not a null pointer, modifies the search (see cmat.h). Of the
+ * search domains, only SEARCH_AXIS applies here: it fixes the direction of
+ * one of the principal axes (not necessarily the one that ends up as Z).
+ * With opts->warm_inc set, rmat is input as well, as the orientation to
+ * start refining from.
+ */
+FLT_DBL
+search_ortho (DIST_FUNC ortho_func, DIST_FUNC ti_func, void *data,
+	      struct search_opts *opts, FLT_DBL * rmat)
+{
+int             ii, kk, ib;
+int             stride, ibest;
+FLT_DBL         dist;
+FLT_DBL         resolution, res_best;
+FLT_DBL         qq[4], qq_best[4];
+FLT_DBL         dscan[N_SCAN];
+FLT_DBL         basin_qq[N_BASIN][4];
+FLT_DBL         basin_dist[N_BASIN];
+int             nbasin;
+double          center[4];
+double          range[4];
+int             count[4];
+int             qindex[4];
+double          inc[4];
+FLT_DBL         dist_best;
+FLT_DBL         stop_below;
+FLT_DBL         par[3];
+struct ortho_chart chart;
+
+/*
+ * No answer yet. The distance must be non-negative; we use -1 to mean
+ * "not set yet".
+ */
+    dist_best = NO_NORM;
+    res_best = 0.;
+    stop_below = (opts != (struct search_opts *) 0) ? opts->stop_below : -1.;
+    search_start (opts);
+
+/*
+ * If one principal axis is already known, only the azimuth about it
+ * needs to be found.
+ */
+    if (opts != (struct search_opts *) 0 && opts->domain == SEARCH_AXIS)
+    {
+	dist_best = azimuth_ortho (ortho_func, data, opts->theta, opts->phi,
+				   opts, rmat);
+	order_axes (ti_func, data, rmat, opts);
+	return dist_best;
+    }
+
+/*
+ * A warm start: no scan, just the orientation we were given. Polish it by
+ * Newton's method if that works, and otherwise refine it by grid, from
+ * increments in the quaternion that turn it by about opts->warm_inc.
+ */
+    if (opts != (struct search_opts *) 0 && opts->warm_inc > 0.)
+    {
+	chart.ortho_func = ortho_func;
+	chart.data = data;
+	matrix_to_quaternion (rmat, chart.qq);
+
+	if (newton_refine (ortho_chart_distance, (void *) &chart, 3,
+			   2. * opts->warm_inc * DEGTORAD, opts, par,
+			   &dist_best, &res_best))
+	    ortho_chart_quaternion (&chart, par, qq_best);
+	else
+	{
+	    for (kk = 0; kk < 4; kk++)
+	    {
+		qq_best[kk] = chart.qq[kk];
+		inc[kk] = opts->warm_inc * DEGTORAD / 2.;
+	    }
+	    dist_best = quaternion_distance (ortho_func, data, qq_best);
+	    search_spend (opts);
+	    dist_best = refine_ortho (ortho_func, data, qq_best, dist_best,
+				      inc, opts, &res_best);
+	}
+	search_finish (opts, res_best, !opts->spent &&
+		       !(stop_below >= 0. && dist_best <= stop_below));
+	quaternion_to_matrix (qq_best, rmat);
+	order_axes (ti_func, data, rmat, opts);
+	return dist_best;
+    }
+
+/*
+ * Search over all possible orientations.
+ *
+ * Any orientation in 3-space can be specified by a unit vector,
+ * giving an axis to rotate around, and an angle to rotate about
+ * the given axis. The orientation is given with respect to some
+ * fixed reference orientation.
+ *
+ * Since rotating by theta degrees about (A,B,C) produces the same
+ * result as rotating -theta degrees about (-A,-B,-C), we only
+ * need to consider 180 degrees worth of angles, not 360.
+ *
+ * In this application, we are finding the orientation of an orthorhombic
+ * medium. Orthorhombic symmetry has three orthogonal symmetry planes,
+ * so any one octant defines the whole. We thus only need to search
+ * over rotation axes within one octant.
+ *
+ * Following the article in EDN, March 2, 1995, on page 95, author
+ * "Do-While Jones" (a pen name of R. David Pogge),
+ * "Quaternions quickly transform coordinates without error buildup",
+ * we use quaternions to express the rotation. The article can be read
+ * online here:
+ * http://www.reed-electronics.com/ednmag/archives/1995/030295/05df3.htm
+ *
+ * If (A,B,C) is a unit vector to rotate theta degrees about, then:
+ *
+ * q0 = Cos (theta/2)
+ * q1 = A * Sin(theta/2)
+ * q2 = B * Sin(theta/2)
+ * q3 = C * Sin(theta/2)
+ *
+ * so that q0^2 + q1^2 + q2^2 + q3^2 = 1. (A unit magnitude quaternion
+ * represents a pure rotation, with no change in scale).
+ *
+ * For our case, taking advantage of the orthorhombic symmetry to
+ * restrict the search space, we have:
+ * 0 <= A <= 1
+ * 0 <= B <= 1
+ * 0 <= C <= 1
+ * 0 <= theta <= 180 degrees.
+ * The rotation axis direction is limited to within one octant,
+ * and the rotation about that axis is limited to half of the full circle.
+ *
+ * In terms of quaternions, this bounds all four elements between 0 and 1,
+ * inclusive.
+ */
+
+    scan_grid (count, center, range);
+    for (kk = 0; kk < 4; kk++)
+	inc[kk] = (2. * range[kk]) / (FLT_DBL) (count[kk] - 1);
+
+    /*
+     * Do the initial 4-dimensional scan over the whole search space,
+     * remembering the distance found at every point. If we were handed the
+     * answers already, use those instead.
+     */
+    stride = search_stride (opts, N_SCAN);
+    ibest = 0;
+    for (ii = 0; ii < N_SCAN; ii++)
+    {
+	kk = (int) (((long) ii * stride) % N_SCAN);
+	qindex[0] = kk % count[0];
+	qindex[1] = (kk / count[0]) % count[1];
+	qindex[2] = (kk / (count[0] * count[1])) % count[2];
+	qindex[3] = kk / (count[0] * count[1] * count[2]);
+	grid_quaternion (qq, qindex, count, center, range);
+
+	if (opts != (struct search_opts *) 0 && opts->scan != (FLT_DBL *) 0)
+	    dscan[kk] = opts->scan[kk];
+	else
+	{
+	    dscan[kk] = quaternion_distance (ortho_func, data, qq);
+	    search_spend (opts);
+	}
+
+	if (ii == 0 || dscan[kk] < dscan[ibest])
+	    ibest = kk;
+
+	/*
+	 * Good enough, or out of time? Then the best point so far will
+	 * have to do.
+	 */
+	if ((stop_below >= 0. && dscan[kk] <= stop_below) ||
+	    (opts != (struct search_opts *) 0 && opts->spent))
+	{
+	    qindex[0] = ibest % count[0];
+	    qindex[1] = (ibest / count[0]) % count[1];
+	    qindex[2] = (ibest / (count[0] * count[1])) % count[2];
+	    qindex[3] = ibest / (count[0] * count[1] * count[2]);
+	    grid_quaternion (qq, qindex, count, center, range);
+	    quaternion_to_matrix (qq, rmat);
+	    search_finish (opts, quaternion_resolution (inc) *
+			   sqrt ((FLT_DBL) N_SCAN / (ii + 1)), 0);
+	    order_axes (ti_func, data, rmat, opts);
+	    return dscan[ibest];
+	}
+    }
+
+    /*
+     * Rather than trusting the single best point of the scan, pick out the
+     * best few distinct local minima and refine each of them in turn, best
+     * first, keeping whichever refines to the least distance. Each is
+     * refined all the way: a basin that starts out worse can still end up
+     * best, and how far a refinement will yet go can't be told from how
+     * far it has gone.
+     */
+    nbasin = scan_minima (dscan, count, center, range, basin_qq, basin_dist);
+
+    for (ib = 0; ib < nbasin; ib++)
+    {
+	for (kk = 0; kk < 4; kk++)
+	    qq[kk] = basin_qq[ib][kk];
+
+	dist = refine_ortho (ortho_func, data, qq, basin_dist[ib], inc,
+			     opts, &resolution);
+
+	if (dist < dist_best || dist_best < 0.)
+	{
+	    dist_best = dist;
+	    res_best = resolution;
+	    for (kk = 0; kk < 4; kk++)
+		qq_best[kk] = qq[kk];
+	}
+
+	if ((stop_below >= 0. && dist_best <= stop_below) ||
+	    (opts != (struct search_opts *) 0 && opts->spent))
+	    break;
+    }
+    search_finish (opts, res_best, ib == nbasin);
+
+    /*
+     * We've got the answer to sufficient resolution... clean it up a bit,
+     * then output it.
+     */
+
+    /*
+     * Convert the best answer from a Quaternion back to a rotation matrix
+     */
+    quaternion_to_matrix (qq_best, rmat);
+
+    order_axes (ti_func, data, rmat, opts);
+
     return dist_best;
 }
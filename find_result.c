@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * find_ti and find_ortho, returning everything about the answer in one
+ * structure (see cmat.h): the orientation in the forms people want, plus
+ * whichever of the derived matrices (the rotated input, the nearest
+ * symmetric medium, that back in the original coordinates, and the
+ * deviation from it) the caller asks for. Matrices that aren't asked for
+ * aren't computed, and what the search already found (such as how well
+ * each orthorhombic principal axis serves as a TI symmetry axis) isn't
+ * computed again.
+ */
+
+#include "cmat.h"
+
+/*
+ * The derived matrices each need the ones before them.
+ */
+static int
+result_needs (int want)
+{
+    if (want & RESULT_DEVIATION)
+	want |= RESULT_APPROX_ORIG;
+    if (want & RESULT_APPROX_ORIG)
+	want |= RESULT_APPROX;
+    if (want & RESULT_APPROX)
+	want |= RESULT_ROTATED;
+    return want;
+}
+
+/*
+ * Work out the derived matrices for the input cc and the rotation rmat to
+ * canonical orientation, using sym_distance (ti_distance or
+ * ortho_distance) to find the nearest symmetric medium.
+ *
+ * Return value: the distance from symmetry if it was found (RESULT_APPROX),
+ * otherwise dist.
+ */
+static FLT_DBL
+result_matrices (FLT_DBL * cc, FLT_DBL * rmat, FLT_DBL norm, int want,
+		 FLT_DBL (*sym_distance) (FLT_DBL *, FLT_DBL *), FLT_DBL dist,
+		 FLT_DBL * ccrot, FLT_DBL * ccsym, FLT_DBL * ccorig,
+		 FLT_DBL * ccdev)
+{
+int             ii, jj;
+FLT_DBL         rmat_transp[9];
+
+    if (want & RESULT_ROTATED)
+	rotate_tensor (ccrot, cc, rmat);
+
+    if (want & RESULT_APPROX)
+	dist = sym_distance (ccsym, ccrot);
+
+    if (want & RESULT_APPROX_ORIG)
+    {
+	transpose_matrix (rmat_transp, rmat);
+	rotate_tensor (ccorig, ccsym, rmat_transp);
+    }
+
+    if (want & RESULT_DEVIATION)
+    {
+	for (ii = 0; ii < 6; ii++)
+	    for (jj = 0; jj <= ii; jj++)
+	    {
+		ccdev[jj + 6 * ii] = ccdev[ii + 6 * jj] =
+		 (cc[jj + 6 * ii] - ccorig[jj + 6 * ii]) * 100. / norm;
+	    }
+    }
+
+    return dist;
+}
+
+/*
+ * Find the best-fitting TI medium.
+ *
+ * Input:
+ *	cc is the stiffness matrix.
+ *	opts, if not a null pointer, modifies the search as for search_ti.
+ *	want says which derived matrices to compute: any of RESULT_ROTATED,
+ *	RESULT_APPROX, RESULT_APPROX_ORIG, and RESULT_DEVIATION ORed
+ *	together, or 0 for none.
+ *
+ * Output:
+ *	res is filled in. res->have says which of the derived matrices were
+ *	computed (those asked for, and any they needed).
+ *
+ * Return value:
+ *	The distance from TI (res->dist).
+ */
+FLT_DBL
+find_ti_result (FLT_DBL * cc, struct search_opts *opts, int want,
+		struct ti_result *res)
+{
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         theta, phi, dist;
+
+    pack_matrix_6x6 (ccp, cc);
+    dist = search_ti (rotated_ti_distance, (void *) ccp, opts, &theta, &phi);
+
+    return ti_result_at (cc, theta, phi, dist, want, res);
+}
+
+/*
+ * The rest of find_ti_result, for a symmetry axis already found some
+ * other way (by find_ti_batch, say): theta and phi, with distance dist
+ * from TI. Input, output, and return value are otherwise as for
+ * find_ti_result.
+ */
+FLT_DBL
+ti_result_at (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi, FLT_DBL dist,
+	      int want, struct ti_result *res)
+{
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         rmat_transp[9];
+FLT_DBL         vec[3];
+
+    pack_matrix_6x6 (ccp, cc);
+    res->norm = norm_packed (ccp);
+    res->dist = dist;
+    res->theta = theta;
+    res->phi = phi;
+
+    make_rotation_matrix (res->theta, res->phi, 0., res->rmat);
+    transpose_matrix (rmat_transp, res->rmat);
+    vec[0] = 0.;
+    vec[1] = 0.;
+    vec[2] = 1.;
+    matrix_times_vector (res->axis, rmat_transp, vec);
+
+    res->have = result_needs (want);
+    res->dist = result_matrices (cc, res->rmat, res->norm, res->have,
+				 ti_distance, res->dist, res->ccrot,
+				 res->ccsym, res->ccorig, res->ccdev);
+
+    return res->dist;
+}
+
+/*
+ * Find the best-fitting orthorhombic medium.
+ *
+ * Input and output as for find_ti_result, with opts modifying the search
+ * as for search_ortho. The per-axis TI distances in res->axis_dist are
+ * the ones the search found while ordering the axes.
+ *
+ * Return value:
+ *	The distance from Orthorhombic (res->dist).
+ */
+FLT_DBL
+find_ortho_result (FLT_DBL * cc, struct search_opts *opts, int want,
+		   struct ortho_result *res)
+{
+struct search_opts defaults;
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         rmat[9];
+FLT_DBL         dist;
+
+    if (opts == (struct search_opts *) 0)
+    {
+	search_defaults (&defaults);
+	opts = &defaults;
+    }
+
+    pack_matrix_6x6 (ccp, cc);
+    dist = search_ortho (rotated_ortho_distance, rotated_ti_distance,
+			 (void *) ccp, opts, rmat);
+
+    return ortho_result_at (cc, rmat, dist, opts->axis_dist, want, res);
+}
+
+/*
+ * The rest of find_ortho_result, for a canonical orientation rmat already
+ * found some other way (by find_ortho_batch, say), with distance dist
+ * from Orthorhombic. axis_dist holds the per-axis TI distances, or is a
+ * null pointer to have them worked out (see ortho_axis_distances). Input,
+ * output, and return value are otherwise as for find_ortho_result.
+ */
+FLT_DBL
+ortho_result_at (FLT_DBL * cc, FLT_DBL * rmat, FLT_DBL dist,
+		 FLT_DBL * axis_dist, int want, struct ortho_result *res)
+{
+int             kk;
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         rmat_transp[9];
+FLT_DBL         vec[3];
+
+    pack_matrix_6x6 (ccp, cc);
+    res->norm = norm_packed (ccp);
+    res->dist = dist;
+    for (kk = 0; kk < 9; kk++)
+	res->rmat[kk] = rmat[kk];
+    if (axis_dist != (FLT_DBL *) 0)
+	for (kk = 0; kk < 3; kk++)
+	    res->axis_dist[kk] = axis_dist[kk];
+    else
+	ortho_axis_distances (ccp, res->rmat, res->axis_dist);
+
+    transpose_matrix (rmat_transp, res->rmat);
+    for (kk = 0; kk < 3; kk++)
+    {
+	vec[0] = vec[1] = vec[2] = 0.;
+	vec[kk] = 1.;
+	matrix_times_vector (res->axis[kk], rmat_transp, vec);
+	vector_to_angles (res->axis[kk], &res->phi[kk], &res->theta[kk]);
+    }
+
+    res->have = result_needs (want);
+    res->dist = result_matrices (cc, res->rmat, res->norm, res->have,
+				 ortho_distance, res->dist, res->ccrot,
+				 res->ccsym, res->ccorig, res->ccdev);
+
+    return res->dist;
+}
+
+/*
+ * How far each principal axis of the canonical orientation rmat is from
+ * being a TI symmetry axis of the packed matrix ccp, for when the search's
+ * own values (opts->axis_dist) aren't at hand, as after find_ortho_batch.
+ */
+void
+ortho_axis_distances (FLT_DBL * ccp, FLT_DBL * rmat, FLT_DBL * dists)
+{
+int             ii, kk;
+FLT_DBL         rmat_axis[9];
+FLT_DBL         axis[3];
+
+    for (kk = 0; kk < 3; kk++)
+    {
+	for (ii = 0; ii < 3; ii++)
+	    axis[ii] = rmat[kk + 3 * ii];
+	axis_to_rotation (axis, rmat_axis);
+	dists[kk] = rotated_ti_distance ((void *) ccp, rmat_axis);
+    }
+
+    return;
+}
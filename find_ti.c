@@ -64,23 +64,381 @@
 #endif
 
 
+/*
+ * The most points there can be in the initial scan
+ */
+#define TI_SCAN_MAX	((int) (90.01 / DEG_INC + 2) * (int) (360. / DEG_INC + 2))
+
+
 FLT_DBL
 find_ti (FLT_DBL * cc, FLT_DBL * theta_best, FLT_DBL * phi_best)
 {
-int             ii, jj, kk;
-FLT_DBL         ccrot[6 * 6];
-FLT_DBL         ccti[6 * 6];
+FLT_DBL         ccp[PACKED_SIZE];
+
+    pack_matrix_6x6 (ccp, cc);
+    return search_ti (rotated_ti_distance, (void *) ccp,
+		      (struct search_opts *) 0, theta_best, phi_best);
+}
+
+/*
+ * find_ti, but giving up when a budget of max_evals distance evaluations
+ * or max_seconds of elapsed time (either, if positive) runs out. The best
+ * axis found so far is returned; resolution is set to the angular
+ * resolution reached, in degrees, and converged to 1 if the search ran to
+ * completion or 0 if it was cut short.
+ */
+FLT_DBL
+find_ti_budget (FLT_DBL * cc, long max_evals, double max_seconds,
+		FLT_DBL * theta_best, FLT_DBL * phi_best,
+		FLT_DBL * resolution, int *converged)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+FLT_DBL         dist;
+
+    search_defaults (&opts);
+    opts.max_evals = max_evals;
+    opts.max_seconds = max_seconds;
+
+    pack_matrix_6x6 (ccp, cc);
+    dist = search_ti (rotated_ti_distance, (void *) ccp, &opts,
+		      theta_best, phi_best);
+
+    *resolution = opts.resolution;
+    *converged = opts.converged;
+    return dist;
+}
+
+/*
+ * Variants of find_ti for when something is already known about the
+ * symmetry axis.
+ *
+ * find_ti_axis: the distance from TI given the symmetry axis (theta, phi).
+ * This is a single projection; there is no search.
+ */
+FLT_DBL
+find_ti_axis (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi)
+{
+FLT_DBL         rmat[9];
+FLT_DBL         ccp[PACKED_SIZE];
+
+    make_rotation_matrix (theta, phi, 0., rmat);
+    pack_matrix_6x6 (ccp, cc);
+    return rotated_ti_distance ((void *) ccp, rmat);
+}
+
+/*
+ * find_ti_cone: as find_ti, but only consider symmetry axes within max_dev
+ * degrees of the axis (theta, phi).
+ */
+FLT_DBL
+find_ti_cone (FLT_DBL * cc, FLT_DBL theta, FLT_DBL phi, FLT_DBL max_dev,
+	      FLT_DBL * theta_best, FLT_DBL * phi_best)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+
+    search_defaults (&opts);
+    opts.domain = SEARCH_CONE;
+    opts.theta = theta;
+    opts.phi = phi;
+    opts.max_dev = max_dev;
+
+    pack_matrix_6x6 (ccp, cc);
+    return search_ti (rotated_ti_distance, (void *) ccp, &opts,
+		      theta_best, phi_best);
+}
+
+/*
+ * find_ti_box: as find_ti, but only consider symmetry axes with azimuth
+ * theta between theta_min and theta_max, and angle from vertical phi
+ * between phi_min and phi_max (0 <= phi_min <= phi_max <= 90). If
+ * theta_max is less than theta_min the box wraps around through
+ * theta = 0.
+ */
+FLT_DBL
+find_ti_box (FLT_DBL * cc, FLT_DBL theta_min, FLT_DBL theta_max,
+	     FLT_DBL phi_min, FLT_DBL phi_max,
+	     FLT_DBL * theta_best, FLT_DBL * phi_best)
+{
+struct search_opts opts;
+FLT_DBL         ccp[PACKED_SIZE];
+
+    search_defaults (&opts);
+    opts.domain = SEARCH_BOX;
+    opts.theta_min = theta_min;
+    opts.theta_max = theta_max;
+    opts.phi_min = phi_min;
+    opts.phi_max = phi_max;
+
+    pack_matrix_6x6 (ccp, cc);
+    return search_ti (rotated_ti_distance, (void *) ccp, &opts,
+		      theta_best, phi_best);
+}
+
+/*
+ * Which kind of search domain opts asks for. A null pointer, or a cone
+ * too wide to be any restriction, is the whole hemisphere; a cone with no
+ * width is a fixed axis.
+ */
+static int
+ti_domain (struct search_opts *opts)
+{
+    if (opts == (struct search_opts *) 0)
+	return SEARCH_ALL;
+
+    if (opts->domain == SEARCH_CONE)
+    {
+	if (opts->max_dev >= 90.)
+	    return SEARCH_ALL;
+	if (opts->max_dev <= 0.)
+	    return SEARCH_AXIS;
+    }
+
+    return opts->domain;
+}
+
+/*
+ * How many degrees of azimuth a box spans. A theta_max less than
+ * theta_min is a box that wraps around through theta = 0 (350 to 10, say).
+ */
+static FLT_DBL
+ti_box_span (struct search_opts *opts)
+{
+FLT_DBL         span;
+
+    span = opts->theta_max - opts->theta_min;
+    if (span < 0.)
+	span += 360.;
+    return span;
+}
+
+/*
+ * The grid spacing of the initial scan, in degrees. Small domains are
+ * scanned more finely, so that there are always a few points across them.
+ */
+static FLT_DBL
+ti_scan_inc (struct search_opts *opts)
+{
+FLT_DBL         extent;
+
+    switch (ti_domain (opts))
+    {
+    case SEARCH_CONE:
+	extent = opts->max_dev;
+	break;
+    case SEARCH_BOX:
+	extent = ti_box_span (opts) * sin (opts->phi_max * DEGTORAD);
+	if (opts->phi_max - opts->phi_min > extent)
+	    extent = opts->phi_max - opts->phi_min;
+	break;
+    default:
+	return DEG_INC;
+    }
+
+    if (extent / 4. < DEG_INC)
+	return (extent > 0.) ? extent / 4. : END_RES;
+    return DEG_INC;
+}
+
+/*
+ * The "current best" symmetry axis v0 given by theta and phi, and two
+ * vectors v1 and v2 perpendicular to it and to each other.
+ */
+static void
+ti_axis_frame (FLT_DBL theta, FLT_DBL phi,
+	       FLT_DBL * v0, FLT_DBL * v1, FLT_DBL * v2)
+{
 FLT_DBL         rmat[9];
 FLT_DBL         vec[3];
-FLT_DBL         dist;
-FLT_DBL         theta, phi, dist_best;
+
+    /*
+     * rmat is the rotation matrix that takes the +Z axis back to this
+     * symmetry axis candidate. This is the inverse of the rotation that
+     * takes the candidate to +Z; hence the minus signs on phi and theta.
+     */
+    make_rotation_matrix (0., -phi, -theta, rmat);
+
+    /* Rotate the +Z axis */
+    vec[0] = 0.;
+    vec[1] = 0.;
+    vec[2] = 1.;
+    matrix_times_vector (v0, rmat, vec);
+
+    /* Rotate the +X vector */
+    vec[0] = 1.;
+    vec[1] = 0.;
+    vec[2] = 0.;
+    matrix_times_vector (v1, rmat, vec);
+
+    /* Rotate the +Y vector */
+    vec[0] = 0.;
+    vec[1] = 1.;
+    vec[2] = 0.;
+    matrix_times_vector (v2, rmat, vec);
+
+    return;
+}
+
+/*
+ * For a cone domain, the axis of the cone as a unit vector, followed by
+ * the cosine of the largest deviation from it that ti_in_domain allows
+ * (a little more than opts->max_dev, so the edge of the cone itself
+ * counts as inside).
+ */
+static void
+ti_cone (struct search_opts *opts, FLT_DBL * cone)
+{
+    angles_to_vector (opts->phi, opts->theta, cone);
+    cone[3] = cos ((opts->max_dev + END_RES) * DEGTORAD);
+    return;
+}
+
+/*
+ * Is the symmetry axis vv (not necessarily normalized) within the search
+ * domain? An axis and its opposite are the same axis. For a cone, cone
+ * is as set by ti_cone.
+ */
+static int
+ti_in_domain (struct search_opts *opts, FLT_DBL * cone, FLT_DBL * vv)
+{
+FLT_DBL         v0[3];
+FLT_DBL         theta, phi, span;
+FLT_DBL         len, cosdev;
+int             kk, sign;
+
+    switch (ti_domain (opts))
+    {
+    case SEARCH_CONE:
+	len = sqrt (vv[0] * vv[0] + vv[1] * vv[1] + vv[2] * vv[2]);
+	cosdev = 0.;
+	for (kk = 0; kk < 3; kk++)
+	    cosdev += cone[kk] * vv[kk];
+	return fabs (cosdev) >= len * cone[3];
+
+    case SEARCH_BOX:
+	for (sign = -1; sign <= 1; sign += 2)
+	{
+	    for (kk = 0; kk < 3; kk++)
+		v0[kk] = sign * vv[kk];
+	    vector_to_angles (v0, &phi, &theta);
+
+	    if (phi < opts->phi_min - END_RES || phi > opts->phi_max + END_RES)
+		continue;
+	    /* At the pole the azimuth means nothing. */
+	    if (phi <= END_RES)
+		return 1;
+
+	    span = ti_box_span (opts);
+	    theta = fmod (theta - opts->theta_min, 360.);
+	    if (theta < 0.)
+		theta += 360.;
+	    if (theta <= span + END_RES || theta >= 360. - END_RES)
+		return 1;
+	}
+	return 0;
+
+    default:
+	return 1;
+    }
+}
+
+/*
+ * Add a trial axis to the scan list, unless it is full.
+ */
+static int
+ti_scan_add (int nscan, FLT_DBL * theta_scan, FLT_DBL * phi_scan,
+	     FLT_DBL theta, FLT_DBL phi)
+{
+    if (nscan >= TI_SCAN_MAX)
+	return nscan;
+
+    if (theta_scan != (FLT_DBL *) 0)
+    {
+	theta_scan[nscan] = theta;
+	phi_scan[nscan] = phi;
+    }
+
+    return nscan + 1;
+}
+
+/*
+ * List the trial symmetry axes of the initial scan, in the order that
+ * search_ti tries them.
+ *
+ * On input:
+ *	opts, if not a null pointer, gives the domain to scan over.
+ *
+ * On output:
+ *	theta_scan, phi_scan are the trial axes. If they are null pointers,
+ *	the points are only counted. There are never more than TI_SCAN_MAX.
+ *
+ * Return value: the number of points in the scan.
+ */
+int
+ti_scan_points (struct search_opts *opts,
+		FLT_DBL * theta_scan, FLT_DBL * phi_scan)
+{
+int             ii, kk, nscan, nring;
+FLT_DBL         theta, phi;
 FLT_DBL         phi_min, phi_max, phi_inc;
 FLT_DBL         theta_min, theta_max, theta_inc;
+FLT_DBL         dev, az, az_inc;
 FLT_DBL         v0[3], v1[3], v2[3], vv[3];
 
+    nscan = 0;
+    phi_inc = ti_scan_inc (opts);
+
+    switch (ti_domain (opts))
+    {
+    case SEARCH_AXIS:
+	return ti_scan_add (nscan, theta_scan, phi_scan,
+			    opts->theta, opts->phi);
+
+    case SEARCH_CONE:
+/*
+ * Scan in rings of increasing deviation around the cone axis, out to
+ * and including the edge of the cone.
+ */
+	ti_axis_frame (opts->theta, opts->phi, v0, v1, v2);
+	nring = (int) ceil (opts->max_dev / phi_inc - .01);
+
+	for (ii = 0; ii <= nring; ii++)
+	{
+	    dev = (ii < nring) ? ii * phi_inc : opts->max_dev;
+	    /*
+	     * The same spacing around the ring as between rings. The
+	     * center is a single point.
+	     */
+	    az_inc = (ii == 0) ? 360. : phi_inc / sin (dev * DEGTORAD);
 
+	    for (az = 0.; az < 360.; az += az_inc)
+	    {
+		for (kk = 0; kk < 3; kk++)
+		    vv[kk] = cos (dev * DEGTORAD) * v0[kk] +
+		     sin (dev * DEGTORAD) *
+		     (cos (az * DEGTORAD) * v1[kk] +
+		      sin (az * DEGTORAD) * v2[kk]);
+
+		vector_to_angles (vv, &phi, &theta);
+		nscan = ti_scan_add (nscan, theta_scan, phi_scan, theta, phi);
+	    }
+	}
+	return nscan;
+
+    case SEARCH_BOX:
 /*
- * Begin the first symmetry-axis scan, spanning a hemisphere.
+ * Scan the box as the hemisphere below, but include its far edges.
+ */
+	phi_min = opts->phi_min;
+	phi_max = opts->phi_max;
+	theta_min = opts->theta_min;
+	theta_max = opts->theta_min + ti_box_span (opts);
+	break;
+
+    default:
+/*
+ * The first symmetry-axis scan spans a hemisphere.
  * (By symmetry, the other hemisphere is equivalent, so a search over
  * a hemisphere is sufficient.)
  */
@@ -89,18 +447,14 @@ FLT_DBL         v0[3], v1[3], v2[3], vv[3];
  * Search in latitude from pole to equator. Proceed in increments of
  * 5 (DEG_INC) degrees.
  */
-    phi_min = 0.;
-    phi_max = 90.01;
-    phi_inc = DEG_INC;
+	phi_min = 0.;
+	phi_max = 90.01;
 
 /* At each latitude, search all 360 degrees of longitude. */
-    theta_min = 0.;
-    theta_max = 360.;
-/*
- * Keep track of the best so far. The norm must be non-negative, so
- * a norm of -1 indicates that we haven't got any value yet.
- */
-    dist_best = -1.;
+	theta_min = 0.;
+	theta_max = 360.;
+	break;
+    }
 
 /* Loop to scan over latitude */
     for (phi = phi_min; phi < phi_max; phi += phi_inc)
@@ -114,30 +468,210 @@ FLT_DBL         v0[3], v1[3], v2[3], vv[3];
 
 /* Loop to scan over longitude */
 	for (theta = theta_min; theta < theta_max; theta += theta_inc)
+	    nscan = ti_scan_add (nscan, theta_scan, phi_scan, theta, phi);
+
+	if (ti_domain (opts) == SEARCH_BOX && phi > END_RES)
+	    nscan = ti_scan_add (nscan, theta_scan, phi_scan, theta_max, phi);
+    }
+
+    if (ti_domain (opts) == SEARCH_BOX)
+    {
+	/* The far edge in latitude; at the pole, that is a single point. */
+	if (phi_max > END_RES)
+	{
+	    theta_inc = phi_inc / sin (phi_max * DEGTORAD);
+	    for (theta = theta_min; theta < theta_max; theta += theta_inc)
+		nscan =
+		 ti_scan_add (nscan, theta_scan, phi_scan, theta, phi_max);
+	}
+	nscan = ti_scan_add (nscan, theta_scan, phi_scan, theta_max, phi_max);
+    }
+
+    return nscan;
+}
+
+/*
+ * For a warm start (see newton_refine.c): the distance with the symmetry
+ * axis moved from the starting axis, column 2 of frame, by par[0] and
+ * par[1] along columns 0 and 1.
+ */
+struct ti_chart
+{
+    DIST_FUNC       ti_func;
+    void           *data;
+    FLT_DBL         frame[9];
+};
+
+static void
+ti_chart_axis (struct ti_chart *chart, FLT_DBL * par, FLT_DBL * vv)
+{
+int             kk;
+
+    for (kk = 0; kk < 3; kk++)
+	vv[kk] = chart->frame[2 + 3 * kk] + par[0] * chart->frame[3 * kk] +
+	 par[1] * chart->frame[1 + 3 * kk];
+    return;
+}
+
+static FLT_DBL
+ti_chart_distance (void *data, FLT_DBL * par)
+{
+struct ti_chart *chart = (struct ti_chart *) data;
+FLT_DBL         rmat[9];
+FLT_DBL         vv[3];
+
+    ti_chart_axis (chart, par, vv);
+    axis_to_rotation (vv, rmat);
+    return chart->ti_func (chart->data, rmat);
+}
+
+/*
+ * The search itself. This is the same as find_ti, except that the distance
+ * from VTI of a trial rotation is found by calling ti_func, passing it
+ * data. This allows the same search to be used for objectives other than
+ * a single stiffness matrix; see for example find_ti_group.
+ *
+ * opts, if not a null pointer, modifies the search (see cmat.h). In
+ * particular it may restrict the symmetry axes searched over to a cone or
+ * a range of azimuth and angle from vertical; the initial scan then covers
+ * only that domain (more finely, if it is small), and the refinement never
+ * leaves it. With opts->warm_inc set, *theta_best and *phi_best are input
+ * as well, as the axis to start refining from.
+ */
+FLT_DBL
+search_ti (DIST_FUNC ti_func, void *data, struct search_opts *opts,
+	   FLT_DBL * theta_best, FLT_DBL * phi_best)
+{
+int             ii, jj, kk;
+int             nscan, iscan, stride;
+FLT_DBL         rmat[9];
+FLT_DBL         dist;
+FLT_DBL         theta, phi, dist_best;
+FLT_DBL         dist_prev;
+FLT_DBL         phi_inc, inc_start, step;
+FLT_DBL         stop_below;
+FLT_DBL         axis_best[3], axis_prev[3];
+FLT_DBL         cone[4];
+FLT_DBL         frame[9];
+FLT_DBL         par[2];
+struct ti_chart chart;
+FLT_DBL         v0[3], v1[3], v2[3], vv[3];
+FLT_DBL         theta_scan[TI_SCAN_MAX];
+FLT_DBL         phi_scan[TI_SCAN_MAX];
+
+
+/*
+ * Begin the first symmetry-axis scan, spanning a hemisphere.
+ */
+    nscan = ti_scan_points (opts, theta_scan, phi_scan);
+    phi_inc = ti_scan_inc (opts);
+    stop_below = (opts != (struct search_opts *) 0) ? opts->stop_below : -1.;
+    stride = search_stride (opts, nscan);
+    search_start (opts);
+
+    /* A known axis needs no search. */
+    if (ti_domain (opts) == SEARCH_AXIS)
+    {
+	*theta_best = opts->theta;
+	*phi_best = opts->phi;
+	make_rotation_matrix (*theta_best, *phi_best, 0., rmat);
+	dist = ti_func (data, rmat);
+	search_spend (opts);
+	search_finish (opts, 0., 1);
+	return dist;
+    }
+
+/*
+ * Keep track of the best so far. The norm must be non-negative, so
+ * a norm of -1 indicates that we haven't got any value yet.
+ */
+    dist_best = -1.;
+
+    /*
+     * A warm start: no scan, just the axis we were given. Polish it by
+     * Newton's method if that works, and otherwise refine it by grid from
+     * a spacing of opts->warm_inc.
+     */
+    if (opts != (struct search_opts *) 0 && opts->warm_inc > 0.)
+    {
+	if (ti_domain (opts) == SEARCH_CONE)
+	    ti_cone (opts, cone);
+	chart.ti_func = ti_func;
+	chart.data = data;
+	angles_to_vector (*phi_best, *theta_best, vv);
+	axis_to_rotation (vv, chart.frame);
+
+	if (newton_refine (ti_chart_distance, (void *) &chart, 2,
+			   2. * opts->warm_inc * DEGTORAD, opts, par,
+			   &dist_best, &step))
+	{
+	    ti_chart_axis (&chart, par, vv);
+	    if (ti_in_domain (opts, cone, vv))
+	    {
+		vector_to_angles (vv, phi_best, theta_best);
+		search_finish (opts, step, !opts->spent &&
+			       !(stop_below >= 0. && dist_best <= stop_below));
+		return dist_best;
+	    }
+	}
+
+	/* No luck: start again, by grid. */
+	nscan = 0;
+	phi_inc = opts->warm_inc;
+	par[0] = par[1] = 0.;
+	dist_best = ti_chart_distance ((void *) &chart, par);
+	search_spend (opts);
+    }
+
+    for (ii = 0; ii < nscan; ii++)
+    {
+	iscan = (int) (((long) ii * stride) % nscan);
+	theta = theta_scan[iscan];
+	phi = phi_scan[iscan];
+
+	if (opts != (struct search_opts *) 0 &&
+	    opts->scan != (FLT_DBL *) 0)
+	{
+	    /* We were handed the answer already. */
+	    dist = opts->scan[iscan];
+	}
+	else
 	{
 	    /*
-	     * rmat is the rotation matrix that rotates the current trial
+	     * rmat is a rotation matrix that rotates the current trial
 	     * symmetry axis, as defined by theta and phi, to the +Z axis.
 	     */
-	    make_rotation_matrix (theta, phi, 0., rmat);
-	    /* Rotate the elastic constants using rmat */
-	    rotate_tensor (ccrot, cc, rmat);
+	    angles_to_vector (phi, theta, vv);
+	    axis_to_rotation (vv, rmat);
 	    /*
-	     * Find the distance of the rotated constants from VTI:
+	     * Find the distance of the constants rotated by rmat from VTI:
 	     * transversely isotropic with a vertical (+Z) symmetry axis.
 	     */
-	    dist = ti_distance (ccti, ccrot);
+	    dist = ti_func (data, rmat);
+	    search_spend (opts);
+	}
 
-	    /*
-	     * Is it better than the best we have found so far, or is it the
-	     * first time through the loop?
-	     */
-	    if (dist < dist_best || dist_best < 0.)
-	    {
-		dist_best = dist;
-		*phi_best = phi;
-		*theta_best = theta;
-	    }
+	/*
+	 * Is it better than the best we have found so far, or is it the
+	 * first time through the loop?
+	 */
+	if (dist < dist_best || dist_best < 0.)
+	{
+	    dist_best = dist;
+	    *phi_best = phi;
+	    *theta_best = theta;
+	}
+
+	/*
+	 * Good enough, or out of time? The scan so far has covered the
+	 * domain about as finely as a full scan with fewer points would.
+	 */
+	if ((stop_below >= 0. && dist_best <= stop_below) ||
+	    (opts != (struct search_opts *) 0 && opts->spent))
+	{
+	    search_finish (opts, phi_inc * sqrt ((FLT_DBL) nscan / (ii + 1)),
+			   0);
+	    return dist_best;
 	}
     }
 
@@ -148,50 +682,43 @@ FLT_DBL         v0[3], v1[3], v2[3], vv[3];
  * the search grid by a factor of SUBDIVIDE each time, until the
  * resolution is smaller than END_RES, which defines the minimal
  * acceptable resolution.
+ *
+ * From here on the best axis is kept as a vector, and each trial axis
+ * is turned straight into a rotation by axis_to_rotation; the angles are
+ * only worked out again for the answer.
  */
+    angles_to_vector (*phi_best, *theta_best, axis_best);
+    inc_start = phi_inc;
+    if (ti_domain (opts) == SEARCH_CONE)
+	ti_cone (opts, cone);
+
     while (phi_inc > END_RES)
     {
 	/*
-	 * Calculate the "current best" symmetry axis vector.
+	 * Calculate the "current best" symmetry axis vector v0, and two
+	 * vectors v1 and v2 perpendicular to it: those a rotation taking v0
+	 * to +Z takes to +X and +Y. We will use these to construct a small
+	 * 2D grid on the surface of the sphere, with the grid centered on
+	 * the best symmetry-axis candidate found so far.
 	 */
-	/*
-	 * rmat is the rotation matrix that takes the +Z axis back to this
-	 * symmetry axis candidate. This is the inverse of what we needed
-	 * before; hence the minus signs on phi and theta.
-	 */
-	make_rotation_matrix (0., -(*phi_best), -(*theta_best), rmat);
-
-	/* Here is the +Z axis */
-	vec[0] = 0.;
-	vec[1] = 0.;
-	vec[2] = 1.;
-	/* Apply the rotation. */
-	matrix_times_vector (v0, rmat, vec);
-	/* v0 is now the "current best" symmetry-axis vector */
-
-	/*
-	 * Now construct two vectors perpendicular to the current best
-	 * symmetry axis. We will use these to construct a small 2D grid on
-	 * the surface of the sphere, with the grid centered on the best
-	 * symmetry-axis candidate found so far.
-	 */
-	/* Rotate the +X vector */
-	vec[0] = 1.;
-	vec[1] = 0.;
-	vec[2] = 0.;
-	matrix_times_vector (v1, rmat, vec);
-
-	/* Rotate the +Y vector */
-	vec[0] = 0.;
-	vec[1] = 1.;
-	vec[2] = 0.;
-	matrix_times_vector (v2, rmat, vec);
+	axis_to_rotation (axis_best, frame);
+	for (kk = 0; kk < 3; kk++)
+	{
+	    v1[kk] = frame[3 * kk];
+	    v2[kk] = frame[1 + 3 * kk];
+	    v0[kk] = frame[2 + 3 * kk];
+	}
 
 	/*
 	 * Do a search over this small 2D grid. Keep track of the best so
 	 * far. A negative distance means we don't have an answer yet.
+	 * Remember the previous best, in case we are stopped part way.
 	 */
+	dist_prev = dist_best;
+	for (kk = 0; kk < 3; kk++)
+	    axis_prev[kk] = axis_best[kk];
 	dist_best = -1.;
+	step = tan (phi_inc * DEGTORAD) / (FLT_DBL) SUBDIVIDE;
 
 	/*
 	 * Loop over a (4*SUBDIVIDE + 1)^2 grid centered on the current
@@ -216,37 +743,49 @@ FLT_DBL         v0[3], v1[3], v2[3], vv[3];
 		 */
 		for (kk = 0; kk < 3; kk++)
 		{
-		    vv[kk] = v0[kk] +
-		     tan (phi_inc * DEGTORAD) *
-		     ((FLT_DBL) ii / (FLT_DBL) SUBDIVIDE) * v1[kk] +
-		     tan (phi_inc * DEGTORAD) *
-		     ((FLT_DBL) jj / (FLT_DBL) SUBDIVIDE) * v2[kk];
+		    vv[kk] = v0[kk] + step * (FLT_DBL) ii * v1[kk] +
+		     step * (FLT_DBL) jj * v2[kk];
 		}
 
-		/*
-		 * Convert the direction vector vv to spherical coordinates.
-		 * This also normalizes it back to being on the unit sphere.
-		 */
-		vector_to_angles (vv, &phi, &theta);
+		/* Stay inside the domain we were asked to search. */
+		if (!ti_in_domain (opts, cone, vv))
+		    continue;
 
 		/*
-		 * We now have a current trial symmetry direction given by
-		 * phi and theta. Find the corresponding rotation matrix, and
-		 * apply it to the input elastic stiffness constants to
-		 * rotate that trial symmetry axis to the +Z direction.
+		 * Find a rotation matrix taking the trial symmetry direction
+		 * to +Z, and apply it to the input elastic stiffness
+		 * constants.
 		 */
-		make_rotation_matrix (theta, phi, 0., rmat);
-		rotate_tensor (ccrot, cc, rmat);
+		axis_to_rotation (vv, rmat);
 
 		/* Find the distance from VTI */
-		dist = ti_distance (ccti, ccrot);
+		dist = ti_func (data, rmat);
+		search_spend (opts);
 
-		/* Keep track of the best candidate found so far */
+		/*
+		 * Keep track of the best candidate found so far (normalized,
+		 * as axis_to_rotation left it in column 2 of rmat).
+		 */
 		if (dist < dist_best || dist_best < 0.)
 		{
 		    dist_best = dist;
-		    *phi_best = phi;
-		    *theta_best = theta;
+		    for (kk = 0; kk < 3; kk++)
+			axis_best[kk] = rmat[2 + 3 * kk];
+		}
+
+		/* Good enough, or out of time? */
+		if ((stop_below >= 0. && dist_best <= stop_below) ||
+		    (opts != (struct search_opts *) 0 && opts->spent))
+		{
+		    if (dist_prev < dist_best)
+		    {
+			dist_best = dist_prev;
+			for (kk = 0; kk < 3; kk++)
+			    axis_best[kk] = axis_prev[kk];
+		    }
+		    vector_to_angles (axis_best, phi_best, theta_best);
+		    search_finish (opts, phi_inc, 0);
+		    return dist_best;
 		}
 	    }
 
@@ -257,6 +796,10 @@ FLT_DBL         v0[3], v1[3], v2[3], vv[3];
 	phi_inc /= (FLT_DBL) SUBDIVIDE;
     }
 
-    /* theta_best and phi_best are returned set. */
+    search_finish (opts, phi_inc, 1);
+
+    /* If there was no refinement, the angles stand as they are. */
+    if (phi_inc < inc_start)
+	vector_to_angles (axis_best, phi_best, theta_best);
     return dist_best;
 }
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Nearest TI or Orthorhombic medium for a medium that keeps changing a
+ * little at a time, as in an inversion that perturbs one or two elastic
+ * constants per step.
+ *
+ * fit_start does a full search once and keeps what it found in a
+ * fit_state (see cmat.h): the medium, the best orientation, and the
+ * medium rotated to that orientation. fit_update then applies a sparse
+ * change to the constants without starting over.
+ *
+ * The best orientation moves only a little for a small change, so
+ * instead of the global scan the search just refines the previous
+ * optimum (the warm_inc search option), looking out to about
+ * state->reach degrees. If the change could switch the answer to some
+ * distant, quite different, orientation, call fit_start again instead.
+ *
+ * With state->reach zero, the orientation is held and there is no search
+ * at all. Rotation is linear in the constants, so the rotated medium is
+ * brought up to date by rotating just the change (rotate_packed_sparse)
+ * and adding it on, and the distance follows from that. At the optimum
+ * the distance is stationary with respect to orientation (see
+ * distance_gradient.c), so it is still correct to first order in the
+ * change.
+ */
+
+#include "cmat.h"
+
+/* The default for state->reach, in degrees */
+#define FIT_REACH	1.
+
+/*
+ * The distance from symmetry of the already rotated medium.
+ */
+static FLT_DBL
+fit_distance (struct fit_state *state)
+{
+FLT_DBL         ccsym[PACKED_SIZE];
+
+    if (state->symmetry == FIT_ORTHO)
+	return ortho_distance_packed (ccsym, state->ccrot);
+    return ti_distance_packed (ccsym, state->ccrot);
+}
+
+/*
+ * Search for the best orientation of state->ccp, either from scratch or
+ * by refining the one already in state, and bring the rest of the state
+ * up to date with it.
+ */
+static FLT_DBL
+fit_search (struct fit_state *state, FLT_DBL warm_inc)
+{
+struct search_opts opts;
+
+    search_defaults (&opts);
+    opts.warm_inc = warm_inc;
+
+    if (state->symmetry == FIT_ORTHO)
+    {
+	state->dist = search_ortho (rotated_ortho_distance,
+				    rotated_ti_distance,
+				    (void *) state->ccp, &opts, state->rmat);
+    }
+    else
+    {
+	state->dist = search_ti (rotated_ti_distance, (void *) state->ccp,
+				 &opts, &state->theta, &state->phi);
+	make_rotation_matrix (state->theta, state->phi, 0., state->rmat);
+    }
+
+    rotate_packed (state->ccrot, state->ccp, state->rmat);
+    state->nevals = opts.nevals;
+
+    return state->dist;
+}
+
+/*
+ * Begin.
+ *
+ * Input:
+ *	symmetry is FIT_TI or FIT_ORTHO.
+ *	cc is a 6x6 array of Voigt-notation elastic stiffness constants.
+ *
+ * Output:
+ *	state holds the answer, as find_ti or find_ortho would give it:
+ *	state->dist, state->rmat, and for TI state->theta and state->phi.
+ *	state->reach is set to its default; change it if need be.
+ *
+ * Return value:
+ *	The distance from symmetry (state->dist).
+ */
+FLT_DBL
+fit_start (struct fit_state *state, int symmetry, FLT_DBL * cc)
+{
+    state->symmetry = symmetry;
+    state->reach = FIT_REACH;
+    state->theta = 0.;
+    state->phi = 0.;
+    pack_matrix_6x6 (state->ccp, cc);
+
+    return fit_search (state, 0.);
+}
+
+/*
+ * Change some of the elastic constants and find the answer again.
+ *
+ * Input:
+ *	state is as left by fit_start or a previous fit_update.
+ *	For n from 0 to nn-1, delta[n] is added to the constant C_IJ
+ *	(and so to C_JI as well), with I = ii[n] and J = jj[n] in "C" Voigt
+ *	notation, from 0 to 5.
+ *
+ * Output:
+ *	state is updated. state->nevals is the number of distance
+ *	evaluations it took.
+ *
+ * Return value:
+ *	The new distance from symmetry (state->dist).
+ */
+FLT_DBL
+fit_update (struct fit_state *state, int nn, int *ii, int *jj,
+	    FLT_DBL * delta)
+{
+int             kk, nblock;
+int             index[PACKED_SIZE];
+
+    if (state->reach > 0.)
+    {
+	for (kk = 0; kk < nn; kk++)
+	    state->ccp[extern_packed[ii[kk]][jj[kk]]] += delta[kk];
+	return fit_search (state, state->reach);
+    }
+
+    /* Both the medium and the rotated medium take the change. */
+    while (nn > 0)
+    {
+	nblock = (nn < PACKED_SIZE) ? nn : PACKED_SIZE;
+	for (kk = 0; kk < nblock; kk++)
+	{
+	    index[kk] = extern_packed[ii[kk]][jj[kk]];
+	    state->ccp[index[kk]] += delta[kk];
+	}
+	rotate_packed_sparse (state->ccrot, nblock, index, delta,
+			      state->rmat);
+
+	nn -= nblock;
+	ii += nblock;
+	jj += nblock;
+	delta += nblock;
+    }
+
+    state->dist = fit_distance (state);
+    state->nevals = 0;
+
+    return state->dist;
+}
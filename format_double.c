@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Write a double as the shortest decimal string that reads back as exactly
+ * the same double.
+ *
+ * printf with enough digits to be safe ("%.17g") is slow, and usually
+ * prints a couple of digits more than needed. Instead we use Loitsch's
+ * Grisu2 algorithm ("Printing floating-point numbers quickly and
+ * accurately with integers", PLDI 2010): the double and the two halfway
+ * points to its neighbors are scaled by a cached power of 10 into 64-bit
+ * integers, and digits are generated until the result is inside that
+ * interval. The answer always reads back exactly, and is almost always
+ * the shortest that does.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * An unsigned 64-bit significand f and binary exponent e: f * 2^e.
+ */
+struct diy_fp
+{
+    unsigned long long f;
+    int             e;
+};
+
+#define DIY_HIDDEN	0x0010000000000000ULL
+#define DIY_SIGNIF	0x000FFFFFFFFFFFFFULL
+
+/*
+ * Normalized significands and binary exponents of 10^-348, 10^-340, ...,
+ * 10^340.
+ */
+static const unsigned long long cached_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short cached_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const unsigned int pow10_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000
+};
+
+/*
+ * The product of x and y, rounded to the top 64 bits.
+ */
+static struct diy_fp
+diy_multiply (struct diy_fp x, struct diy_fp y)
+{
+unsigned long long a, b, c, d, ac, bc, ad, bd, tmp;
+struct diy_fp   result;
+
+    a = x.f >> 32;
+    b = x.f & 0xFFFFFFFFULL;
+    c = y.f >> 32;
+    d = y.f & 0xFFFFFFFFULL;
+    ac = a * c;
+    bc = b * c;
+    ad = a * d;
+    bd = b * d;
+    tmp = (bd >> 32) + (ad & 0xFFFFFFFFULL) + (bc & 0xFFFFFFFFULL);
+    tmp += 1ULL << 31;
+
+    result.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+/*
+ * Shift x left until its top bit is set.
+ */
+static struct diy_fp
+diy_normalize (struct diy_fp x)
+{
+    while (!(x.f & 0x8000000000000000ULL))
+    {
+	x.f <<= 1;
+	x.e--;
+    }
+    return x;
+}
+
+/*
+ * Step the last digit down while that brings the digits closer to the
+ * true value and keeps them inside the interval.
+ */
+static void
+grisu_round (char *buffer, int len, unsigned long long delta,
+	     unsigned long long rest, unsigned long long ten_kappa,
+	     unsigned long long wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+	   (rest + ten_kappa < wp_w ||
+	    wp_w - rest > rest + ten_kappa - wp_w))
+    {
+	buffer[len - 1]--;
+	rest += ten_kappa;
+    }
+}
+
+/*
+ * Generate the digits of a positive finite value.
+ *
+ * Output:
+ *	buffer holds the digits (no decimal point), len of them.
+ *	The value is those digits times 10^(*kk).
+ */
+static void
+grisu2 (double value, char *buffer, int *len, int *kk)
+{
+unsigned long long bits, one_f, wp_w, delta, p2, tmp;
+struct diy_fp   vv, w_plus, w_minus, c_mk, ww, wp, wm;
+unsigned int    p1, dd;
+int             biased, one_e, kappa, index;
+double          dk;
+
+    memcpy (&bits, &value, sizeof (bits));
+    biased = (int) ((bits >> 52) & 0x7FF);
+    vv.f = bits & DIY_SIGNIF;
+    if (biased != 0)
+    {
+	vv.f += DIY_HIDDEN;
+	vv.e = biased - 1075;
+    }
+    else
+	vv.e = 1 - 1075;
+
+    /* The halfway points to the neighboring doubles, on a common scale */
+    w_plus.f = (vv.f << 1) + 1;
+    w_plus.e = vv.e - 1;
+    while (!(w_plus.f & (DIY_HIDDEN << 1)))
+    {
+	w_plus.f <<= 1;
+	w_plus.e--;
+    }
+    w_plus.f <<= 64 - 52 - 2;
+    w_plus.e -= 64 - 52 - 2;
+
+    if (vv.f == DIY_HIDDEN)
+    {
+	w_minus.f = (vv.f << 2) - 1;
+	w_minus.e = vv.e - 2;
+    }
+    else
+    {
+	w_minus.f = (vv.f << 1) - 1;
+	w_minus.e = vv.e - 1;
+    }
+    w_minus.f <<= w_minus.e - w_plus.e;
+    w_minus.e = w_plus.e;
+
+    /*
+     * Pick the cached power of 10 that brings w_plus's exponent into
+     * [-60, -32], so that its integer part fits in 32 bits.
+     */
+    dk = (-61 - w_plus.e) * 0.30102999566398114 + 347;
+    *kk = (int) dk;
+    if (dk - *kk > 0.)
+	(*kk)++;
+    index = (*kk >> 3) + 1;
+    *kk = -(-348 + index * 8);
+    c_mk.f = cached_f[index];
+    c_mk.e = cached_e[index];
+
+    ww = diy_multiply (diy_normalize (vv), c_mk);
+    wp = diy_multiply (w_plus, c_mk);
+    wm = diy_multiply (w_minus, c_mk);
+    wm.f++;
+    wp.f--;
+
+    /* Generate digits from the top of the interval down. */
+    delta = wp.f - wm.f;
+    one_e = wp.e;
+    one_f = 1ULL << -one_e;
+    wp_w = wp.f - ww.f;
+    p1 = (unsigned int) (wp.f >> -one_e);
+    p2 = wp.f & (one_f - 1);
+
+    for (kappa = 10; kappa > 1 && p1 < pow10_32[kappa - 1]; kappa--);
+
+    *len = 0;
+    while (kappa > 0)
+    {
+	dd = p1 / pow10_32[kappa - 1];
+	p1 %= pow10_32[kappa - 1];
+	if (dd || *len)
+	    buffer[(*len)++] = (char) ('0' + dd);
+	kappa--;
+	tmp = ((unsigned long long) p1 << -one_e) + p2;
+	if (tmp <= delta)
+	{
+	    *kk += kappa;
+	    grisu_round (buffer, *len, delta, tmp,
+			 (unsigned long long) pow10_32[kappa] << -one_e, wp_w);
+	    return;
+	}
+    }
+
+    for (;;)
+    {
+	p2 *= 10;
+	delta *= 10;
+	dd = (unsigned int) (p2 >> -one_e);
+	if (dd || *len)
+	    buffer[(*len)++] = (char) ('0' + dd);
+	p2 &= one_f - 1;
+	kappa--;
+	if (p2 < delta)
+	{
+	    *kk += kappa;
+	    index = -kappa;
+	    grisu_round (buffer, *len, delta, p2, one_f,
+			 wp_w * (index < 10 ? pow10_32[index] : 0));
+	    return;
+	}
+    }
+}
+
+/*
+ * Format value into buf (which must have room for at least 32 characters)
+ * as the shortest string that reads back exactly, in %g style: plain
+ * notation for moderate exponents, else d.ddde-xx. Infinities and NaNs
+ * come out as "inf", "-inf", and "nan".
+ *
+ * Return value: the length of the string (not counting the terminating
+ * null, which is written).
+ */
+int
+format_double (char *buf, double value)
+{
+char            digits[24];
+char           *cp;
+int             len, kk, point, ii, expon;
+
+    cp = buf;
+    if (value != value)
+    {
+	strcpy (buf, "nan");
+	return 3;
+    }
+    if (signbit (value))
+    {
+	*cp++ = '-';
+	value = -value;
+    }
+    if (isinf (value))
+    {
+	strcpy (cp, "inf");
+	return (int) (cp - buf) + 3;
+    }
+    if (value == 0.)
+    {
+	*cp++ = '0';
+	*cp = '\0';
+	return (int) (cp - buf);
+    }
+
+    grisu2 (value, digits, &len, &kk);
+
+    /* The decimal point goes after this many digits. */
+    point = len + kk;
+
+    if (kk >= 0 && point <= 17)
+    {
+	/* An integer */
+	memcpy (cp, digits, (size_t) len);
+	cp += len;
+	for (ii = 0; ii < kk; ii++)
+	    *cp++ = '0';
+    }
+    else if (point > 0 && point <= 17)
+    {
+	memcpy (cp, digits, (size_t) point);
+	cp += point;
+	*cp++ = '.';
+	memcpy (cp, digits + point, (size_t) (len - point));
+	cp += len - point;
+    }
+    else if (point <= 0 && point > -5)
+    {
+	*cp++ = '0';
+	*cp++ = '.';
+	for (ii = 0; ii < -point; ii++)
+	    *cp++ = '0';
+	memcpy (cp, digits, (size_t) len);
+	cp += len;
+    }
+    else
+    {
+	*cp++ = digits[0];
+	if (len > 1)
+	{
+	    *cp++ = '.';
+	    memcpy (cp, digits + 1, (size_t) (len - 1));
+	    cp += len - 1;
+	}
+	*cp++ = 'e';
+	expon = point - 1;
+	if (expon < 0)
+	{
+	    *cp++ = '-';
+	    expon = -expon;
+	}
+	if (expon >= 100)
+	    *cp++ = (char) ('0' + expon / 100);
+	if (expon >= 10)
+	    *cp++ = (char) ('0' + expon / 10 % 10);
+	*cp++ = (char) ('0' + expon % 10);
+    }
+
+    *cp = '\0';
+    return (int) (cp - buf);
+}
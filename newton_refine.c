@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Polish an orientation that is already close to the best one by
+ * Newton's method, instead of by a grid search. This is how the searches
+ * refine a warm start (see warm_inc in cmat.h).
+ *
+ * The orientation is described by npar (2 or 3) parameters, each roughly
+ * a small rotation in radians away from the starting orientation, which
+ * is parameters all zero. Near a minimum the squared distance is close to
+ * a quadratic function of them. Its gradient and Hessian are found by
+ * central differences, as in distance_gradient.c, which takes 1 + 2 npar^2
+ * evaluations (9 for TI, 19 for Orthorhombic), and the step to the
+ * minimum of the quadratic is taken. Two or three steps usually reach the
+ * resolution of a full search, where a grid refinement from the same
+ * starting point would need hundreds or thousands of evaluations.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * Steps for the finite differences, in radians: the largest (used first)
+ * and the smallest (used once the steps become tiny). Below the smallest,
+ * rounding in the distance would swamp the differences.
+ */
+#ifdef DOUBLE_PRECISION
+#define NEWTON_HMAX	(1.e-4)
+#define NEWTON_HMIN	(1.e-6)
+#define NEWTON_TOL	(1.e-9)
+#else
+#define NEWTON_HMAX	(1.e-2)
+#define NEWTON_HMIN	(1.e-3)
+#define NEWTON_TOL	(1.e-5)
+#endif
+
+/* The most Newton steps to take before giving up */
+#define NEWTON_ITER	10
+
+/*
+ * Squared distance at parameters par plus hh times unit vectors ii and jj
+ * (either may be -1 for none).
+ */
+static double
+newton_eval (FLT_DBL (*objective) (void *, FLT_DBL *), void *data,
+	     int npar, FLT_DBL * par, int ii, double hi, int jj, double hj,
+	     struct search_opts *opts)
+{
+int             kk;
+FLT_DBL         trial[3];
+double          dist;
+
+    for (kk = 0; kk < npar; kk++)
+	trial[kk] = par[kk];
+    if (ii >= 0)
+	trial[ii] += hi;
+    if (jj >= 0)
+	trial[jj] += hj;
+
+    dist = objective (data, trial);
+    search_spend (opts);
+
+    return dist * dist;
+}
+
+/*
+ * Input:
+ *	objective (data, par) is the distance at parameters par.
+ *	npar is the number of parameters, at most 3.
+ *	max_step is how far (in radians) the answer may be from the start
+ *	before the start is judged too far from the minimum for this to work.
+ *	opts, if not a null pointer, may end the search early, as for
+ *	search_ti.
+ *
+ * Output:
+ *	par is the best point found.
+ *	dist is the distance there.
+ *	resolution is the size of the last step taken, in degrees.
+ *
+ * Return value:
+ *	1 if the minimum was found (or the search was stopped early, which
+ *	opts shows), 0 if not: the distance was not close enough to a
+ *	quadratic with a minimum within max_step. Then only a grid search
+ *	will do, but par and dist are still the best found.
+ */
+int
+newton_refine (FLT_DBL (*objective) (void *, FLT_DBL *), void *data,
+	       int npar, FLT_DBL max_step, struct search_opts *opts,
+	       FLT_DBL * par, FLT_DBL * dist, FLT_DBL * resolution)
+{
+int             ii, jj, kk, iter, halve;
+double          ff, ff_new, fpi, fmi, fpp, fpm, fmp, fmm;
+double          hh, len, total;
+double          grad[3], hess[3][3], chol[3][3], step[3];
+double          temp;
+FLT_DBL         trial[3];
+FLT_DBL         stop_below;
+
+    stop_below = (opts != (struct search_opts *) 0) ? opts->stop_below : -1.;
+
+    for (kk = 0; kk < npar; kk++)
+	par[kk] = 0.;
+    ff = newton_eval (objective, data, npar, par, -1, 0., -1, 0., opts);
+    *dist = sqrt (ff);
+    *resolution = max_step / DEGTORAD;
+
+    hh = NEWTON_HMAX;
+    for (iter = 0; iter < NEWTON_ITER; iter++)
+    {
+	if ((stop_below >= 0. && *dist <= stop_below) ||
+	    (opts != (struct search_opts *) 0 && opts->spent))
+	    return 1;
+
+	/* Gradient and Hessian of the squared distance */
+	for (ii = 0; ii < npar; ii++)
+	{
+	    fpi = newton_eval (objective, data, npar, par, ii, hh, -1, 0.,
+			       opts);
+	    fmi = newton_eval (objective, data, npar, par, ii, -hh, -1, 0.,
+			       opts);
+	    grad[ii] = (fpi - fmi) / (2. * hh);
+	    hess[ii][ii] = (fpi - 2. * ff + fmi) / (hh * hh);
+	}
+	for (ii = 0; ii < npar; ii++)
+	    for (jj = ii + 1; jj < npar; jj++)
+	    {
+		fpp = newton_eval (objective, data, npar, par, ii, hh, jj, hh,
+				   opts);
+		fpm = newton_eval (objective, data, npar, par, ii, hh, jj, -hh,
+				   opts);
+		fmp = newton_eval (objective, data, npar, par, ii, -hh, jj, hh,
+				   opts);
+		fmm = newton_eval (objective, data, npar, par, ii, -hh, jj,
+				   -hh, opts);
+		hess[ii][jj] = hess[jj][ii] =
+		 (fpp - fpm - fmp + fmm) / (4. * hh * hh);
+	    }
+
+	/*
+	 * Solve hess step = -grad by Cholesky factorization. If the Hessian
+	 * isn't positive definite this isn't near a minimum (or the minimum
+	 * is degenerate, as for a medium with more symmetry than asked for).
+	 */
+	for (ii = 0; ii < npar; ii++)
+	    for (jj = 0; jj <= ii; jj++)
+	    {
+		temp = hess[ii][jj];
+		for (kk = 0; kk < jj; kk++)
+		    temp -= chol[ii][kk] * chol[jj][kk];
+		if (ii == jj)
+		{
+		    if (temp <= 1.e-12 * fabs (hess[ii][ii]) || temp <= 0.)
+			return 0;
+		    chol[ii][ii] = sqrt (temp);
+		}
+		else
+		    chol[ii][jj] = temp / chol[jj][jj];
+	    }
+	for (ii = 0; ii < npar; ii++)
+	{
+	    temp = -grad[ii];
+	    for (kk = 0; kk < ii; kk++)
+		temp -= chol[ii][kk] * step[kk];
+	    step[ii] = temp / chol[ii][ii];
+	}
+	for (ii = npar - 1; ii >= 0; ii--)
+	{
+	    temp = step[ii];
+	    for (kk = ii + 1; kk < npar; kk++)
+		temp -= chol[kk][ii] * step[kk];
+	    step[ii] = temp / chol[ii][ii];
+	}
+
+	/*
+	 * Take the step, or as much of it as makes things better. If the
+	 * step is already tiny and nothing makes things better, we are down
+	 * to rounding and done.
+	 */
+	for (halve = 0; halve < 4; halve++)
+	{
+	    len = 0.;
+	    total = 0.;
+	    for (kk = 0; kk < npar; kk++)
+	    {
+		trial[kk] = par[kk] + step[kk];
+		len += step[kk] * step[kk];
+		total += trial[kk] * trial[kk];
+	    }
+	    len = sqrt (len);
+	    if (sqrt (total) > max_step)
+		return 0;
+
+	    ff_new = newton_eval (objective, data, npar, trial, -1, 0., -1, 0.,
+				  opts);
+	    if (ff_new <= ff)
+		break;
+
+	    for (kk = 0; kk < npar; kk++)
+		step[kk] /= 2.;
+	}
+	if (halve == 4)
+	    return (len < NEWTON_HMIN) ? 1 : 0;
+
+	for (kk = 0; kk < npar; kk++)
+	    par[kk] = trial[kk];
+	ff = ff_new;
+	*dist = sqrt (ff);
+	*resolution = len / DEGTORAD;
+
+	if (len < NEWTON_TOL)
+	    return 1;
+
+	/* Finer differences as we close in */
+	hh = (len < NEWTON_HMAX) ? len : NEWTON_HMAX;
+	if (hh < NEWTON_HMIN)
+	    hh = NEWTON_HMIN;
+    }
+
+    return 0;
+}
@@ -9,7 +9,6 @@
  */
 
 #include "cmat.h"
-#include <math.h>
 
 /*
  * Calculate the Federov norm of a stiffness matrix.
@@ -27,18 +26,9 @@
 FLT_DBL
 norm_matrix_6x6 (FLT_DBL * cc1)
 {
-int             ii, jj, kk, ll;
-double          temp1, temp2;
+FLT_DBL         ccp1[PACKED_SIZE];
 
-    temp2 = 0.;
-    for (ii = 0; ii < 3; ii++)
-	for (jj = 0; jj < 3; jj++)
-	    for (kk = 0; kk < 3; kk++)
-		for (ll = 0; ll < 3; ll++)
-		{
-		    temp1 = CCT1 (ii, jj, kk, ll);
-		    temp2 += temp1 * temp1;
-		}
+    pack_matrix_6x6 (ccp1, cc1);
 
-    return (FLT_DBL) sqrt (temp2);
+    return norm_packed (ccp1);
 }
@@ -11,7 +11,7 @@
 /*
  * Usage:
  *
- * orthotest < elastic_constants
+ * orthotest [options] < elastic_constants
  *
  * elastic constants is a file with 36 numbers in it,
  * usually 6 numbers on each of 6 lines.
@@ -61,125 +61,283 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "cmat.h"
 
+static int      group_mode (int compliance);
+static void     batch_values (int *chosen, struct batch_chunk *ch, int nn,
+			      double *values);
+static int      threshold_mode (FLT_DBL percent);
+
+/*
+ * The fields batch mode can output with --format (the last three only
+ * when the search has a budget), and how to print the default ones as
+ * plain text. By default the first 10 are output; the per-axis TI
+ * distances take more work after a batched search, so are only found
+ * when asked for.
+ */
+static const char *batch_fields[] = {
+    "dist", "xaxis_x", "xaxis_y", "xaxis_z", "yaxis_x", "yaxis_y", "yaxis_z",
+    "zaxis_x", "zaxis_y", "zaxis_z", "tidist_x", "tidist_y", "tidist_z",
+    "nevals", "resolution", "converged"
+};
+static const char *batch_text[] = {
+    "%.3f", "  %.4f", " %.4f", " %.4f", "  %.4f", " %.4f", " %.4f",
+    "  %.4f", " %.4f", " %.4f"
+};
+#define FIELD_TIDIST	10
+
+/*
+ * What the batch driver (see batch_driver.c) needs to know about orthotest
+ */
+static struct batch_program program = {
+    "orthotest", FIT_ORTHO, batch_fields, batch_text, 16, 10, 3, 7,
+    FIELD_TIDIST, "Orthorhombic", "Z principal axis", batch_values
+};
+
 int
-main ()
+main (int argc, char **argv)
 {
-int             ii, jj;
+int             ii;
 FLT_DBL         cc[6 * 6];
-FLT_DBL         cc1[6 * 6];
-FLT_DBL         cc2[6 * 6];
-FLT_DBL         ccrot[6 * 6];
-FLT_DBL         ccortho[6 * 6];
-FLT_DBL         ccrot2[6 * 6];
-FLT_DBL         ccti[6 * 6];
-FLT_DBL         rmat[9];
-FLT_DBL         rmat_transp[9];
-FLT_DBL         rmat_temp[9];
-FLT_DBL         vec[3];
-FLT_DBL         vec2[3];
-FLT_DBL         dist;
-FLT_DBL         norm;
-FLT_DBL         dist_best;
-FLT_DBL         phi, theta;
+struct ortho_result res;
+struct batch_options bo;
+int             status;
+FLT_DBL         ss[6 * 6];
+FLT_DBL         ccp[PACKED_SIZE];
+
+/*
+ * Process the command-line options (see batch_driver.c).
+ */
+    if (batch_parse (&program, &bo, argc, argv) < 0)
+	return 1;
+    if (bo.threshold >= 0.)
+	return threshold_mode (bo.threshold);
+    if (bo.group)
+	return group_mode (bo.compliance);
+    if (bo.batch || bo.serve || bo.volume)
+	return batch_main (&program, &bo, argc, argv);
 
 /*
  * Read in the elastic constants
  */
-    read_matrix_6x6 (cc);
+    status = read_matrix_6x6 (cc);
+    if (status <= 0)
+    {
+	if (status == 0)
+	    fprintf (stderr, "orthotest: no input matrix\n");
+	return 1;
+    }
+
+    /* With --compliance, what was read in is S, and C is its inverse. */
+    if (bo.compliance)
+    {
+	for (ii = 0; ii < 6 * 6; ii++)
+	    ss[ii] = cc[ii];
+	pack_matrix_6x6 (ccp, ss);
+	batch_compliance (&program, 1, ccp, 0);
+	unpack_matrix_6x6 (cc, ccp);
+
+	printf ("Input S matrix:\n");
+	print_matrix_6x6 (ss);
+	printf ("\n\n");
+    }
 
     printf ("Input C matrix:\n");
     print_matrix_6x6 (cc);
     printf ("\n\n");
 
 /*
- * Calculate the norm of this matrix, so that we can calculate
- * normalized deviations from symmetry for output.
+ * Find the best-approximating orthorhombic medium, and everything we are
+ * going to print out about it.
  */
-    norm = norm_matrix_6x6 (cc);
+    find_ortho_result (cc, &bo.opts, RESULT_ALL, &res);
 
-/*
- * Find the best-approximating orthorhombic medium.
- */
-    dist_best = find_ortho (cc, rmat);
-
-    transpose_matrix (rmat_transp, rmat);
+    /*
+     * With --compliance=both, give the matrices as compliances. The
+     * deviation and the distance stay those of the stiffnesses, as those
+     * are what was fitted.
+     */
+    if (bo.compliance_out)
+    {
+	invert_matrix_6x6 (res.ccrot, res.ccrot);
+	invert_matrix_6x6 (res.ccsym, res.ccsym);
+	invert_matrix_6x6 (res.ccorig, res.ccorig);
+    }
 
     /*
      * Write out the result!
      */
-    rotate_tensor (ccrot, cc, rmat);
-    printf ("Rotated C matrix:\n");
-    print_matrix_6x6 (ccrot);
+    printf ("Rotated %c matrix:\n", bo.compliance_out ? 'S' : 'C');
+    print_matrix_6x6 (res.ccrot);
     printf ("\n");
 
-    dist = ortho_distance (ccortho, ccrot);
-    printf ("Orthorhombic approximation:\n");
-    print_matrix_6x6 (ccortho);
+    printf ("Orthorhombic approximation%s:\n", bo.compliance_out ? " (S)" : "");
+    print_matrix_6x6 (res.ccsym);
     printf ("\n");
 
-    rotate_tensor (cc2, ccortho, rmat_transp);
-    printf ("Orthorhombic approximation in original coordinates:\n");
-    print_matrix_6x6 (cc2);
+    printf ("Orthorhombic approximation in original coordinates%s:\n",
+	    bo.compliance_out ? " (S)" : "");
+    print_matrix_6x6 (res.ccorig);
     printf ("\n");
 
-    for (ii = 0; ii < 6; ii++)
-	for (jj = 0; jj <= ii; jj++)
-	{
-	    CC1 (ii, jj) = CC1 (jj, ii) =
-	     (CC (ii, jj) - CC2 (ii, jj)) * 100. / norm;
-	}
     printf
      ("Normalized deviation from Orthorhombic in original coordinates, in percent:\n");
-    format_print_matrix_6x6 ("%11.4f ", cc1);
+    format_print_matrix_6x6 ("%11.4f ", res.ccdev);
     printf ("\n");
 
     printf ("Distance from Orthorhombic = %.3f percent\n",
-	    100. * dist / norm);
+	    100. * res.dist / res.norm);
     printf ("\n");
 
     /*
      * And write out the canonically ordered principal axes, and how well
-     * each functions as a TI symmetry axis.
+     * each functions as a TI symmetry axis (which the search has already
+     * worked out, to put them in order).
      */
-    vec[0] = 1.;
-    vec[1] = 0.;
-    vec[2] = 0.;
-    matrix_times_vector (vec2, rmat_transp, vec);
-    printf ("X axis: (%.4f, %.4f, %.4f)  ", vec2[0], vec2[1], vec2[2]);
-    vector_to_angles (vec2, &phi, &theta);
-    make_rotation_matrix (theta, phi, 0., rmat_temp);
-    rotate_tensor (ccrot2, cc, rmat_temp);
-    dist = ti_distance (ccti, ccrot2);
-    printf ("theta=%.3f, phi=%.3f, TI dist=%.3f%%\n",
-	    theta, phi, 100. * dist / norm);
-
-
-    vec[0] = 0.;
-    vec[1] = 1.;
-    vec[2] = 0.;
-    matrix_times_vector (vec2, rmat_transp, vec);
-    printf ("Y axis: (%.4f, %.4f, %.4f)  ", vec2[0], vec2[1], vec2[2]);
-    vector_to_angles (vec2, &phi, &theta);
-    make_rotation_matrix (theta, phi, 0., rmat_temp);
-    rotate_tensor (ccrot2, cc, rmat_temp);
-    dist = ti_distance (ccti, ccrot2);
-    printf ("theta=%.3f, phi=%.3f, TI dist=%.3f%%\n",
-	    theta, phi, 100. * dist / norm);
-
-    vec[0] = 0.;
-    vec[1] = 0.;
-    vec[2] = 1.;
-    matrix_times_vector (vec2, rmat_transp, vec);
-    printf ("Z axis: (%.4f, %.4f, %.4f)  ", vec2[0], vec2[1], vec2[2]);
-    vector_to_angles (vec2, &phi, &theta);
-    make_rotation_matrix (theta, phi, 0., rmat_temp);
-    rotate_tensor (ccrot2, cc, rmat_temp);
-    dist = ti_distance (ccti, ccrot2);
-    printf ("theta=%.3f, phi=%.3f, TI dist=%.3f%%\n",
-	    theta, phi, 100. * dist / norm);
+    for (ii = 0; ii < 3; ii++)
+    {
+	printf ("%c axis: (%.4f, %.4f, %.4f)  ", "XYZ"[ii],
+		res.axis[ii][0], res.axis[ii][1], res.axis[ii][2]);
+	printf ("theta=%.3f, phi=%.3f, TI dist=%.3f%%\n",
+		res.theta[ii], res.phi[ii], 100. * res.axis_dist[ii] / res.norm);
+    }
+
+    if (search_budgeted (&bo.opts))
+	printf ("Search: %ld evaluations, resolution %.3g degrees, %s\n",
+		bo.opts.nevals, bo.opts.resolution,
+		bo.opts.converged ? "converged" : "not converged");
 
     return 0;
 }
+
+/*
+ * --group: read stiffness matrices until the input runs out, and find
+ * the single orthorhombic frame that best fits all of them together.
+ * Output the shared principal axes, the overall distance from
+ * Orthorhombic, and the distance from Orthorhombic of each matrix in
+ * that frame. With compliance, the matrices read in are compliances.
+ */
+static int
+group_mode (int compliance)
+{
+int             ii, nn, ncc;
+FLT_DBL        *ccs;
+FLT_DBL        *dists;
+FLT_DBL         rmat[9];
+FLT_DBL         rmat_transp[9];
+FLT_DBL         vec[3];
+FLT_DBL         vec2[3];
+FLT_DBL         phi, theta;
+FLT_DBL         dist_best;
+FLT_DBL         norm;
+double          norm_sum;
+
+    ccs = batch_read_all (&program, &ncc);
+    if (ccs == (FLT_DBL *) 0)
+	return 1;
+    dists = (FLT_DBL *) malloc ((ncc + 1) * sizeof (FLT_DBL));
+    if (dists == (FLT_DBL *) 0)
+    {
+	fprintf (stderr, "orthotest: out of memory\n");
+	return 1;
+    }
+    if (compliance)
+	batch_compliance (&program, ncc, ccs, 0);
+
+    dist_best = find_ortho_group (ncc, ccs, rmat, dists);
+    transpose_matrix (rmat_transp, rmat);
+
+    printf ("Shared orthorhombic principal axes for %d matrices:\n", ncc);
+    for (ii = 0; ii < 3; ii++)
+    {
+	vec[0] = vec[1] = vec[2] = 0.;
+	vec[ii] = 1.;
+	matrix_times_vector (vec2, rmat_transp, vec);
+	vector_to_angles (vec2, &phi, &theta);
+	printf ("%c axis: (%.4f, %.4f, %.4f)  theta=%.3f, phi=%.3f\n",
+		"XYZ"[ii], vec2[0], vec2[1], vec2[2], theta, phi);
+    }
+    printf ("\n");
+
+    /*
+     * Output the distance of each matrix from Orthorhombic, normalized to
+     * a percentage of its own norm, and the overall distance normalized by
+     * the overall norm.
+     */
+    norm_sum = 0.;
+    for (nn = 0; nn < ncc; nn++)
+    {
+	norm = norm_packed (ccs + PACKED_SIZE * nn);
+	norm_sum += norm * norm;
+	printf ("Matrix %d: distance from Orthorhombic = %.3f percent\n",
+		nn + 1, 100. * dists[nn] / norm);
+    }
+    printf ("\n");
+    printf ("Overall distance from Orthorhombic = %.3f percent\n",
+	    100. * dist_best / sqrt (norm_sum));
+
+    free (ccs);
+    free (dists);
+
+    return 0;
+}
+
+/*
+ * --threshold=percent: read stiffness matrices until the input runs out,
+ * and for each decide whether its distance from Orthorhombic is no more than
+ * percent. Output one line per matrix: 1 if it is, 0 if not, and then
+ * the lower and upper bounds on the percent distance that decided it.
+ */
+static int
+threshold_mode (FLT_DBL percent)
+{
+FLT_DBL         cc[6 * 6];
+FLT_DBL         bounds[2];
+FLT_DBL         norm;
+int             yes, status;
+
+    while ((status = read_matrix_6x6 (cc)) > 0)
+    {
+	norm = norm_matrix_6x6 (cc);
+	yes = classify_ortho (cc, percent * norm / 100., bounds);
+	printf ("%d  %.3f %.3f\n", yes,
+		100. * bounds[0] / norm, 100. * bounds[1] / norm);
+    }
+
+    return status < 0;
+}
+
+/*
+ * The value of every chosen field (see batch_fields) but the budget ones
+ * for matrix nn of a chunk.
+ */
+static void
+batch_values (int *chosen, struct batch_chunk *ch, int nn, double *values)
+{
+int             ii;
+FLT_DBL         norm;
+FLT_DBL        *rr;
+
+    /*
+     * The principal axes are the columns of the transpose of rmat,
+     * ie, the rows of rmat.
+     */
+    rr = ch->rmat + 9 * nn;
+
+    norm = 1.;
+    if (chosen[0] || chosen[FIELD_TIDIST] ||
+	chosen[FIELD_TIDIST + 1] || chosen[FIELD_TIDIST + 2])
+	norm = norm_packed (ch->ccs + PACKED_SIZE * nn);
+    values[0] = chosen[0] ? 100. * ch->dist_best[nn] / norm : 0.;
+    for (ii = 0; ii < 9; ii++)
+	values[1 + ii] = rr[3 * (ii % 3) + ii / 3];
+
+    /* Only worked out after a batched search if asked for */
+    for (ii = 0; ii < 3; ii++)
+	values[FIELD_TIDIST + ii] = chosen[FIELD_TIDIST + ii] ?
+	 100. * ch->axis_dist[3 * nn + ii] / norm : 0.;
+
+    return;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Packed stiffness matrices.
+ *
+ * A stiffness matrix is symmetric, so only the 21 elements on and above
+ * the diagonal need be kept: C11 C12 ... C16 C22 ... C26 ... C66, row by
+ * row. The searches, the distance functions, and batches of many
+ * matrices all work with this packed form; the full 6x6 form is only
+ * used at the edges, for reading, printing, and the single-matrix entry
+ * points (find_ti, find_ortho, ...), which convert with pack_matrix_6x6
+ * and unpack_matrix_6x6.
+ *
+ * CCP(A,B) (see cmat.h) indexes a packed matrix with C Voigt indices,
+ * in either order.
+ */
+
+#include "cmat.h"
+
+/* This array converts from Voigt notation to the packed index */
+int             extern_packed[6][6] = {
+    {0, 1, 2, 3, 4, 5},
+    {1, 6, 7, 8, 9, 10},
+    {2, 7, 11, 12, 13, 14},
+    {3, 8, 12, 15, 16, 17},
+    {4, 9, 13, 16, 18, 19},
+    {5, 10, 14, 17, 19, 20}
+};
+
+/*
+ * Input: 6x6 elastic matrix cc (only the upper triangle is used)
+ *
+ * Output: packed matrix ccp
+ */
+void
+pack_matrix_6x6 (FLT_DBL * ccp, FLT_DBL * cc)
+{
+int             ii, jj, kk;
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	    ccp[kk++] = CC (ii, jj);
+
+    return;
+}
+
+/*
+ * Input: packed matrix ccp
+ *
+ * Output: 6x6 elastic matrix cc
+ */
+void
+unpack_matrix_6x6 (FLT_DBL * cc, FLT_DBL * ccp)
+{
+int             ii, jj, kk;
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	{
+	    CC (ii, jj) = CC (jj, ii) = ccp[kk];
+	    kk++;
+	}
+
+    return;
+}
+
+/*
+ * Federov's tensor norm of a packed matrix (see norm_matrix.c), by the
+ * typed kernel for FLT_DBL (see typed_kernels.c).
+ */
+FLT_DBL
+norm_packed (FLT_DBL * ccp)
+{
+    return FLT_DBL_KERNEL (norm_packed) (ccp);
+}
+
+/*
+ * The distance between two packed matrices: the Federov norm of their
+ * difference.
+ */
+FLT_DBL
+packed_distance (FLT_DBL * ccp1, FLT_DBL * ccp2)
+{
+    return FLT_DBL_KERNEL (packed_distance) (ccp1, ccp2);
+}
@@ -67,3 +67,102 @@ double          tx, ty, tz, tq, tk;
 
     return;
 }
+
+/*
+ * Compose two rotations given as quaternions, without going through
+ * rotation matrices.
+ *
+ * Input:
+ *	qq1, qq2 are quaternions.
+ *
+ * Output:
+ *	qq is the quaternion of the rotation by qq2 followed by qq1:
+ *	quaternion_to_matrix gives for it what matrix_times_matrix gives
+ *	for the matrices of qq1 and qq2, in that order. qq may be the same
+ *	array as either input. If both are normalized, so is qq.
+ */
+
+void
+quaternion_multiply (FLT_DBL * qq, FLT_DBL * qq1, FLT_DBL * qq2)
+{
+double          ww, xx, yy, zz;
+
+    /*
+     * quaternion_to_matrix's matrices multiply in the opposite order to
+     * the quaternions themselves, so this is the product qq2 qq1.
+     */
+    ww = qq2[0] * qq1[0] - qq2[1] * qq1[1] - qq2[2] * qq1[2] -
+     qq2[3] * qq1[3];
+    xx = qq2[0] * qq1[1] + qq2[1] * qq1[0] + qq2[2] * qq1[3] -
+     qq2[3] * qq1[2];
+    yy = qq2[0] * qq1[2] - qq2[1] * qq1[3] + qq2[2] * qq1[0] +
+     qq2[3] * qq1[1];
+    zz = qq2[0] * qq1[3] + qq2[1] * qq1[2] - qq2[2] * qq1[1] +
+     qq2[3] * qq1[0];
+
+    qq[0] = ww;
+    qq[1] = xx;
+    qq[2] = yy;
+    qq[3] = zz;
+
+    return;
+}
+
+/*
+ * The inverse of quaternion_to_matrix.
+ *
+ * Input:
+ *	rmat is a 3x3 rotation matrix.
+ *
+ * Output:
+ *	qq is a normalized quaternion that quaternion_to_matrix turns back
+ *	into rmat. (So does -qq.)
+ *
+ * The largest of the four components is found first, from the diagonal
+ * of rmat, and the others from sums and differences of the off-diagonal
+ * elements divided by it, so nothing is divided by a small number.
+ */
+
+void
+matrix_to_quaternion (FLT_DBL * rmat, FLT_DBL * qq)
+{
+double          trace, tt;
+
+    trace = RMAT (0, 0) + RMAT (1, 1) + RMAT (2, 2);
+
+    if (trace >= RMAT (0, 0) && trace >= RMAT (1, 1) &&
+	trace >= RMAT (2, 2))
+    {
+	tt = 2. * sqrt (1. + trace);
+	qq[0] = tt / 4.;
+	qq[1] = (RMAT (2, 1) - RMAT (1, 2)) / tt;
+	qq[2] = (RMAT (0, 2) - RMAT (2, 0)) / tt;
+	qq[3] = (RMAT (1, 0) - RMAT (0, 1)) / tt;
+    }
+    else if (RMAT (0, 0) >= RMAT (1, 1) && RMAT (0, 0) >= RMAT (2, 2))
+    {
+	tt = 2. * sqrt (1. + RMAT (0, 0) - RMAT (1, 1) - RMAT (2, 2));
+	qq[0] = (RMAT (2, 1) - RMAT (1, 2)) / tt;
+	qq[1] = tt / 4.;
+	qq[2] = (RMAT (0, 1) + RMAT (1, 0)) / tt;
+	qq[3] = (RMAT (0, 2) + RMAT (2, 0)) / tt;
+    }
+    else if (RMAT (1, 1) >= RMAT (2, 2))
+    {
+	tt = 2. * sqrt (1. - RMAT (0, 0) + RMAT (1, 1) - RMAT (2, 2));
+	qq[0] = (RMAT (0, 2) - RMAT (2, 0)) / tt;
+	qq[1] = (RMAT (0, 1) + RMAT (1, 0)) / tt;
+	qq[2] = tt / 4.;
+	qq[3] = (RMAT (1, 2) + RMAT (2, 1)) / tt;
+    }
+    else
+    {
+	tt = 2. * sqrt (1. - RMAT (0, 0) - RMAT (1, 1) + RMAT (2, 2));
+	qq[0] = (RMAT (1, 0) - RMAT (0, 1)) / tt;
+	qq[1] = (RMAT (0, 2) + RMAT (2, 0)) / tt;
+	qq[2] = (RMAT (1, 2) + RMAT (2, 1)) / tt;
+	qq[3] = tt / 4.;
+    }
+
+    return;
+}
@@ -8,8 +8,272 @@
  * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
  */
 
+/*
+ * Reading stiffness matrices from standard input.
+ *
+ * Batch runs can read a great many matrices, so rather than scanf we
+ * read the input in large blocks and convert the numbers ourselves.
+ * Numbers may be separated by any mixture of white space, commas, and
+ * semicolons, so both the original layout (6 numbers on each of 6
+ * lines) and comma-separated files can be read, and line breaks do not
+ * matter.
+ *
+ * Most numbers in these files have few enough digits that they can be
+ * converted exactly with a single multiplication or division by a power
+ * of 10 (Clinger's fast path); anything else is handed to strtod. The
+ * decimal point is always ".", whatever the locale.
+ *
+ * Bad input is reported on standard error with the line and column
+ * where it was found.
+ */
+
 #include "cmat.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define READ_BUFSIZE	65536
+
+/* The longest number we will accept */
+#define READ_TOKEN_MAX	128
+
+/*
+ * How far apart C_ij and C_ji may be, relative to the largest element,
+ * before the matrix is rejected as not symmetric.
+ */
+#define READ_ASYM_TOL	1.e-4
+
+static int      read_layout = READ_FULL;
+
+static char     read_buf[READ_BUFSIZE];
+static long     read_pos, read_len, read_line_start;
+static long     read_line = 1;
+static int      read_eof;
+
+/*
+ * Is ch something that can come between numbers? (White space, comma,
+ * or semicolon.)
+ */
+static const unsigned char read_separator[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0
+};
+#define READ_SEPARATOR(ch)	read_separator[(unsigned char) (ch)]
+
+/*
+ * Keep the unread part of the buffer, moved to the front, and read in
+ * more after it. Return 0 if there was no more input.
+ */
+static int
+read_fill (void)
+{
+size_t          nn;
+
+    if (read_eof)
+	return 0;
+
+    memmove (read_buf, read_buf + read_pos, (size_t) (read_len - read_pos));
+    read_len -= read_pos;
+    read_line_start -= read_pos;
+    read_pos = 0;
+
+    nn = fread (read_buf + read_len, 1, (size_t) (READ_BUFSIZE - read_len),
+		stdin);
+    if (nn == 0)
+	read_eof = 1;
+    read_len += (long) nn;
+
+    return nn != 0;
+}
+
+/*
+ * Convert the number in token[0] through token[len-1]. Return 1, or 0 if
+ * it isn't a number, or -1 if it is too big to be a double.
+ */
+static int
+read_convert (const char *token, int len, double *value)
+{
+static const double pow10[] = {
+    1.e0, 1.e1, 1.e2, 1.e3, 1.e4, 1.e5, 1.e6, 1.e7, 1.e8, 1.e9, 1.e10,
+    1.e11, 1.e12, 1.e13, 1.e14, 1.e15, 1.e16, 1.e17, 1.e18, 1.e19, 1.e20,
+    1.e21, 1.e22
+};
+const char     *cp, *last;
+char            copy[READ_TOKEN_MAX + 1], *end;
+unsigned long long mantissa;
+int             negative, ndigit, nsig, scale, expon, expon_neg;
+
+    cp = token;
+    last = token + len;
+    negative = 0;
+    if (cp < last && (*cp == '+' || *cp == '-'))
+	negative = (*cp++ == '-');
+
+    /*
+     * Collect the significant digits into an integer, and note the power
+     * of 10 to scale it by.
+     */
+    mantissa = 0;
+    ndigit = 0;
+    nsig = 0;
+    scale = 0;
+    for (; cp < last && *cp >= '0' && *cp <= '9'; cp++, ndigit++)
+    {
+	if (mantissa != 0 || *cp != '0')
+	{
+	    if (nsig++ < 19)
+		mantissa = 10 * mantissa + (*cp - '0');
+	    else
+		scale++;
+	}
+    }
+    if (cp < last && *cp == '.')
+    {
+	for (cp++; cp < last && *cp >= '0' && *cp <= '9'; cp++, ndigit++)
+	{
+	    if (mantissa != 0 || *cp != '0')
+	    {
+		if (nsig++ < 19)
+		{
+		    mantissa = 10 * mantissa + (*cp - '0');
+		    scale--;
+		}
+	    }
+	    else
+		scale--;
+	}
+    }
+    if (ndigit == 0)
+	return 0;
+
+    if (cp < last && (*cp == 'e' || *cp == 'E'))
+    {
+	cp++;
+	expon_neg = 0;
+	if (cp < last && (*cp == '+' || *cp == '-'))
+	    expon_neg = (*cp++ == '-');
+	if (cp == last || *cp < '0' || *cp > '9')
+	    return 0;
+	for (expon = 0; cp < last && *cp >= '0' && *cp <= '9'; cp++)
+	{
+	    if (expon < 100000)
+		expon = 10 * expon + (*cp - '0');
+	}
+	scale += expon_neg ? -expon : expon;
+    }
+    if (cp != last)
+	return 0;
+
+    /*
+     * Both the mantissa and the power of 10 are exact doubles, so one
+     * correctly rounded operation gives the correctly rounded answer.
+     */
+    if (nsig <= 19 && mantissa <= (1ULL << 53) && scale >= -22 && scale <= 22)
+    {
+	if (scale >= 0)
+	    *value = (double) mantissa * pow10[scale];
+	else
+	    *value = (double) mantissa / pow10[-scale];
+	if (negative)
+	    *value = -*value;
+	return 1;
+    }
+
+    memcpy (copy, token, (size_t) len);
+    copy[len] = '\0';
+    *value = strtod (copy, &end);
+    if (*end != '\0')
+	return 0;
+    return isfinite (*value) ? 1 : -1;
+}
+
+/*
+ * Read the next number from standard input.
+ *
+ * Output:
+ *	value is the number.
+ *	line, column say where it started.
+ *
+ * Return value:
+ *	1 if a number was read, 0 if the input ran out, -1 if bad input
+ *	was found (and reported).
+ */
+static int
+read_number (double *value, long *line, long *column)
+{
+long            end;
+int             ch, ok;
+
+    for (;;)
+    {
+	if (read_pos == read_len && !read_fill ())
+	    return 0;
+	ch = read_buf[read_pos];
+	if (!READ_SEPARATOR (ch))
+	    break;
+	read_pos++;
+	if (ch == '\n')
+	{
+	    read_line++;
+	    read_line_start = read_pos;
+	}
+    }
+
+    /* Find the end of the number, reading more in if it runs off the end. */
+    end = read_pos;
+    for (;;)
+    {
+	while (end < read_len && !READ_SEPARATOR (read_buf[end]))
+	    end++;
+	if (end < read_len || end - read_pos > READ_TOKEN_MAX)
+	    break;
+	end -= read_pos;
+	if (!read_fill ())
+	{
+	    end += read_pos;
+	    break;
+	}
+	end += read_pos;
+    }
+
+    *line = read_line;
+    *column = read_pos - read_line_start + 1;
+
+    if (end - read_pos > READ_TOKEN_MAX)
+    {
+	fprintf (stderr, "read_matrix: line %ld, column %ld: "
+		 "number is too long\n", *line, *column);
+	return -1;
+    }
+    ok = read_convert (read_buf + read_pos, (int) (end - read_pos), value);
+    if (ok <= 0)
+    {
+	fprintf (stderr, "read_matrix: line %ld, column %ld: "
+		 "\"%.*s\" is %s\n", *line, *column,
+		 (int) (end - read_pos), read_buf + read_pos,
+		 (ok < 0) ? "too large" : "not a number");
+	return -1;
+    }
+    read_pos = end;
+
+    return 1;
+}
+
+/*
+ * Choose how read_matrix_6x6 expects each matrix to be laid out:
+ * READ_FULL, all 36 elements row by row (the default), or READ_UPPER,
+ * the 21 elements on and above the diagonal row by row (C11 C12 ... C16
+ * C22 ... C66).
+ */
+void
+read_matrix_layout (int layout)
+{
+    read_layout = layout;
+    return;
+}
 
 /*
  * Read a stiffness matrix from standard input.
@@ -17,23 +281,88 @@
  * Output:
  * 	cc is a 6x6 elastic stiffness matrix read from standard input.
  *
+ * Return value:
+ *	1 if a complete matrix was read, 0 if the input ran out first,
+ *	-1 if the input was bad: something that isn't a number, a matrix
+ *	cut short by the end of the input, or (for READ_FULL) a matrix
+ *	that is not symmetric. The problem is reported on standard error.
+ *
  * Author Joe Dellinger, Amoco TTC, 19 Feb 1997.
  */
 
-void
+int
 read_matrix_6x6 (FLT_DBL * cc)
 {
-int             ii, jj;
+int             ii, jj, nn, nnum, status;
+double          value, big;
+long            line[6 * 6], column[6 * 6];
 
+    nnum = (read_layout == READ_UPPER) ? 21 : 36;
+
+    nn = 0;
     for (ii = 0; ii < 6; ii++)
-	for (jj = 0; jj < 6; jj++)
+	for (jj = (read_layout == READ_UPPER) ? ii : 0; jj < 6; jj++)
 	{
-#ifdef DOUBLE_PRECISION
-	    scanf ("%lf", &CC (ii, jj));
-#else
-	    scanf ("%f", &CC (ii, jj));
-#endif
+	    status = read_number (&value, &line[jj + 6 * ii],
+				  &column[jj + 6 * ii]);
+	    if (status < 0)
+		return -1;
+	    if (status == 0)
+	    {
+		if (nn == 0)
+		    return 0;
+		fprintf (stderr, "read_matrix: line %ld: input ends after "
+			 "%d of the %d numbers of a matrix\n",
+			 read_line, nn, nnum);
+		return -1;
+	    }
+
+	    CC (ii, jj) = (FLT_DBL) value;
+	    if (read_layout == READ_UPPER)
+		CC (jj, ii) = CC (ii, jj);
+	    nn++;
 	}
 
-    return;
+    if (read_layout == READ_UPPER)
+	return 1;
+
+    big = 0.;
+    for (ii = 0; ii < 36; ii++)
+	if (fabs ((double) cc[ii]) > big)
+	    big = fabs ((double) cc[ii]);
+
+    for (ii = 1; ii < 6; ii++)
+	for (jj = 0; jj < ii; jj++)
+	{
+	    if (fabs ((double) CC (ii, jj) - (double) CC (jj, ii)) >
+		READ_ASYM_TOL * big)
+	    {
+		fprintf (stderr, "read_matrix: line %ld, column %ld: "
+			 "C%d%d = %g but C%d%d = %g; "
+			 "the matrix is not symmetric\n",
+			 line[jj + 6 * ii], column[jj + 6 * ii],
+			 ii + 1, jj + 1, (double) CC (ii, jj),
+			 jj + 1, ii + 1, (double) CC (jj, ii));
+		return -1;
+	    }
+	}
+
+    return 1;
+}
+
+/*
+ * read_matrix_6x6, but storing the matrix packed (see packed_matrix.c),
+ * as for a batch of matrices. The return value is as for read_matrix_6x6.
+ */
+int
+read_matrix_packed (FLT_DBL * ccp)
+{
+FLT_DBL         cc[6 * 6];
+int             status;
+
+    status = read_matrix_6x6 (cc);
+    if (status > 0)
+	pack_matrix_6x6 (ccp, cc);
+
+    return status;
 }
@@ -0,0 +1,580 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * A cache of search results, keyed on the 21 independent elastic
+ * constants.
+ *
+ * Blocky models hand us the same stiffness matrix over and over. The
+ * cache lets each distinct matrix be searched only once: find_ti_cached
+ * and find_ortho_cached look every input up, run the batched search on
+ * just the distinct ones that are new, and hand the answers back to all
+ * the inputs.
+ *
+ * The key is normally the exact bit pattern of the constants. Optionally
+ * the constants can instead be rounded to a multiple of a given quantum
+ * (in the same units as the constants), so that matrices that differ by
+ * less than that share an answer.
+ *
+ * The cache can also be kept in a file, so that later runs can reuse it.
+ * The file starts with a header saying what sort of results it holds
+ * and how the keys were made, followed by one record per result: the 21
+ * key integers and then the result. New results are appended as they are
+ * found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cmat.h"
+
+#define CACHE_MAGIC	"CMATCACHE1"
+
+/* The table is kept at most half full. */
+#define CACHE_START	1024
+
+struct cache_entry
+{
+    int             used;
+    /* Index into the batch being worked on, or -1 if the result is known */
+    int             pending;
+    long long       key[21];
+    FLT_DBL         result[CACHE_RESULT_MAX];
+};
+
+struct result_cache
+{
+    int             nresult;
+    double          quantum;
+    long            size;
+    long            count;
+    struct cache_entry *table;
+    FILE           *store;
+};
+
+/*
+ * Make the key for a stiffness matrix.
+ */
+static void
+cache_key (struct result_cache *cache, FLT_DBL * ccp, long long *key)
+{
+int             kk;
+double          value;
+
+    for (kk = 0; kk < PACKED_SIZE; kk++)
+    {
+	value = (double) ccp[kk];
+
+	if (cache->quantum > 0.)
+	    key[kk] = (long long) floor (value / cache->quantum + .5);
+	else
+	{
+	    /* Minus zero is the same matrix as zero. */
+	    if (value == 0.)
+		value = 0.;
+	    memcpy (&key[kk], &value, sizeof (long long));
+	}
+    }
+
+    return;
+}
+
+/*
+ * FNV-1a hash of a key.
+ */
+static unsigned long long
+cache_hash (long long *key)
+{
+unsigned long long hash;
+unsigned char  *bytes;
+size_t          ii;
+
+    bytes = (unsigned char *) key;
+    hash = 14695981039346656037ULL;
+    for (ii = 0; ii < 21 * sizeof (long long); ii++)
+    {
+	hash ^= bytes[ii];
+	hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * Find the entry for key: either the one holding it, or the empty one
+ * where it would go.
+ */
+static struct cache_entry *
+cache_slot (struct result_cache *cache, long long *key)
+{
+long            ii;
+struct cache_entry *entry;
+
+    ii = (long) (cache_hash (key) & (unsigned long long) (cache->size - 1));
+    for (;;)
+    {
+	entry = cache->table + ii;
+	if (!entry->used || memcmp (entry->key, key, sizeof (entry->key)) == 0)
+	    return entry;
+	ii = (ii + 1) & (cache->size - 1);
+    }
+}
+
+/*
+ * Double the size of the table. Return 0 if out of memory.
+ */
+static int
+cache_grow (struct result_cache *cache)
+{
+long            ii;
+struct cache_entry *old_table;
+long            old_size;
+struct cache_entry *entry;
+
+    old_table = cache->table;
+    old_size = cache->size;
+
+    cache->table = (struct cache_entry *)
+     calloc ((size_t) (2 * old_size), sizeof (struct cache_entry));
+    if (cache->table == (struct cache_entry *) 0)
+    {
+	cache->table = old_table;
+	return 0;
+    }
+    cache->size = 2 * old_size;
+
+    for (ii = 0; ii < old_size; ii++)
+    {
+	if (!old_table[ii].used)
+	    continue;
+	entry = cache_slot (cache, old_table[ii].key);
+	*entry = old_table[ii];
+    }
+
+    free (old_table);
+    return 1;
+}
+
+/*
+ * Make sure there is room for nn more entries without growing the table.
+ * Return 0 if out of memory.
+ */
+static int
+cache_reserve (struct result_cache *cache, long nn)
+{
+    while (2 * (cache->count + nn) > cache->size)
+    {
+	if (!cache_grow (cache))
+	    return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Add an entry for key (which must not already be there), growing the
+ * table if need be. Return a null pointer if out of memory.
+ */
+static struct cache_entry *
+cache_add (struct result_cache *cache, long long *key)
+{
+struct cache_entry *entry;
+
+    if (!cache_reserve (cache, 1))
+	return (struct cache_entry *) 0;
+
+    entry = cache_slot (cache, key);
+    entry->used = 1;
+    entry->pending = -1;
+    memcpy (entry->key, key, sizeof (entry->key));
+    cache->count++;
+
+    return entry;
+}
+
+/*
+ * Read in a stored cache, or start a new one. Return 0 if the file is not
+ * a cache of the right sort, or can't be written.
+ */
+static int
+cache_load (struct result_cache *cache, const char *path)
+{
+FILE           *fp;
+char            magic[sizeof (CACHE_MAGIC)];
+int             nresult, fsize;
+double          quantum;
+long long       key[21];
+FLT_DBL         result[CACHE_RESULT_MAX];
+struct cache_entry *entry;
+
+    fp = fopen (path, "rb");
+    if (fp != (FILE *) 0)
+    {
+	if (fread (magic, sizeof (magic), 1, fp) != 1 ||
+	    memcmp (magic, CACHE_MAGIC, sizeof (magic)) != 0 ||
+	    fread (&nresult, sizeof (int), 1, fp) != 1 ||
+	    fread (&fsize, sizeof (int), 1, fp) != 1 ||
+	    fread (&quantum, sizeof (double), 1, fp) != 1 ||
+	    nresult != cache->nresult ||
+	    fsize != (int) sizeof (FLT_DBL) || quantum != cache->quantum)
+	{
+	    fclose (fp);
+	    return 0;
+	}
+
+	/* A partly written last record (from a crash) is ignored. */
+	while (fread (key, sizeof (key), 1, fp) == 1 &&
+	       fread (result, sizeof (FLT_DBL), (size_t) nresult, fp) ==
+	       (size_t) nresult)
+	{
+	    entry = cache_slot (cache, key);
+	    if (!entry->used)
+	    {
+		entry = cache_add (cache, key);
+		if (entry == (struct cache_entry *) 0)
+		    break;
+	    }
+	    memcpy (entry->result, result, nresult * sizeof (FLT_DBL));
+	}
+	fclose (fp);
+
+	cache->store = fopen (path, "ab");
+	return cache->store != (FILE *) 0;
+    }
+
+    cache->store = fopen (path, "wb");
+    if (cache->store == (FILE *) 0)
+	return 0;
+
+    nresult = cache->nresult;
+    fsize = (int) sizeof (FLT_DBL);
+    quantum = cache->quantum;
+    fwrite (CACHE_MAGIC, sizeof (magic), 1, cache->store);
+    fwrite (&nresult, sizeof (int), 1, cache->store);
+    fwrite (&fsize, sizeof (int), 1, cache->store);
+    fwrite (&quantum, sizeof (double), 1, cache->store);
+
+    return 1;
+}
+
+/*
+ * Start a cache.
+ *
+ * Input:
+ *	nresult is how many numbers each result has (at most
+ *	CACHE_RESULT_MAX): 3 for find_ti_cached, 10 for find_ortho_cached.
+ *	quantum, if positive, is the rounding applied to the constants
+ *	to make the keys; otherwise the keys are exact.
+ *	path, if not a null pointer, is the file the cache is kept in.
+ *	If it exists it must hold a cache made with the same nresult and
+ *	quantum, and the same precision of FLT_DBL.
+ *
+ * Return value:
+ *	The cache, or a null pointer if out of memory or the file could not
+ *	be used.
+ */
+struct result_cache *
+cache_open (int nresult, double quantum, const char *path)
+{
+struct result_cache *cache;
+
+    if (nresult < 1 || nresult > CACHE_RESULT_MAX)
+	return (struct result_cache *) 0;
+
+    cache = (struct result_cache *) malloc (sizeof (struct result_cache));
+    if (cache == (struct result_cache *) 0)
+	return cache;
+
+    cache->nresult = nresult;
+    cache->quantum = quantum;
+    cache->size = CACHE_START;
+    cache->count = 0;
+    cache->store = (FILE *) 0;
+    cache->table = (struct cache_entry *)
+     calloc ((size_t) cache->size, sizeof (struct cache_entry));
+
+    if (cache->table == (struct cache_entry *) 0 ||
+	(path != (char *) 0 && !cache_load (cache, path)))
+    {
+	cache_close (cache);
+	return (struct result_cache *) 0;
+    }
+
+    return cache;
+}
+
+/*
+ * Finish with a cache, making sure everything is written out.
+ */
+void
+cache_close (struct result_cache *cache)
+{
+    if (cache == (struct result_cache *) 0)
+	return;
+
+    if (cache->store != (FILE *) 0)
+	fclose (cache->store);
+    free (cache->table);
+    free (cache);
+
+    return;
+}
+
+/*
+ * The number of distinct results the cache holds.
+ */
+long
+cache_count (struct result_cache *cache)
+{
+    return cache->count;
+}
+
+/*
+ * Look up one packed stiffness matrix.
+ *
+ * Return value: 1, with result filled in, if it is in the cache; else 0.
+ */
+int
+cache_lookup (struct result_cache *cache, FLT_DBL * ccp, FLT_DBL * result)
+{
+long long       key[21];
+struct cache_entry *entry;
+
+    cache_key (cache, ccp, key);
+    entry = cache_slot (cache, key);
+    if (!entry->used || entry->pending >= 0)
+	return 0;
+
+    memcpy (result, entry->result, cache->nresult * sizeof (FLT_DBL));
+    return 1;
+}
+
+/*
+ * Add the result for one packed stiffness matrix, replacing any already
+ * there.
+ */
+void
+cache_insert (struct result_cache *cache, FLT_DBL * ccp, FLT_DBL * result)
+{
+long long       key[21];
+struct cache_entry *entry;
+
+    cache_key (cache, ccp, key);
+    entry = cache_slot (cache, key);
+    if (!entry->used)
+    {
+	entry = cache_add (cache, key);
+	/* If we are out of memory, simply don't remember it. */
+	if (entry == (struct cache_entry *) 0)
+	    return;
+    }
+    entry->pending = -1;
+    memcpy (entry->result, result, cache->nresult * sizeof (FLT_DBL));
+
+    if (cache->store != (FILE *) 0)
+    {
+	fwrite (key, sizeof (key), 1, cache->store);
+	fwrite (result, sizeof (FLT_DBL), (size_t) cache->nresult,
+		cache->store);
+    }
+
+    return;
+}
+
+/*
+ * Sort a batch of inputs into those whose results are known and those
+ * that must be found.
+ *
+ * On output:
+ *	results holds cache->nresult numbers for each input; those for the
+ *	inputs already in the cache are filled in.
+ *	which[nn] is -1 if input nn was in the cache. Otherwise it is the
+ *	index of the distinct new matrix it is a copy of, and that matrix
+ *	has been copied to position which[nn] of unique.
+ *
+ * Return value: the number of distinct new matrices, or -1 if out of
+ * memory (in which case the cache is unchanged).
+ */
+static int
+cache_sort (struct result_cache *cache, int ncc, FLT_DBL * ccs,
+	    FLT_DBL * results, int *which, FLT_DBL * unique)
+{
+int             nn, nunique;
+long long       key[21];
+struct cache_entry *entry;
+
+    /* Make room first, so that we never have to stop part way. */
+    if (!cache_reserve (cache, ncc))
+	return -1;
+
+    nunique = 0;
+    for (nn = 0; nn < ncc; nn++)
+    {
+	cache_key (cache, ccs + PACKED_SIZE * nn, key);
+	entry = cache_slot (cache, key);
+
+	if (entry->used && entry->pending < 0)
+	{
+	    memcpy (results + cache->nresult * nn, entry->result,
+		    cache->nresult * sizeof (FLT_DBL));
+	    which[nn] = -1;
+	    continue;
+	}
+
+	if (!entry->used)
+	{
+	    entry = cache_add (cache, key);
+	    entry->pending = nunique;
+	    memcpy (unique + PACKED_SIZE * nunique, ccs + PACKED_SIZE * nn,
+		    PACKED_SIZE * sizeof (FLT_DBL));
+	    nunique++;
+	}
+
+	which[nn] = entry->pending;
+    }
+
+    return nunique;
+}
+
+/*
+ * find_ti for many inputs, as find_ti_batch, but using and adding to a
+ * cache made by cache_open with nresult = 3. Each result is the distance,
+ * theta, and phi.
+ *
+ * Return value: the number of distinct searches that had to be done, or -1
+ * if out of memory (in which case nothing was done).
+ */
+int
+find_ti_cached (struct result_cache *cache, int ncc, FLT_DBL * ccs,
+		FLT_DBL * theta_best, FLT_DBL * phi_best,
+		FLT_DBL * dist_best)
+{
+int             nn, nunique;
+int            *which;
+FLT_DBL        *unique, *results, *uresults;
+FLT_DBL         result[3];
+
+    which = (int *) malloc ((ncc + 1) * sizeof (int));
+    unique = (FLT_DBL *) malloc ((PACKED_SIZE * ncc + 1) *
+				 sizeof (FLT_DBL));
+    results = (FLT_DBL *) malloc ((3 * ncc + 1) * sizeof (FLT_DBL));
+    uresults = (FLT_DBL *) malloc ((3 * ncc + 1) * sizeof (FLT_DBL));
+
+    nunique = -1;
+    if (which != (int *) 0 && unique != (FLT_DBL *) 0 &&
+	results != (FLT_DBL *) 0 && uresults != (FLT_DBL *) 0)
+	nunique = cache_sort (cache, ncc, ccs, results, which, unique);
+
+    if (nunique >= 0)
+    {
+	/* Search just the distinct new matrices, all together. */
+	find_ti_batch (nunique, unique, uresults + ncc, uresults + 2 * ncc,
+		       uresults);
+
+	for (nn = 0; nn < nunique; nn++)
+	{
+	    result[0] = uresults[nn];
+	    result[1] = uresults[ncc + nn];
+	    result[2] = uresults[2 * ncc + nn];
+	    cache_insert (cache, unique + PACKED_SIZE * nn, result);
+	}
+
+	/* Hand the answers out. */
+	for (nn = 0; nn < ncc; nn++)
+	{
+	    if (which[nn] < 0)
+	    {
+		dist_best[nn] = results[3 * nn];
+		theta_best[nn] = results[3 * nn + 1];
+		phi_best[nn] = results[3 * nn + 2];
+	    }
+	    else
+	    {
+		dist_best[nn] = uresults[which[nn]];
+		theta_best[nn] = uresults[ncc + which[nn]];
+		phi_best[nn] = uresults[2 * ncc + which[nn]];
+	    }
+	}
+    }
+
+    free (which);
+    free (unique);
+    free (results);
+    free (uresults);
+
+    return nunique;
+}
+
+/*
+ * find_ortho for many inputs, as find_ortho_batch, but using and adding
+ * to a cache made by cache_open with nresult = 10. Each result is the
+ * distance and then the 9 elements of rmat.
+ *
+ * Return value: as for find_ti_cached.
+ */
+int
+find_ortho_cached (struct result_cache *cache, int ncc, FLT_DBL * ccs,
+		   FLT_DBL * rmat, FLT_DBL * dist_best)
+{
+int             nn, nunique;
+int            *which;
+FLT_DBL        *unique, *results, *urmat, *udist;
+FLT_DBL         result[10];
+
+    which = (int *) malloc ((ncc + 1) * sizeof (int));
+    unique = (FLT_DBL *) malloc ((PACKED_SIZE * ncc + 1) *
+				 sizeof (FLT_DBL));
+    results = (FLT_DBL *) malloc ((10 * ncc + 1) * sizeof (FLT_DBL));
+    urmat = (FLT_DBL *) malloc ((9 * ncc + 1) * sizeof (FLT_DBL));
+    udist = (FLT_DBL *) malloc ((ncc + 1) * sizeof (FLT_DBL));
+
+    nunique = -1;
+    if (which != (int *) 0 && unique != (FLT_DBL *) 0 &&
+	results != (FLT_DBL *) 0 && urmat != (FLT_DBL *) 0 &&
+	udist != (FLT_DBL *) 0)
+	nunique = cache_sort (cache, ncc, ccs, results, which, unique);
+
+    if (nunique >= 0)
+    {
+	find_ortho_batch (nunique, unique, urmat, udist);
+
+	for (nn = 0; nn < nunique; nn++)
+	{
+	    result[0] = udist[nn];
+	    memcpy (result + 1, urmat + 9 * nn, 9 * sizeof (FLT_DBL));
+	    cache_insert (cache, unique + PACKED_SIZE * nn, result);
+	}
+
+	for (nn = 0; nn < ncc; nn++)
+	{
+	    if (which[nn] < 0)
+	    {
+		dist_best[nn] = results[10 * nn];
+		memcpy (rmat + 9 * nn, results + 10 * nn + 1,
+			9 * sizeof (FLT_DBL));
+	    }
+	    else
+	    {
+		dist_best[nn] = udist[which[nn]];
+		memcpy (rmat + 9 * nn, urmat + 9 * which[nn],
+			9 * sizeof (FLT_DBL));
+	    }
+	}
+    }
+
+    free (which);
+    free (unique);
+    free (results);
+    free (urmat);
+    free (udist);
+
+    return nunique;
+}
@@ -55,14 +55,6 @@ static int      static_voigtl[6] = {0, 1, 2, 1, 0, 0};
 static int      static_voigtr[6] = {0, 1, 2, 2, 2, 1};
 
 
-void
-rotate_tensor (FLT_DBL * cc2, FLT_DBL * cc1, FLT_DBL * rmat)
-{
-int             ij, kl;
-int             pp, qq, rr, ss;
-int             ii, jj, kk, ll;
-double          temp;
-
 /*
  * How to rotate a tensor:
  *
@@ -70,40 +62,100 @@ double          temp;
  *
  * Where R is a rotation matrix.
  *
+ * Summing over p and q first, the pairs (i,j) and (p,q) only enter
+ * through the 6x6 "Bond matrix"
+ *
+ *	M(IJ,PQ) = Rpi Rqj + Rqi Rpj	(P != Q)
+ *	M(IJ,PP) = Rpi Rpj
+ *
+ * (IJ and PQ in Voigt notation), and the rotation is C' = M C M^T.
+ * That is a few hundred multiplications instead of the several thousand
+ * of the 4-fold sum, and only the upper triangle of C' need be found.
  */
+static void
+bond_matrix (double *bond, FLT_DBL * rmat)
+{
+int             ij, pq;
+int             ii, jj, pp, qq;
 
-
-    /*
-     * ij and kl are in Voigt notation
-     */
     for (ij = 0; ij < 6; ij++)
-	for (kl = 0; kl <= ij; kl++)
+	for (pq = 0; pq < 6; pq++)
 	{
-	    temp = 0.;
-
-	    /* Uncompress ij to ii and jj, kl to kk and ll */
 	    ii = static_voigtl[ij];
 	    jj = static_voigtr[ij];
-	    kk = static_voigtl[kl];
-	    ll = static_voigtr[kl];
-
-	    /*
-	     * Einstein summation over tensor indices p, q, r, s.
-	     */
-	    for (pp = 0; pp < 3; pp++)
-		for (qq = 0; qq < 3; qq++)
-		    for (rr = 0; rr < 3; rr++)
-			for (ss = 0; ss < 3; ss++)
-			{
-			    temp +=
-			     RMAT (pp, ii) *
-			     RMAT (qq, jj) *
-			     RMAT (rr, kk) *
-			     RMAT (ss, ll) * CCT1 (pp, qq, rr, ss);
-			}
-
-	    CC2 (kl, ij) = CC2 (ij, kl) = temp;
+	    pp = static_voigtl[pq];
+	    qq = static_voigtr[pq];
+
+	    bond[pq + 6 * ij] = RMAT (pp, ii) * RMAT (qq, jj);
+	    if (pp != qq)
+		bond[pq + 6 * ij] += RMAT (qq, ii) * RMAT (pp, jj);
 	}
 
     return;
 }
+
+/*
+ * rotate_tensor for packed matrices (see packed_matrix.c), by the typed
+ * kernel for FLT_DBL (see typed_kernels.c). ccp2 may be the same array
+ * as ccp1.
+ */
+void
+rotate_packed (FLT_DBL * ccp2, FLT_DBL * ccp1, FLT_DBL * rmat)
+{
+    FLT_DBL_KERNEL (rotate_packed) (ccp2, ccp1, rmat);
+    return;
+}
+
+/*
+ * Add to the packed matrix ccp2 the rotation by rmat of a sparse change:
+ * delta[n] added to packed element index[n] (and so to both C_IJ and
+ * C_JI), for n from 0 to nn-1. Rotation is linear, so if ccp2 was some C
+ * rotated by rmat, it is now C plus the change rotated by rmat. Each
+ * changed element costs only a few products per element of ccp2, instead
+ * of a full rotate_packed.
+ */
+void
+rotate_packed_sparse (FLT_DBL * ccp2, int nn, int *index, FLT_DBL * delta,
+		      FLT_DBL * rmat)
+{
+int             ij, kl, pq, rs, kk;
+double          bond[6 * 6];
+
+    bond_matrix (bond, rmat);
+
+    for (kk = 0; kk < nn; kk++)
+    {
+	/* Which C_PQ,RS (PQ <= RS) is this? */
+	for (pq = 0; pq < 5 && extern_packed[pq + 1][pq + 1] <= index[kk];
+	     pq++)
+	    ;
+	rs = pq + index[kk] - extern_packed[pq][pq];
+
+	for (ij = 0; ij < 6; ij++)
+	    for (kl = ij; kl < 6; kl++)
+	    {
+		if (pq == rs)
+		    CCP2 (ij, kl) += delta[kk] *
+		     bond[pq + 6 * ij] * bond[pq + 6 * kl];
+		else
+		    CCP2 (ij, kl) += delta[kk] *
+		     (bond[pq + 6 * ij] * bond[rs + 6 * kl] +
+		      bond[rs + 6 * ij] * bond[pq + 6 * kl]);
+	    }
+    }
+
+    return;
+}
+
+void
+rotate_tensor (FLT_DBL * cc2, FLT_DBL * cc1, FLT_DBL * rmat)
+{
+FLT_DBL         ccp1[PACKED_SIZE];
+FLT_DBL         ccp2[PACKED_SIZE];
+
+    pack_matrix_6x6 (ccp1, cc1);
+    rotate_packed (ccp2, ccp1, rmat);
+    unpack_matrix_6x6 (cc2, ccp2);
+
+    return;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+#include "cmat.h"
+
+/*
+ * Fill in the default search options, so that a search run with them
+ * behaves exactly like one run with a null options pointer.
+ * Callers should always start from these, then change what they need.
+ *
+ * Output:
+ *	opts is the search options structure (see cmat.h).
+ */
+
+void
+search_defaults (struct search_opts *opts)
+{
+    opts->scan = (FLT_DBL *) 0;
+
+    opts->domain = SEARCH_ALL;
+    opts->theta = 0.;
+    opts->phi = 0.;
+    opts->max_dev = 0.;
+    opts->theta_min = 0.;
+    opts->theta_max = 360.;
+    opts->phi_min = 0.;
+    opts->phi_max = 90.;
+
+    opts->stop_below = -1.;
+
+    opts->max_evals = 0;
+    opts->max_seconds = 0.;
+
+    opts->warm_inc = 0.;
+
+    opts->nevals = 0;
+    opts->resolution = 0.;
+    opts->converged = 0;
+    opts->axis_dist[0] = opts->axis_dist[1] = opts->axis_dist[2] = -1.;
+    opts->start_time = 0.;
+    opts->spent = 0;
+
+    return;
+}
+
+/*
+ * Elapsed time in seconds, from an arbitrary starting point.
+ */
+static double
+elapsed_seconds (void)
+{
+struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1.e-9 * (double) ts.tv_nsec;
+}
+
+/*
+ * The searches call these to keep track of their budget. All of them
+ * accept a null options pointer, meaning no budget.
+ *
+ * search_start: a search is beginning.
+ */
+void
+search_start (struct search_opts *opts)
+{
+    if (opts == (struct search_opts *) 0)
+	return;
+
+    opts->nevals = 0;
+    opts->resolution = 0.;
+    opts->converged = 0;
+    opts->spent = 0;
+    if (opts->max_seconds > 0.)
+	opts->start_time = elapsed_seconds ();
+
+    return;
+}
+
+/*
+ * search_spend: one more distance evaluation has been made.
+ *
+ * Return value: 1 if the budget is now used up (and stays so for the
+ * rest of the search), else 0.
+ */
+int
+search_spend (struct search_opts *opts)
+{
+    if (opts == (struct search_opts *) 0)
+	return 0;
+
+    opts->nevals++;
+
+    if (opts->max_evals > 0 && opts->nevals >= opts->max_evals)
+	opts->spent = 1;
+    if (opts->max_seconds > 0. &&
+	elapsed_seconds () - opts->start_time >= opts->max_seconds)
+	opts->spent = 1;
+
+    return opts->spent;
+}
+
+/*
+ * search_finish: the search is over, having reached the given angular
+ * resolution (in degrees).
+ */
+void
+search_finish (struct search_opts *opts, FLT_DBL resolution, int converged)
+{
+    if (opts == (struct search_opts *) 0)
+	return;
+
+    opts->resolution = resolution;
+    opts->converged = converged;
+
+    return;
+}
+
+/*
+ * The order to visit the nscan points of an initial scan: point
+ * (ii * stride) % nscan is visited ii'th. Without a budget that is just
+ * the natural order. With one, the stride is about the golden section of
+ * nscan, and shares no factor with it, so every point is still visited
+ * exactly once but any early part of the scan is spread over all of it.
+ */
+int
+search_stride (struct search_opts *opts, int nscan)
+{
+int             stride, aa, bb, temp;
+
+    if (!search_budgeted (opts) || nscan < 3)
+	return 1;
+
+    for (stride = (int) (.618034 * nscan); stride < nscan; stride++)
+    {
+	/* Greatest common divisor */
+	aa = nscan;
+	bb = stride;
+	while (bb != 0)
+	{
+	    temp = aa % bb;
+	    aa = bb;
+	    bb = temp;
+	}
+	if (aa == 1)
+	    return stride;
+    }
+
+    return 1;
+}
+
+/*
+ * Was the search given a budget?
+ */
+int
+search_budgeted (struct search_opts *opts)
+{
+    return opts != (struct search_opts *) 0 &&
+     (opts->max_evals > 0 || opts->max_seconds > 0.);
+}
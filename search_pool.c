@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Searches run in the background by a pool of threads, for programs
+ * (servers, say) with many callers that each want a few answers at a
+ * time.
+ *
+ * pool_open starts the threads once, and every caller then shares them:
+ * however many callers there are, there are never more searches running
+ * than threads, so they don't fight over the processors. pool_submit
+ * hands over one matrix and returns at once with a job; the answer
+ * appears in the caller's result when pool_ready says the job is done,
+ * and pool_wait waits for that and gives the job back. pool_submit_batch
+ * does the same for a whole array of matrices, and its matrices are
+ * spread over all the threads, so a batch finishes sooner than the same
+ * matrices submitted one by one and searched in turn.
+ *
+ * Jobs come from a fixed number made when the pool is opened, and the
+ * matrices and results stay in the caller's memory, so submitting and
+ * waiting allocate nothing. If every job is in use, pool_submit waits
+ * for one to be given back. So a caller mustn't wait in pool_submit
+ * while holding jobs only it will give back: if callers each keep up to
+ * k jobs at once, open the pool with at least k jobs per caller.
+ *
+ * Each matrix is searched by find_ti_result or find_ortho_result (see
+ * find_result.c), with its own copy of the options.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "cmat.h"
+
+struct search_job
+{
+    struct search_job *link;	/* next in the queue, or in the free list */
+    int             symmetry;	/* FIT_TI or FIT_ORTHO */
+    int             want;
+    int             use_opts;	/* was opts given? */
+    struct search_opts opts;
+    int             ncc;
+    FLT_DBL        *cc;		/* ncc 6x6 matrices */
+    void           *res;	/* ncc ti_result or ortho_result */
+    int             nstarted;	/* matrices handed to a thread so far */
+    int             ndone;	/* ... and finished */
+};
+
+struct search_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  work;	/* the queue has something in it */
+    pthread_cond_t  done;	/* some job is finished */
+    pthread_cond_t  freed;	/* some job is free */
+
+    struct search_job *queue;	/* jobs with matrices not yet started */
+    struct search_job *tail;
+    struct search_job *free;
+
+    struct search_job *jobs;
+    int             njobs;
+    pthread_t      *threads;
+    int             nthreads;
+    int             closing;
+};
+
+/*
+ * Search matrix kk of a job.
+ */
+static void
+pool_search (struct search_job *job, int kk)
+{
+struct search_opts opts;
+struct search_opts *optp;
+
+    optp = (struct search_opts *) 0;
+    if (job->use_opts)
+    {
+	opts = job->opts;
+	optp = &opts;
+    }
+
+    if (job->symmetry == FIT_ORTHO)
+	find_ortho_result (job->cc + 36 * kk, optp, job->want,
+			   (struct ortho_result *) job->res + kk);
+    else
+	find_ti_result (job->cc + 36 * kk, optp, job->want,
+			(struct ti_result *) job->res + kk);
+
+    return;
+}
+
+static void    *
+pool_thread (void *arg)
+{
+struct search_pool *pool = (struct search_pool *) arg;
+struct search_job *job;
+int             kk;
+
+    pthread_mutex_lock (&pool->lock);
+    for (;;)
+    {
+	while (pool->queue == (struct search_job *) 0 && !pool->closing)
+	    pthread_cond_wait (&pool->work, &pool->lock);
+	if (pool->queue == (struct search_job *) 0)
+	    break;
+
+	/* Take the next matrix of the oldest job */
+	job = pool->queue;
+	kk = job->nstarted++;
+	if (job->nstarted == job->ncc)
+	{
+	    pool->queue = job->link;
+	    if (pool->queue == (struct search_job *) 0)
+		pool->tail = (struct search_job *) 0;
+	}
+	pthread_mutex_unlock (&pool->lock);
+
+	pool_search (job, kk);
+
+	pthread_mutex_lock (&pool->lock);
+	job->ndone++;
+	if (job->ndone == job->ncc)
+	    pthread_cond_broadcast (&pool->done);
+    }
+    pthread_mutex_unlock (&pool->lock);
+
+    return (void *) 0;
+}
+
+/*
+ * Start a pool.
+ *
+ * Input:
+ *	nthreads is the number of threads to search with, or 0 for one per
+ *	processor.
+ *	njobs is the most jobs that can be submitted and not yet waited for.
+ *
+ * Return value:
+ *	The pool, or a null pointer if it couldn't be started.
+ */
+struct search_pool *
+pool_open (int nthreads, int njobs)
+{
+struct search_pool *pool;
+int             ii;
+
+    if (nthreads <= 0)
+    {
+	nthreads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+	    nthreads = 1;
+    }
+    if (njobs <= 0)
+	return (struct search_pool *) 0;
+
+    pool = (struct search_pool *) malloc (sizeof (struct search_pool));
+    if (pool == (struct search_pool *) 0)
+	return pool;
+    pool->jobs = (struct search_job *) malloc (njobs *
+					       sizeof (struct search_job));
+    pool->threads = (pthread_t *) malloc (nthreads * sizeof (pthread_t));
+    if (pool->jobs == (struct search_job *) 0 ||
+	pool->threads == (pthread_t *) 0)
+    {
+	free (pool->jobs);
+	free (pool->threads);
+	free (pool);
+	return (struct search_pool *) 0;
+    }
+
+    pool->njobs = njobs;
+    for (ii = 0; ii < njobs; ii++)
+	pool->jobs[ii].link = (ii + 1 < njobs) ? pool->jobs + ii + 1 :
+	 (struct search_job *) 0;
+    pool->free = pool->jobs;
+    pool->queue = (struct search_job *) 0;
+    pool->tail = (struct search_job *) 0;
+    pool->closing = 0;
+
+    pthread_mutex_init (&pool->lock, (pthread_mutexattr_t *) 0);
+    pthread_cond_init (&pool->work, (pthread_condattr_t *) 0);
+    pthread_cond_init (&pool->done, (pthread_condattr_t *) 0);
+    pthread_cond_init (&pool->freed, (pthread_condattr_t *) 0);
+
+    for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++)
+	if (pthread_create (pool->threads + pool->nthreads,
+			    (pthread_attr_t *) 0, pool_thread,
+			    (void *) pool) != 0)
+	    break;
+
+    if (pool->nthreads == 0)
+    {
+	pool_close (pool);
+	return (struct search_pool *) 0;
+    }
+
+    return pool;
+}
+
+/*
+ * Finish the searches already submitted, then stop the threads and free
+ * the pool. Jobs not yet waited for are gone: their results are filled
+ * in, but they can no longer be waited for.
+ */
+void
+pool_close (struct search_pool *pool)
+{
+int             ii;
+
+    pthread_mutex_lock (&pool->lock);
+    pool->closing = 1;
+    pthread_cond_broadcast (&pool->work);
+    pthread_mutex_unlock (&pool->lock);
+
+    for (ii = 0; ii < pool->nthreads; ii++)
+	pthread_join (pool->threads[ii], (void **) 0);
+
+    pthread_cond_destroy (&pool->freed);
+    pthread_cond_destroy (&pool->done);
+    pthread_cond_destroy (&pool->work);
+    pthread_mutex_destroy (&pool->lock);
+    free (pool->jobs);
+    free (pool->threads);
+    free (pool);
+
+    return;
+}
+
+/*
+ * Submit ncc matrices, to be searched in the background. This may be
+ * called from any number of threads at once.
+ *
+ * Input:
+ *	symmetry is FIT_TI or FIT_ORTHO.
+ *	cc holds ncc 6x6 stiffness matrices, one after the other.
+ *	opts, if not a null pointer, modifies the searches as for search_ti
+ *	or search_ortho. It is copied, so needn't be kept.
+ *	want is as for find_ti_result.
+ *	res is an array of ncc struct ti_result (for FIT_TI) or struct
+ *	ortho_result (for FIT_ORTHO).
+ *
+ * Output:
+ *	res is filled in by the time the job is done. It, and cc, must be
+ *	left alone until then.
+ *
+ * Return value:
+ *	The job, to pass to pool_ready and pool_wait.
+ */
+struct search_job *
+pool_submit_batch (struct search_pool *pool, int symmetry, int ncc,
+		   FLT_DBL * cc, struct search_opts *opts, int want,
+		   void *res)
+{
+struct search_job *job;
+
+    pthread_mutex_lock (&pool->lock);
+    while (pool->free == (struct search_job *) 0)
+	pthread_cond_wait (&pool->freed, &pool->lock);
+    job = pool->free;
+    pool->free = job->link;
+
+    job->symmetry = symmetry;
+    job->want = want;
+    job->use_opts = (opts != (struct search_opts *) 0);
+    if (job->use_opts)
+	job->opts = *opts;
+    job->ncc = ncc;
+    job->cc = cc;
+    job->res = res;
+    job->nstarted = 0;
+    job->ndone = 0;
+
+    /* An empty job is done already. */
+    if (ncc > 0)
+    {
+	job->link = (struct search_job *) 0;
+	if (pool->tail != (struct search_job *) 0)
+	    pool->tail->link = job;
+	else
+	    pool->queue = job;
+	pool->tail = job;
+	pthread_cond_broadcast (&pool->work);
+    }
+    pthread_mutex_unlock (&pool->lock);
+
+    return job;
+}
+
+/*
+ * Submit a single matrix: as pool_submit_batch, with ncc 1.
+ */
+struct search_job *
+pool_submit (struct search_pool *pool, int symmetry, FLT_DBL * cc,
+	     struct search_opts *opts, int want, void *res)
+{
+    return pool_submit_batch (pool, symmetry, 1, cc, opts, want, res);
+}
+
+/*
+ * Is the job done? (Its results can then be used, but it must still be
+ * given back with pool_wait.)
+ */
+int
+pool_ready (struct search_pool *pool, struct search_job *job)
+{
+int             ready;
+
+    pthread_mutex_lock (&pool->lock);
+    ready = (job->ndone == job->ncc);
+    pthread_mutex_unlock (&pool->lock);
+
+    return ready;
+}
+
+/*
+ * Wait for the job to be done, and give it back to the pool; it can't
+ * be used after this.
+ */
+void
+pool_wait (struct search_pool *pool, struct search_job *job)
+{
+    pthread_mutex_lock (&pool->lock);
+    while (job->ndone < job->ncc)
+	pthread_cond_wait (&pool->done, &pool->lock);
+
+    job->link = pool->free;
+    pool->free = job;
+    pthread_cond_signal (&pool->freed);
+    pthread_mutex_unlock (&pool->lock);
+
+    return;
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Answering requests one after another, for a program that stays running
+ * and keeps what it has built up (the scan tables, a result cache) from
+ * one request to the next, instead of being started afresh for each.
+ *
+ * A request is one stiffness matrix, and the reply is one record of
+ * named numbers, as for a batch run (see write_records.c), worked out by
+ * handler->answer. Requests come in, and replies go out, either
+ *
+ *	OUTPUT_JSON	one request per line, and one JSON object per line
+ *			in reply. A request is the 36 numbers of the matrix
+ *			(21 for READ_UPPER) separated by white space or
+ *			commas, bare, as a JSON array, or as the "cc" member
+ *			of a JSON object: {"cc":[c11,c12,...]}. A request
+ *			that can't be answered (one with a NaN or infinite
+ *			number in it, say) gets {"error":"why"}.
+ *	OUTPUT_BINARY	each request the numbers of the matrix as native
+ *			doubles, each reply its numbers as native doubles.
+ *			A matrix that can't be answered gets NaNs.
+ *
+ * Each reply is flushed as soon as it is written, so a client can wait
+ * for it before sending the next request.
+ *
+ * The requests are read from standard input and the replies written to
+ * standard output, or they come over a Unix-domain socket. Then clients
+ * are served one connection at a time, each until it closes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "cmat.h"
+
+/* The longest request line */
+#define SERVE_LINE_MAX	8192
+
+/* How far apart C_ij and C_ji may be, as for read_matrix_6x6 */
+#define SERVE_ASYM_TOL	1.e-4
+
+/*
+ * Parse a request line into the numbers of a matrix. Return the number
+ * of numbers found, or -1 (with why saying why) if the line is bad.
+ */
+static int
+serve_parse (char *line, double *numbers, int nmax, const char **why)
+{
+char           *cp, *end;
+int             nn;
+
+    cp = line;
+    while (*cp == ' ' || *cp == '\t')
+	cp++;
+
+    /* A JSON object: find its "cc" member. */
+    if (*cp == '{')
+    {
+	cp = strstr (cp, "\"cc\"");
+	if (cp == (char *) 0)
+	{
+	    *why = "no \\\"cc\\\" in the request";
+	    return -1;
+	}
+	cp += 4;
+	while (*cp == ' ' || *cp == '\t' || *cp == ':')
+	    cp++;
+	if (*cp != '[')
+	{
+	    *why = "\\\"cc\\\" is not an array";
+	    return -1;
+	}
+    }
+    if (*cp == '[')
+	cp++;
+
+    for (nn = 0;; nn++)
+    {
+	while (*cp == ' ' || *cp == '\t' || *cp == ',' || *cp == '\r' ||
+	       *cp == '\n')
+	    cp++;
+	if (*cp == '\0' || *cp == ']')
+	    return nn;
+	if (nn == nmax)
+	{
+	    *why = "too many numbers";
+	    return -1;
+	}
+	numbers[nn] = strtod (cp, &end);
+	if (end == cp)
+	{
+	    *why = "not a number";
+	    return -1;
+	}
+	cp = end;
+    }
+}
+
+/*
+ * Make the packed matrix ccp out of the numbers of a request. Return 0,
+ * or -1 (with why saying why) if they don't make a stiffness matrix.
+ */
+static int
+serve_matrix (struct serve_handler *handler, double *numbers, int nn,
+	      FLT_DBL * ccp, const char **why)
+{
+FLT_DBL         cc[6 * 6];
+double          big;
+int             ii, jj, kk;
+
+    if (nn != ((handler->layout == READ_UPPER) ? 21 : 36))
+    {
+	*why = (handler->layout == READ_UPPER) ?
+	 "expected 21 numbers" : "expected 36 numbers";
+	return -1;
+    }
+
+    for (kk = 0; kk < nn; kk++)
+	if (!isfinite (numbers[kk]))
+	{
+	    *why = "not a finite number";
+	    return -1;
+	}
+
+    kk = 0;
+    big = 0.;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = (handler->layout == READ_UPPER) ? ii : 0; jj < 6; jj++)
+	{
+	    CC (ii, jj) = (FLT_DBL) numbers[kk++];
+	    if (handler->layout == READ_UPPER)
+		CC (jj, ii) = CC (ii, jj);
+	    if (fabs (numbers[kk - 1]) > big)
+		big = fabs (numbers[kk - 1]);
+	}
+
+    for (ii = 1; ii < 6; ii++)
+	for (jj = 0; jj < ii; jj++)
+	    if (fabs ((double) CC (ii, jj) - (double) CC (jj, ii)) >
+		SERVE_ASYM_TOL * big)
+	    {
+		*why = "the matrix is not symmetric";
+		return -1;
+	    }
+
+    pack_matrix_6x6 (ccp, cc);
+    return 0;
+}
+
+/*
+ * Write a reply as a JSON object.
+ */
+static void
+serve_json (struct serve_handler *handler, double *values, FILE * out)
+{
+char            buf[64];
+double          value;
+int             ii;
+
+    for (ii = 0; ii < handler->nfield; ii++)
+    {
+	value = values[handler->order[ii]];
+	fprintf (out, "%c\"%s\":", (ii == 0) ? '{' : ',',
+		 handler->names[handler->order[ii]]);
+	/* JSON has no infinities or NaNs. */
+	if (value - value != 0.)
+	    fputs ("null", out);
+	else
+	{
+	    buf[format_double (buf, value)] = '\0';
+	    fputs (buf, out);
+	}
+    }
+    fputs ("}\n", out);
+
+    return;
+}
+
+/*
+ * Answer requests from in until it runs out.
+ */
+static void
+serve_stream (struct serve_handler *handler, int format, FILE * in,
+	      FILE * out)
+{
+char            line[SERVE_LINE_MAX];
+double          numbers[36];
+double         *values;
+FLT_DBL         ccp[PACKED_SIZE];
+const char     *why;
+int             nn, nnum, ii;
+
+    values = handler->values;
+    nnum = (handler->layout == READ_UPPER) ? 21 : 36;
+
+    if (format == OUTPUT_BINARY)
+    {
+	while (fread (numbers, sizeof (double), (size_t) nnum, in) ==
+	       (size_t) nnum)
+	{
+	    if (serve_matrix (handler, numbers, nnum, ccp, &why) < 0 ||
+		handler->answer (handler->data, ccp, values) < 0)
+		for (ii = 0; ii < handler->nfield; ii++)
+		    values[handler->order[ii]] = NAN;
+	    for (ii = 0; ii < handler->nfield; ii++)
+		fwrite (&values[handler->order[ii]], sizeof (double), 1, out);
+	    if (fflush (out) != 0)
+		return;
+	}
+	return;
+    }
+
+    while (fgets (line, SERVE_LINE_MAX, in) != (char *) 0)
+    {
+	if (strchr (line, '\n') == (char *) 0 && !feof (in))
+	{
+	    /* Skip the rest of an overlong line. */
+	    while (fgets (line, SERVE_LINE_MAX, in) != (char *) 0 &&
+		   strchr (line, '\n') == (char *) 0)
+		;
+	    fputs ("{\"error\":\"request is too long\"}\n", out);
+	}
+	else if (strspn (line, " \t\r\n") == strlen (line))
+	    continue;
+	else if ((nn = serve_parse (line, numbers, 36, &why)) < 0 ||
+		 serve_matrix (handler, numbers, nn, ccp, &why) < 0)
+	    fprintf (out, "{\"error\":\"%s\"}\n", why);
+	else if (handler->answer (handler->data, ccp, values) < 0)
+	    fputs ("{\"error\":\"the search failed\"}\n", out);
+	else
+	    serve_json (handler, values, out);
+
+	if (fflush (out) != 0)
+	    return;
+    }
+
+    return;
+}
+
+/*
+ * Serve requests.
+ *
+ * Input:
+ *	handler says how to answer: handler->answer (handler->data, ccp,
+ *	values) fills in values, indexed as handler->names, for the packed
+ *	matrix ccp, and returns 0, or -1 if it can't. Of those the nfield
+ *	given by handler->order are sent back. handler->values is room for
+ *	them all. handler->layout is READ_FULL or READ_UPPER, as for
+ *	read_matrix_layout.
+ *	format is OUTPUT_JSON or OUTPUT_BINARY.
+ *	path is the Unix-domain socket to listen on (replacing anything
+ *	already there), or a null pointer to serve standard input.
+ *
+ * Return value:
+ *	0 when standard input runs out; with a socket, -1 (and a message on
+ *	standard error) if it couldn't be set up, and otherwise it never
+ *	returns.
+ */
+int
+serve_requests (struct serve_handler *handler, int format, const char *path)
+{
+struct sockaddr_un addr;
+int             listener, fd;
+FILE           *in, *out;
+
+    if (path == (const char *) 0)
+    {
+	serve_stream (handler, format, stdin, stdout);
+	return 0;
+    }
+
+    if (strlen (path) >= sizeof (addr.sun_path))
+    {
+	fprintf (stderr, "serve: socket path \"%s\" is too long\n", path);
+	return -1;
+    }
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+
+    listener = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+	perror ("serve: socket");
+	return -1;
+    }
+    unlink (path);
+    if (bind (listener, (struct sockaddr *) &addr, sizeof (addr)) < 0 ||
+	listen (listener, 16) < 0)
+    {
+	perror ("serve: can't listen on the socket");
+	close (listener);
+	return -1;
+    }
+
+    /* A client that goes away mid-reply is not our problem. */
+    signal (SIGPIPE, SIG_IGN);
+
+    for (;;)
+    {
+	fd = accept (listener, (struct sockaddr *) 0, (socklen_t *) 0);
+	if (fd < 0)
+	    continue;
+
+	in = fdopen (fd, "r");
+	out = (in != (FILE *) 0) ? fdopen (dup (fd), "w") : (FILE *) 0;
+	if (out != (FILE *) 0)
+	    serve_stream (handler, format, in, out);
+
+	if (out != (FILE *) 0)
+	    fclose (out);
+	if (in != (FILE *) 0)
+	    fclose (in);
+	else
+	    close (fd);
+    }
+}
@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * find_ti and find_ortho for a whole array of stiffness matrices in the
+ * caller's memory, laid out however the caller has them, with the answers
+ * put straight into the caller's arrays. This is meant to be called from
+ * other languages through the shared library (libcmat.so): a NumPy array
+ * can be passed as it is, its data pointer and strides going into a
+ * struct strided_array (see cmat.h), float or double, C or Fortran order,
+ * or a slice of something bigger.
+ *
+ * Nothing is copied in or out wholesale. Each thread gathers a block of
+ * matrices at a time into its own small buffer, searches them together
+ * (see batch_scan.c), and writes each answer out as soon as it has it.
+ * The blocks are handed out to the threads in turn.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cmat.h"
+
+/* How many matrices a thread takes at a time */
+#define STRIDED_BLOCK	64
+
+struct strided_job
+{
+    int             symmetry;
+    long            ncc;
+    struct strided_array *cc;
+    int             layout;
+    struct search_opts *opts;
+    int             batched;	/* can the scans be shared? */
+    int             want;
+    struct strided_results *res;
+
+    pthread_mutex_t lock;
+    long            next;	/* the first matrix not yet handed out */
+};
+
+/*
+ * Element [i0][i1][i2] of an array.
+ */
+static char    *
+strided_at (struct strided_array *arr, long i0, long i1, long i2)
+{
+    return (char *) arr->data + i0 * arr->stride[0] + i1 * arr->stride[1] +
+     i2 * arr->stride[2];
+}
+
+static FLT_DBL
+strided_get (struct strided_array *arr, long i0, long i1, long i2)
+{
+float           fvalue;
+double          dvalue;
+
+    if (arr->type == ARRAY_FLOAT)
+    {
+	memcpy (&fvalue, strided_at (arr, i0, i1, i2), sizeof (float));
+	return (FLT_DBL) fvalue;
+    }
+    memcpy (&dvalue, strided_at (arr, i0, i1, i2), sizeof (double));
+    return (FLT_DBL) dvalue;
+}
+
+/*
+ * Set element [i0][i1][i2] of an array, if the caller wants the array
+ * at all.
+ */
+static void
+strided_put (struct strided_array *arr, long i0, long i1, long i2,
+	     FLT_DBL value)
+{
+float           fvalue;
+double          dvalue;
+
+    if (arr->data == (void *) 0)
+	return;
+
+    if (arr->type == ARRAY_FLOAT)
+    {
+	fvalue = (float) value;
+	memcpy (strided_at (arr, i0, i1, i2), &fvalue, sizeof (float));
+    }
+    else
+    {
+	dvalue = (double) value;
+	memcpy (strided_at (arr, i0, i1, i2), &dvalue, sizeof (double));
+    }
+
+    return;
+}
+
+/*
+ * Read matrix nn in, packed.
+ */
+static void
+strided_gather (struct strided_job *job, long nn, FLT_DBL * ccp)
+{
+int             ii, jj, kk;
+
+    if (job->layout == READ_UPPER)
+    {
+	for (kk = 0; kk < PACKED_SIZE; kk++)
+	    ccp[kk] = strided_get (job->cc, nn, kk, 0);
+	return;
+    }
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	    ccp[kk++] = strided_get (job->cc, nn, ii, jj);
+
+    return;
+}
+
+/*
+ * Write the answers for TI matrix nn out.
+ */
+static void
+strided_scatter_ti (struct strided_job *job, long nn, struct ti_result *tr)
+{
+struct strided_results *res = job->res;
+int             ii, jj;
+
+    strided_put (&res->dist, nn, 0, 0, tr->dist);
+    strided_put (&res->norm, nn, 0, 0, tr->norm);
+    for (ii = 0; ii < 3; ii++)
+	strided_put (&res->axis, nn, ii, 0, tr->axis[ii]);
+    strided_put (&res->angles, nn, 0, 0, tr->theta);
+    strided_put (&res->angles, nn, 1, 0, tr->phi);
+    for (ii = 0; ii < 3; ii++)
+	for (jj = 0; jj < 3; jj++)
+	    strided_put (&res->rmat, nn, ii, jj, tr->rmat[jj + 3 * ii]);
+    if (res->approx.data != (void *) 0)
+	for (ii = 0; ii < 6; ii++)
+	    for (jj = 0; jj < 6; jj++)
+		strided_put (&res->approx, nn, ii, jj,
+			     tr->ccorig[jj + 6 * ii]);
+
+    return;
+}
+
+/*
+ * Write the answers for Orthorhombic matrix nn out.
+ */
+static void
+strided_scatter_ortho (struct strided_job *job, long nn,
+		       struct ortho_result *orr)
+{
+struct strided_results *res = job->res;
+int             ii, jj;
+
+    strided_put (&res->dist, nn, 0, 0, orr->dist);
+    strided_put (&res->norm, nn, 0, 0, orr->norm);
+    for (ii = 0; ii < 3; ii++)
+    {
+	for (jj = 0; jj < 3; jj++)
+	    strided_put (&res->axis, nn, ii, jj, orr->axis[ii][jj]);
+	strided_put (&res->angles, nn, ii, 0, orr->theta[ii]);
+	strided_put (&res->angles, nn, ii, 1, orr->phi[ii]);
+    }
+    for (ii = 0; ii < 3; ii++)
+	for (jj = 0; jj < 3; jj++)
+	    strided_put (&res->rmat, nn, ii, jj, orr->rmat[jj + 3 * ii]);
+    if (res->approx.data != (void *) 0)
+	for (ii = 0; ii < 6; ii++)
+	    for (jj = 0; jj < 6; jj++)
+		strided_put (&res->approx, nn, ii, jj,
+			     orr->ccorig[jj + 6 * ii]);
+
+    return;
+}
+
+/*
+ * Search matrices first to first+ncc-1.
+ */
+static void
+strided_block (struct strided_job *job, long first, int ncc)
+{
+int             nn;
+struct search_opts opts;
+struct ti_result tr;
+struct ortho_result orr;
+FLT_DBL         ccs[PACKED_SIZE * STRIDED_BLOCK];
+FLT_DBL         cc[6 * 6];
+FLT_DBL         theta[STRIDED_BLOCK];
+FLT_DBL         phi[STRIDED_BLOCK];
+FLT_DBL         rmat[9 * STRIDED_BLOCK];
+FLT_DBL         dist[STRIDED_BLOCK];
+FLT_DBL         axis_dist[3 * STRIDED_BLOCK];
+
+    for (nn = 0; nn < ncc; nn++)
+	strided_gather (job, first + nn, ccs + PACKED_SIZE * nn);
+
+    /* As in titest and orthotest's --batch */
+    if (job->batched)
+    {
+	if (job->symmetry == FIT_ORTHO)
+	    find_ortho_batch (ncc, ccs, rmat, dist);
+	else
+	    find_ti_batch (ncc, ccs, theta, phi, dist);
+    }
+    else
+	for (nn = 0; nn < ncc; nn++)
+	{
+	    opts = *job->opts;
+	    if (job->symmetry == FIT_ORTHO)
+	    {
+		dist[nn] = search_ortho (rotated_ortho_distance,
+					 rotated_ti_distance,
+					 (void *) (ccs + PACKED_SIZE * nn),
+					 &opts, rmat + 9 * nn);
+		memcpy (axis_dist + 3 * nn, opts.axis_dist,
+			3 * sizeof (FLT_DBL));
+	    }
+	    else
+		dist[nn] = search_ti (rotated_ti_distance,
+				      (void *) (ccs + PACKED_SIZE * nn),
+				      &opts, theta + nn, phi + nn);
+	}
+
+    for (nn = 0; nn < ncc; nn++)
+    {
+	unpack_matrix_6x6 (cc, ccs + PACKED_SIZE * nn);
+	if (job->symmetry == FIT_ORTHO)
+	{
+	    ortho_result_at (cc, rmat + 9 * nn, dist[nn],
+			     job->batched ? (FLT_DBL *) 0 : axis_dist + 3 * nn,
+			     job->want, &orr);
+	    strided_scatter_ortho (job, first + nn, &orr);
+	}
+	else
+	{
+	    ti_result_at (cc, theta[nn], phi[nn], dist[nn], job->want, &tr);
+	    strided_scatter_ti (job, first + nn, &tr);
+	}
+    }
+
+    return;
+}
+
+static void    *
+strided_thread (void *arg)
+{
+struct strided_job *job = (struct strided_job *) arg;
+long            first;
+
+    for (;;)
+    {
+	pthread_mutex_lock (&job->lock);
+	first = job->next;
+	job->next += STRIDED_BLOCK;
+	pthread_mutex_unlock (&job->lock);
+
+	if (first >= job->ncc)
+	    break;
+	strided_block (job, first,
+		       (job->ncc - first < STRIDED_BLOCK) ?
+		       (int) (job->ncc - first) : STRIDED_BLOCK);
+    }
+
+    return (void *) 0;
+}
+
+/*
+ * Input:
+ *	symmetry is FIT_TI or FIT_ORTHO.
+ *	cc is the ncc stiffness matrices: cc[n][i][j] is C_ij of matrix n
+ *	(in "C" Voigt notation, 0 to 5) for layout READ_FULL; for
+ *	READ_UPPER cc[n][k] are the 21 elements on and above the diagonal
+ *	row by row, C_00 C_01 ... C_05 C_11 ... C_55.
+ *	opts, if not a null pointer, modifies every search as for search_ti
+ *	or search_ortho. A warm start (opts->warm_inc) is not allowed, as
+ *	there is no way to pass in the orientations to start from.
+ *	nthreads is the most threads to search with, or 0 for one per
+ *	processor.
+ *
+ * Output:
+ *	Those members of res whose data isn't a null pointer are filled in,
+ *	for each matrix n:
+ *	dist[n]		the distance from symmetry (as from find_ti);
+ *	norm[n]		the norm of the matrix;
+ *	axis[n][i]	for TI, the symmetry axis; for Orthorhombic,
+ *	axis[n][k][i]	the principal axes, k = 0 for X, 1 for Y, 2 for Z;
+ *	angles[n][0]	for TI, theta and phi (in degrees, as for find_ti);
+ *	angles[n][1]
+ *	angles[n][k][0]	for Orthorhombic, theta and phi of axis k;
+ *	angles[n][k][1]
+ *	rmat[n][i][j]	the rotation to canonical orientation;
+ *	approx[n][i][j]	the nearest symmetric medium, in the original
+ *			coordinates.
+ *
+ * Return value:
+ *	0, or -1 if symmetry, layout, an array's type, or opts is not valid.
+ */
+int
+find_strided (int symmetry, long ncc, struct strided_array *cc, int layout,
+	      struct search_opts *opts, int nthreads,
+	      struct strided_results *res)
+{
+struct strided_job job;
+struct strided_array *outs[6];
+pthread_t      *threads;
+int             ii, nstarted;
+
+    outs[0] = &res->dist;
+    outs[1] = &res->norm;
+    outs[2] = &res->axis;
+    outs[3] = &res->angles;
+    outs[4] = &res->rmat;
+    outs[5] = &res->approx;
+
+    if ((symmetry != FIT_TI && symmetry != FIT_ORTHO) ||
+	(layout != READ_FULL && layout != READ_UPPER) ||
+	(cc->type != ARRAY_FLOAT && cc->type != ARRAY_DOUBLE) ||
+	(opts != (struct search_opts *) 0 && opts->warm_inc > 0.))
+	return -1;
+    for (ii = 0; ii < 6; ii++)
+	if (outs[ii]->data != (void *) 0 &&
+	    outs[ii]->type != ARRAY_FLOAT && outs[ii]->type != ARRAY_DOUBLE)
+	    return -1;
+
+    job.symmetry = symmetry;
+    job.ncc = ncc;
+    job.cc = cc;
+    job.layout = layout;
+    job.opts = opts;
+    job.batched = (opts == (struct search_opts *) 0 ||
+		   (opts->domain == SEARCH_ALL && opts->max_evals <= 0 &&
+		    opts->max_seconds <= 0. && opts->stop_below < 0. &&
+		    opts->warm_inc <= 0.));
+    job.want = (res->approx.data != (void *) 0) ? RESULT_APPROX_ORIG : 0;
+    job.res = res;
+    job.next = 0;
+
+    if (nthreads <= 0)
+	nthreads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+    if ((long) nthreads > (ncc + STRIDED_BLOCK - 1) / STRIDED_BLOCK)
+	nthreads = (int) ((ncc + STRIDED_BLOCK - 1) / STRIDED_BLOCK);
+
+    pthread_mutex_init (&job.lock, (pthread_mutexattr_t *) 0);
+
+    /*
+     * The calling thread searches too, so start one thread fewer. Build
+     * the scan tables first, so the threads don't race to.
+     */
+    nstarted = 0;
+    threads = (pthread_t *) 0;
+    if (nthreads > 1)
+    {
+	if (job.batched)
+	{
+	    if (symmetry == FIT_ORTHO)
+		batch_scan_ortho (0, (FLT_DBL *) 0, (FLT_DBL *) 0);
+	    else
+		batch_scan_ti (0, (FLT_DBL *) 0, (FLT_DBL *) 0);
+	}
+	threads = (pthread_t *) malloc ((nthreads - 1) * sizeof (pthread_t));
+	if (threads != (pthread_t *) 0)
+	    for (nstarted = 0; nstarted < nthreads - 1; nstarted++)
+		if (pthread_create (threads + nstarted, (pthread_attr_t *) 0,
+				    strided_thread, (void *) &job) != 0)
+		    break;
+    }
+
+    strided_thread ((void *) &job);
+
+    for (ii = 0; ii < nstarted; ii++)
+	pthread_join (threads[ii], (void **) 0);
+    free (threads);
+    pthread_mutex_destroy (&job.lock);
+
+    return 0;
+}
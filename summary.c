@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Summaries of a batch run, kept up as the answers come in, for when
+ * what's wanted is how the distances from symmetry and the symmetry axes
+ * are distributed, not the answer for every matrix.
+ *
+ * For the distances (in percent) there is
+ *	a histogram, SUMMARY_PER_DECADE bins to a factor of ten;
+ *	a sketch good for any quantile to within SUMMARY_ACCURACY of its
+ *	value: the count in each of many much finer bins, also equally
+ *	spaced in the logarithm. (A quantile is then the middle of the bin
+ *	it falls in.)
+ * For the axes (for Orthorhombic, one chosen principal axis), each taken
+ * as pointing to positive Z since which way an axis points means nothing,
+ * there is
+ *	their density: how many fall in each bin of SUMMARY_NAZIM azimuths
+ *	(theta) by SUMMARY_NDIP angles from vertical (phi).
+ * And then for each zone, the matrices taken zone_size at a time in the
+ * order they come in (for example one horizontal slice of a volume),
+ * there is
+ *	the mean distance,
+ *	the mean axis: the direction the axes most nearly all share, the
+ *	main eigenvector of the sum of their outer products, with how well
+ *	they share it (1 if they are all the same);
+ *	a rose: how many axes fall in each azimuth bin.
+ *
+ * Everything is counts, and sums in the order the matrices were added,
+ * so a summary doesn't depend on how the matrices were searched. Parts
+ * summarized separately (by different threads, say) merge into the same
+ * counts however they are merged, and into the same sums too if merged
+ * in the same order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "cmat.h"
+
+/* The relative accuracy of quantiles */
+#define SUMMARY_ACCURACY	.01
+
+/*
+ * The sketch's bins: distances below SUMMARY_TINY percent count as 0;
+ * bin SUMMARY_OFFSET + kk holds those up to gamma^kk, gamma the ratio
+ * between bins.
+ */
+#define SUMMARY_TINY	1.e-6
+#define SUMMARY_OFFSET	700
+#define SUMMARY_NSKETCH	1000
+
+/* The histogram runs from 10^SUMMARY_LOW_DECADE percent to 100 percent */
+#define SUMMARY_PER_DECADE	5
+#define SUMMARY_LOW_DECADE	-4
+#define SUMMARY_NHIST	(SUMMARY_PER_DECADE * (2 - SUMMARY_LOW_DECADE) + 1)
+
+/* The orientation bins, in degrees */
+#define SUMMARY_NAZIM	18
+#define SUMMARY_NDIP	6
+
+/* The quantiles printed */
+#define SUMMARY_NQUANT	7
+
+struct zone_summary
+{
+    long            nn;
+    double          dist_sum;
+    double          outer[6];	/* xx, yy, zz, xy, xz, yz */
+    long            rose[SUMMARY_NAZIM];
+};
+
+struct run_summary
+{
+    long            nn;
+    double          dist_sum;
+    double          dist_min, dist_max;
+    long            sketch[SUMMARY_NSKETCH];
+    long            hist[SUMMARY_NHIST];
+    long            density[SUMMARY_NDIP][SUMMARY_NAZIM];
+
+    long            zone_size;	/* 0 for one zone */
+    long            nzone;
+    long            nalloc;
+    struct zone_summary *zones;
+};
+
+/*
+ * Start a summary, with zone_size matrices to a zone, or 0 for just one
+ * zone. Return it, or a null pointer if there isn't room.
+ */
+struct run_summary *
+summary_open (long zone_size)
+{
+struct run_summary *sum;
+
+    sum = (struct run_summary *) calloc (1, sizeof (struct run_summary));
+    if (sum == (struct run_summary *) 0)
+	return sum;
+    sum->zone_size = (zone_size > 0) ? zone_size : 0;
+
+    return sum;
+}
+
+void
+summary_close (struct run_summary *sum)
+{
+    free (sum->zones);
+    free (sum);
+
+    return;
+}
+
+/*
+ * Zone kk, making room for it if it's new. Return a null pointer if
+ * there isn't room.
+ */
+static struct zone_summary *
+summary_zone (struct run_summary *sum, long kk)
+{
+struct zone_summary *zones;
+long            nalloc;
+int             ii;
+
+    if (kk >= sum->nalloc)
+    {
+	nalloc = (sum->nalloc > 0) ? 2 * sum->nalloc : 16;
+	while (nalloc <= kk)
+	    nalloc *= 2;
+	zones = (struct zone_summary *) realloc (sum->zones, nalloc *
+						 sizeof (struct zone_summary));
+	if (zones == (struct zone_summary *) 0)
+	    return zones;
+	sum->zones = zones;
+	sum->nalloc = nalloc;
+    }
+
+    for (; sum->nzone <= kk; sum->nzone++)
+    {
+	zones = sum->zones + sum->nzone;
+	zones->nn = 0;
+	zones->dist_sum = 0.;
+	for (ii = 0; ii < 6; ii++)
+	    zones->outer[ii] = 0.;
+	for (ii = 0; ii < SUMMARY_NAZIM; ii++)
+	    zones->rose[ii] = 0;
+    }
+
+    return sum->zones + kk;
+}
+
+/*
+ * Which sketch bin a distance falls in
+ */
+static int
+sketch_bin (double percent)
+{
+double          kk;
+
+    if (!(percent >= SUMMARY_TINY))
+	return 0;
+    kk = ceil (log (percent) /
+	       log ((1. + SUMMARY_ACCURACY) / (1. - SUMMARY_ACCURACY)));
+    if (kk + SUMMARY_OFFSET < 1.)
+	return 1;
+    if (kk + SUMMARY_OFFSET > SUMMARY_NSKETCH - 1.)
+	return SUMMARY_NSKETCH - 1;
+    return (int) kk + SUMMARY_OFFSET;
+}
+
+/*
+ * Add matrix index (counting from 0 at the start of the run) to the
+ * summary: its percent distance from symmetry, and its axis (a unit
+ * vector). Return 0, or -1 if there isn't room for a new zone.
+ */
+int
+summary_add (struct run_summary *sum, long index, FLT_DBL percent,
+	     FLT_DBL * axis)
+{
+struct zone_summary *zone;
+FLT_DBL         vv[3];
+FLT_DBL         phi, theta;
+int             ii, kk;
+
+    zone = summary_zone (sum, (sum->zone_size > 0) ?
+			 index / sum->zone_size : 0);
+    if (zone == (struct zone_summary *) 0)
+	return -1;
+
+    if (sum->nn == 0 || percent < sum->dist_min)
+	sum->dist_min = percent;
+    if (sum->nn == 0 || percent > sum->dist_max)
+	sum->dist_max = percent;
+    sum->nn++;
+    sum->dist_sum += percent;
+    sum->sketch[sketch_bin (percent)]++;
+
+    kk = (percent > 0.) ? (int) floor (SUMMARY_PER_DECADE *
+				       (log10 (percent) - SUMMARY_LOW_DECADE))
+     + 1 : 0;
+    if (kk < 0)
+	kk = 0;
+    if (kk > SUMMARY_NHIST - 1)
+	kk = SUMMARY_NHIST - 1;
+    sum->hist[kk]++;
+
+    /* Toward positive Z */
+    for (ii = 0; ii < 3; ii++)
+	vv[ii] = (axis[2] < 0.) ? -axis[ii] : axis[ii];
+    vector_to_angles (vv, &phi, &theta);
+    if (theta < 0.)
+	theta += 360.;
+    ii = (int) (phi / (90. / SUMMARY_NDIP));
+    kk = (int) (theta / (360. / SUMMARY_NAZIM));
+    if (ii > SUMMARY_NDIP - 1)
+	ii = SUMMARY_NDIP - 1;
+    if (kk > SUMMARY_NAZIM - 1)
+	kk = SUMMARY_NAZIM - 1;
+    sum->density[ii][kk]++;
+
+    zone->nn++;
+    zone->dist_sum += percent;
+    zone->outer[0] += vv[0] * vv[0];
+    zone->outer[1] += vv[1] * vv[1];
+    zone->outer[2] += vv[2] * vv[2];
+    zone->outer[3] += vv[0] * vv[1];
+    zone->outer[4] += vv[0] * vv[2];
+    zone->outer[5] += vv[1] * vv[2];
+    zone->rose[kk]++;
+
+    return 0;
+}
+
+/*
+ * Add the summary part into sum. Both must have the same zone_size, and
+ * matrix indexes counted from the same start. Return 0, or -1 if there
+ * isn't room.
+ */
+int
+summary_merge (struct run_summary *sum, struct run_summary *part)
+{
+struct zone_summary *zone;
+long            kk;
+int             ii, jj;
+
+    if (part->nn == 0)
+	return 0;
+    if (part->nzone > 0 && summary_zone (sum, part->nzone - 1) ==
+	(struct zone_summary *) 0)
+	return -1;
+
+    if (sum->nn == 0 || part->dist_min < sum->dist_min)
+	sum->dist_min = part->dist_min;
+    if (sum->nn == 0 || part->dist_max > sum->dist_max)
+	sum->dist_max = part->dist_max;
+    sum->nn += part->nn;
+    sum->dist_sum += part->dist_sum;
+    for (ii = 0; ii < SUMMARY_NSKETCH; ii++)
+	sum->sketch[ii] += part->sketch[ii];
+    for (ii = 0; ii < SUMMARY_NHIST; ii++)
+	sum->hist[ii] += part->hist[ii];
+    for (ii = 0; ii < SUMMARY_NDIP; ii++)
+	for (jj = 0; jj < SUMMARY_NAZIM; jj++)
+	    sum->density[ii][jj] += part->density[ii][jj];
+
+    for (kk = 0; kk < part->nzone; kk++)
+    {
+	zone = sum->zones + kk;
+	zone->nn += part->zones[kk].nn;
+	zone->dist_sum += part->zones[kk].dist_sum;
+	for (ii = 0; ii < 6; ii++)
+	    zone->outer[ii] += part->zones[kk].outer[ii];
+	for (ii = 0; ii < SUMMARY_NAZIM; ii++)
+	    zone->rose[ii] += part->zones[kk].rose[ii];
+    }
+
+    return 0;
+}
+
+/*
+ * The quantile qq (0 to 1) of the distances, in percent. It is never
+ * outside the range of the distances themselves, however wide the bin it
+ * falls in.
+ */
+FLT_DBL
+summary_quantile (struct run_summary *sum, double qq)
+{
+double          gamma, value;
+long            rank, count;
+int             ii;
+
+    if (sum->nn == 0)
+	return 0.;
+    rank = (long) floor (qq * (sum->nn - 1) + .5);
+    if (rank < 0)
+	rank = 0;
+
+    count = 0;
+    for (ii = 0; ii < SUMMARY_NSKETCH - 1; ii++)
+    {
+	count += sum->sketch[ii];
+	if (count > rank)
+	    break;
+    }
+    if (ii == 0)
+	value = 0.;
+    else
+    {
+	/* The middle of the bin, relatively, so within the accuracy. */
+	gamma = (1. + SUMMARY_ACCURACY) / (1. - SUMMARY_ACCURACY);
+	value = 2. * pow (gamma, (double) (ii - SUMMARY_OFFSET)) / (gamma + 1.);
+    }
+
+    if (value < sum->dist_min)
+	value = sum->dist_min;
+    if (value > sum->dist_max)
+	value = sum->dist_max;
+    return value;
+}
+
+/*
+ * The mean axis of a zone, and how closely the axes share it.
+ */
+static double
+zone_axis (struct zone_summary *zone, FLT_DBL * axis)
+{
+double          aa[9], evals[3], evecs[9];
+int             ii, kk;
+
+    aa[0] = zone->outer[0];
+    aa[4] = zone->outer[1];
+    aa[8] = zone->outer[2];
+    aa[1] = aa[3] = zone->outer[3];
+    aa[2] = aa[6] = zone->outer[4];
+    aa[5] = aa[7] = zone->outer[5];
+    jacobi_eigen (3, aa, evals, evecs);
+
+    kk = 0;
+    for (ii = 1; ii < 3; ii++)
+	if (evals[ii] > evals[kk])
+	    kk = ii;
+    for (ii = 0; ii < 3; ii++)
+	axis[ii] = (evecs[2 + 3 * kk] < 0.) ? -evecs[ii + 3 * kk] :
+	 evecs[ii + 3 * kk];
+
+    return evals[kk] / zone->nn;
+}
+
+/*
+ * Write out the summary. what names the symmetry ("TI") and which axis
+ * was summarized.
+ */
+void
+summary_print (struct run_summary *sum, const char *what, const char *axis)
+{
+static const double quant[SUMMARY_NQUANT] = {
+    .01, .05, .25, .5, .75, .95, .99
+};
+FLT_DBL         vec[3], phi, theta;
+double          share;
+long            kk;
+int             ii, jj, first, last;
+
+    printf ("Summary of %ld matrices:\n", sum->nn);
+    if (sum->nn == 0)
+	return;
+
+    printf ("Distance from %s, percent: mean %.3f, min %.3f, max %.3f\n",
+	    what, sum->dist_sum / sum->nn, sum->dist_min, sum->dist_max);
+    printf ("Quantiles:");
+    for (ii = 0; ii < SUMMARY_NQUANT; ii++)
+	printf ("  %g%% %.3f", 100. * quant[ii],
+		summary_quantile (sum, quant[ii]));
+    printf ("\n\n");
+
+    printf ("Histogram of the distance from %s, percent:\n", what);
+    for (first = 0; sum->hist[first] == 0; first++)
+	;
+    for (last = SUMMARY_NHIST - 1; sum->hist[last] == 0; last--)
+	;
+    for (ii = first; ii <= last; ii++)
+    {
+	if (ii == 0)
+	    printf ("%10s  %-10.3g", "", pow (10., SUMMARY_LOW_DECADE));
+	else
+	    printf ("%10.3g  %-10.3g",
+		    pow (10., SUMMARY_LOW_DECADE +
+			 (ii - 1.) / SUMMARY_PER_DECADE),
+		    pow (10., SUMMARY_LOW_DECADE +
+			 (double) ii / SUMMARY_PER_DECADE));
+	printf (" %ld\n", sum->hist[ii]);
+    }
+    printf ("\n");
+
+    printf ("Density of the %s: phi (rows, %g degrees each) by theta "
+	    "(columns, %g degrees each):\n", axis,
+	    90. / SUMMARY_NDIP, 360. / SUMMARY_NAZIM);
+    for (ii = 0; ii < SUMMARY_NDIP; ii++)
+    {
+	printf ("%3g:", ii * 90. / SUMMARY_NDIP);
+	for (jj = 0; jj < SUMMARY_NAZIM; jj++)
+	    printf (" %ld", sum->density[ii][jj]);
+	printf ("\n");
+    }
+
+    for (kk = 0; kk < sum->nzone; kk++)
+    {
+	if (sum->zones[kk].nn == 0)
+	    continue;
+	printf ("\n");
+	if (sum->zone_size > 0)
+	    printf ("Zone %ld (matrices %ld to %ld):\n", kk + 1,
+		    kk * sum->zone_size + 1,
+		    kk * sum->zone_size + sum->zones[kk].nn);
+	else
+	    printf ("All matrices:\n");
+	share = zone_axis (sum->zones + kk, vec);
+	vector_to_angles (vec, &phi, &theta);
+	printf ("Mean distance from %s = %.3f percent\n", what,
+		sum->zones[kk].dist_sum / sum->zones[kk].nn);
+	printf ("Mean %s: (%.4f, %.4f, %.4f)  theta = %.3f, phi = %.3f,  "
+		"shared %.4f\n", axis, vec[0], vec[1], vec[2], theta, phi,
+		share);
+	printf ("Rose (theta, %g degrees each):", 360. / SUMMARY_NAZIM);
+	for (jj = 0; jj < SUMMARY_NAZIM; jj++)
+	    printf (" %ld", sum->zones[kk].rose[jj]);
+	printf ("\n");
+    }
+
+    return;
+}
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Telemetry for a batch run: how fast it is going, how long each stage
+ * (see STAGE_PARSE etc. in cmat.h) takes, and how busy each thread is.
+ *
+ * The stages report spans of work as they finish them (telemetry_span),
+ * from whatever thread they run in: reading in a chunk of matrices, the
+ * batched scan or the refinement of a block of them, writing a chunk
+ * out. The lengths of the spans go into a histogram for each stage, with
+ * bins that are evenly spaced within each power of two, so that however
+ * long or short a span is, it is binned to within 1% (as HdrHistogram
+ * does). A span is a few dozen matrices or more, so taking a lock for
+ * each costs nothing that can be seen.
+ *
+ * Every so often the writer reports progress on standard error
+ * (telemetry_progress), and at the end the quantiles of each stage's
+ * spans (telemetry_report). Each span can also be written to a trace file
+ * in the Chrome trace event format, which chrome://tracing and Perfetto
+ * show as a timeline with a row for each thread.
+ *
+ * The stages only look at the clock when given telemetry, so a run
+ * without any costs nothing.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "cmat.h"
+
+/*
+ * The histogram bins: spans are binned in nanoseconds, the first
+ * 2^TELEMETRY_SUB_BITS one nanosecond wide, then that many to each power
+ * of two, up to 2^TELEMETRY_MAX_BITS nanoseconds (over an hour).
+ */
+#define TELEMETRY_SUB_BITS	7
+#define TELEMETRY_MAX_BITS	42
+#define TELEMETRY_NBIN	((TELEMETRY_MAX_BITS - TELEMETRY_SUB_BITS + 1) << \
+			 TELEMETRY_SUB_BITS)
+
+/* The most threads told apart; any more are counted with the last. */
+#define TELEMETRY_THREADS	64
+
+/* The quantiles telemetry_report gives */
+#define TELEMETRY_NQUANT	4
+
+static const char *stage_names[N_STAGES] = {
+    "parse", "scan", "refine", "output"
+};
+
+struct telemetry
+{
+    pthread_mutex_t lock;
+    const char     *name;	/* the program, to start lines with */
+    double          start;	/* when the run started */
+
+    /* Progress */
+    double          interval;
+    double          last_time;
+    long            last_done;
+
+    /* The stages */
+    long            hist[N_STAGES][TELEMETRY_NBIN];
+    long            nspan[N_STAGES];
+    long            nitems[N_STAGES];
+    double          total[N_STAGES];
+    double          longest[N_STAGES];
+
+    /*
+     * The threads, in the order they first reported a span: how long
+     * each has been busy, and which stages it has run (one bit each)
+     */
+    int             nthread;
+    pthread_t       threads[TELEMETRY_THREADS];
+    double          busy[TELEMETRY_THREADS];
+    int             ran[TELEMETRY_THREADS];
+
+    FILE           *trace;
+    long            ntrace;
+};
+
+/*
+ * Elapsed time in seconds, from an arbitrary starting point.
+ */
+double
+telemetry_clock (void)
+{
+struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1.e-9 * (double) ts.tv_nsec;
+}
+
+/*
+ * The histogram bin for a span of seconds, and the middle of a bin.
+ */
+static int
+telemetry_bin (double seconds)
+{
+long            ns;
+int             shift;
+
+    ns = (long) (1.e9 * seconds);
+    if (ns < 0)
+	ns = 0;
+    if (ns >= (1L << TELEMETRY_MAX_BITS))
+	ns = (1L << TELEMETRY_MAX_BITS) - 1;
+
+    for (shift = 0; (ns >> shift) >= (1L << (TELEMETRY_SUB_BITS + 1));
+	 shift++)
+	;
+
+    return (shift << TELEMETRY_SUB_BITS) + (int) (ns >> shift);
+}
+
+static double
+telemetry_bin_middle (int bin)
+{
+int             shift;
+long            low;
+
+    if (bin < (2 << TELEMETRY_SUB_BITS))
+	return 1.e-9 * bin;
+
+    shift = (bin >> TELEMETRY_SUB_BITS) - 1;
+    low = (long) (bin - (shift << TELEMETRY_SUB_BITS)) << shift;
+    return 1.e-9 * ((double) low + .5 * (double) (1L << shift));
+}
+
+/*
+ * Input:
+ *	name is the program's name, to start the lines written with.
+ *	interval is how often, in seconds, telemetry_progress reports
+ *	progress, or 0 for never.
+ *	trace_path, if not a null pointer, is a file to write a trace of
+ *	every span to.
+ *
+ * Return value:
+ *	The telemetry, or a null pointer (after saying why on standard
+ *	error) if it couldn't be started.
+ */
+struct telemetry *
+telemetry_open (const char *name, double interval, const char *trace_path)
+{
+struct telemetry *tel;
+
+    tel = (struct telemetry *) calloc (1, sizeof (struct telemetry));
+    if (tel == (struct telemetry *) 0)
+    {
+	fprintf (stderr, "%s: out of memory\n", name);
+	return tel;
+    }
+
+    tel->trace = (FILE *) 0;
+    if (trace_path != (char *) 0)
+    {
+	tel->trace = fopen (trace_path, "w");
+	if (tel->trace == (FILE *) 0)
+	{
+	    perror (trace_path);
+	    free (tel);
+	    return (struct telemetry *) 0;
+	}
+	fprintf (tel->trace, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    }
+
+    pthread_mutex_init (&tel->lock, (pthread_mutexattr_t *) 0);
+    tel->name = name;
+    tel->start = telemetry_clock ();
+    tel->interval = interval;
+    tel->last_time = tel->start;
+
+    return tel;
+}
+
+/*
+ * A stage (STAGE_PARSE etc.) has finished a span of work on nitems
+ * matrices, begun at start (as telemetry_clock gave it). May be called
+ * from any thread.
+ */
+void
+telemetry_span (struct telemetry *tel, int stage, double start, long nitems)
+{
+double          end, seconds;
+pthread_t       self;
+int             ii;
+
+    end = telemetry_clock ();
+    seconds = end - start;
+    self = pthread_self ();
+
+    pthread_mutex_lock (&tel->lock);
+
+    tel->hist[stage][telemetry_bin (seconds)]++;
+    tel->nspan[stage]++;
+    tel->nitems[stage] += nitems;
+    tel->total[stage] += seconds;
+    if (seconds > tel->longest[stage])
+	tel->longest[stage] = seconds;
+
+    for (ii = 0; ii < tel->nthread; ii++)
+	if (pthread_equal (tel->threads[ii], self))
+	    break;
+    if (ii == tel->nthread)
+    {
+	if (tel->nthread < TELEMETRY_THREADS)
+	    tel->threads[tel->nthread++] = self;
+	else
+	    ii = TELEMETRY_THREADS - 1;
+    }
+    tel->busy[ii] += seconds;
+    tel->ran[ii] |= 1 << stage;
+
+    if (tel->trace != (FILE *) 0)
+	fprintf (tel->trace, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+		 "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+		 "\"args\":{\"matrices\":%ld}}",
+		 (tel->ntrace++ > 0) ? "," : "", stage_names[stage], ii,
+		 1.e6 * (start - tel->start), 1.e6 * seconds, nitems);
+
+    pthread_mutex_unlock (&tel->lock);
+
+    return;
+}
+
+/*
+ * How busy each thread has been, as a percentage of the time since the
+ * run started, on one line.
+ */
+static void
+telemetry_busy (struct telemetry *tel, double elapsed)
+{
+int             ii;
+
+    fprintf (stderr, "threads busy");
+    for (ii = 0; ii < tel->nthread; ii++)
+	fprintf (stderr, " %.0f%%", (elapsed > 0.) ?
+		 100. * tel->busy[ii] / elapsed : 0.);
+    fprintf (stderr, "\n");
+
+    return;
+}
+
+/*
+ * Called by the writer after each chunk. If it has been interval seconds
+ * since the last report, report again: how many matrices have been
+ * written (output), how fast overall and since the last report, and how
+ * busy each thread is.
+ */
+void
+telemetry_progress (struct telemetry *tel)
+{
+double          now;
+long            ndone;
+
+    if (tel->interval <= 0.)
+	return;
+    now = telemetry_clock ();
+    if (now - tel->last_time < tel->interval)
+	return;
+
+    pthread_mutex_lock (&tel->lock);
+    ndone = tel->nitems[STAGE_OUTPUT];
+    fprintf (stderr, "%s: %ld matrices in %.1f s, %.1f/s (%.1f/s lately), ",
+	     tel->name, ndone, now - tel->start,
+	     (double) ndone / (now - tel->start),
+	     (double) (ndone - tel->last_done) / (now - tel->last_time));
+    telemetry_busy (tel, now - tel->start);
+    pthread_mutex_unlock (&tel->lock);
+
+    tel->last_time = now;
+    tel->last_done = ndone;
+
+    return;
+}
+
+/*
+ * Report on the whole run: how many matrices, how fast, and for each
+ * stage the number of spans, the time spent in it per matrix, and the
+ * quantiles of the lengths of its spans.
+ */
+void
+telemetry_report (struct telemetry *tel)
+{
+static const double quant[TELEMETRY_NQUANT] = { .5, .9, .99, .999 };
+double          elapsed;
+long            want, sum, ndone;
+int             stage, bin, iq;
+
+    elapsed = telemetry_clock () - tel->start;
+
+    pthread_mutex_lock (&tel->lock);
+
+    ndone = tel->nitems[STAGE_OUTPUT];
+    fprintf (stderr, "%s: %ld matrices in %.2f s, %.1f/s\n", tel->name,
+	     ndone, elapsed, (elapsed > 0.) ? (double) ndone / elapsed : 0.);
+    fprintf (stderr, "stage     spans   per matrix      p50      p90"
+	     "      p99    p99.9      max  (ms)\n");
+    for (stage = 0; stage < N_STAGES; stage++)
+    {
+	if (tel->nspan[stage] == 0)
+	    continue;
+
+	fprintf (stderr, "%-7s %7ld %9.4f ms", stage_names[stage],
+		 tel->nspan[stage], 1.e3 * tel->total[stage] /
+		 (double) ((tel->nitems[stage] > 0) ? tel->nitems[stage] : 1));
+
+	/* Each quantile in turn, from the bins in order */
+	sum = 0;
+	bin = -1;
+	for (iq = 0; iq < TELEMETRY_NQUANT; iq++)
+	{
+	    want = (long) ceil (quant[iq] * (double) tel->nspan[stage]);
+	    if (want < 1)
+		want = 1;
+	    while (sum < want)
+		sum += tel->hist[stage][++bin];
+	    /* A bin's middle may be past the longest span in it. */
+	    fprintf (stderr, " %8.3f", 1.e3 *
+		     ((telemetry_bin_middle (bin) < tel->longest[stage]) ?
+		      telemetry_bin_middle (bin) : tel->longest[stage]));
+	}
+	fprintf (stderr, " %8.3f\n", 1.e3 * tel->longest[stage]);
+    }
+    telemetry_busy (tel, elapsed);
+
+    pthread_mutex_unlock (&tel->lock);
+
+    return;
+}
+
+/*
+ * Finish the trace, if there is one, naming each thread in it after the
+ * stages it ran ("parse", "scan+refine", ...), and free the telemetry.
+ */
+void
+telemetry_close (struct telemetry *tel)
+{
+int             ii, stage, nran;
+
+    if (tel->trace != (FILE *) 0)
+    {
+	for (ii = 0; ii < tel->nthread; ii++)
+	{
+	    fprintf (tel->trace, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+		     "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+		     (tel->ntrace++ > 0) ? "," : "", ii);
+	    for (stage = nran = 0; stage < N_STAGES; stage++)
+		if (tel->ran[ii] & (1 << stage))
+		    fprintf (tel->trace, "%s%s", (nran++ > 0) ? "+" : "",
+			     stage_names[stage]);
+	    fprintf (tel->trace, "\"}}");
+	}
+	fprintf (tel->trace, "\n]}\n");
+	if (fclose (tel->trace) != 0)
+	    fprintf (stderr, "%s: can't finish writing the trace\n",
+		     tel->name);
+    }
+
+    pthread_mutex_destroy (&tel->lock);
+    free (tel);
+
+    return;
+}
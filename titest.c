@@ -11,7 +11,7 @@
 /*
  * Usage:
  *
- * titest < elastic_constants
+ * titest [options] < elastic_constants
  *
  * titest reads from standard input a fully general anisotropic
  * stiffness matrix in the form of 6 numbers on each of 6 lines of input.
@@ -60,106 +60,285 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "cmat.h"
 
+static int      group_mode (int compliance);
+static void     batch_values (int *chosen, struct batch_chunk *ch, int nn,
+			      double *values);
+static int      threshold_mode (FLT_DBL percent);
+
+/*
+ * The fields batch mode can output with --format (the last three only
+ * when the search has a budget), and how to print the others as plain
+ * text
+ */
+static const char *batch_fields[] = {
+    "dist", "axis_x", "axis_y", "axis_z", "theta", "phi",
+    "nevals", "resolution", "converged"
+};
+static const char *batch_text[] = {
+    "%.3f", "  %.4f", " %.4f", " %.4f", "  %.3f", " %.3f"
+};
+
+/*
+ * What the batch driver (see batch_driver.c) needs to know about titest
+ */
+static struct batch_program program = {
+    "titest", FIT_TI, batch_fields, batch_text, 9, 6, 3, 1, -1,
+    "TI", "symmetry axis", batch_values
+};
+
 int
-main ()
+main (int argc, char **argv)
 {
-int             ii, jj;
+int             ii;
 FLT_DBL         cc[6 * 6];
-FLT_DBL         cc1[6 * 6];
-FLT_DBL         cc2[6 * 6];
-FLT_DBL         ccrot[6 * 6];
-FLT_DBL         ccti[6 * 6];
-FLT_DBL         rmat[9];
-FLT_DBL         rmat_transp[9];
-FLT_DBL         vec[3];
-FLT_DBL         vec_sym[3];
-FLT_DBL         dist;
-FLT_DBL         norm;
-FLT_DBL         theta_best, phi_best, dist_best;
+struct ti_result res;
+struct batch_options bo;
+int             status;
+FLT_DBL         ss[6 * 6];
+FLT_DBL         ccp[PACKED_SIZE];
 
+/*
+ * Process the command-line options (see batch_driver.c).
+ */
+    if (batch_parse (&program, &bo, argc, argv) < 0)
+	return 1;
+    if (bo.threshold >= 0.)
+	return threshold_mode (bo.threshold);
+    if (bo.group)
+	return group_mode (bo.compliance);
+    if (bo.batch || bo.serve || bo.volume)
+	return batch_main (&program, &bo, argc, argv);
 
 /*
  * Read in the input elastic constants.
  */
-    read_matrix_6x6 (cc);
+    status = read_matrix_6x6 (cc);
+    if (status <= 0)
+    {
+	if (status == 0)
+	    fprintf (stderr, "titest: no input matrix\n");
+	return 1;
+    }
+
+    /* With --compliance, what was read in is S, and C is its inverse. */
+    if (bo.compliance)
+    {
+	for (ii = 0; ii < 6 * 6; ii++)
+	    ss[ii] = cc[ii];
+	pack_matrix_6x6 (ccp, ss);
+	batch_compliance (&program, 1, ccp, 0);
+	unpack_matrix_6x6 (cc, ccp);
+
+	printf ("Input S matrix:\n");
+	print_matrix_6x6 (ss);
+	printf ("\n\n");
+    }
 
     printf ("Input C matrix:\n");
     print_matrix_6x6 (cc);
     printf ("\n\n");
 
 /*
- * Find the norm of this set of elastic constants.
- * We will use this for calculating the percent error later.
+ * Find the best-approximating TI medium, and everything we are going to
+ * print out about it.
  */
-    norm = norm_matrix_6x6 (cc);
+    find_ti_result (cc, &bo.opts, RESULT_ALL, &res);
 
-/*
- * Find the best-approximating TI medium.
- */
-    dist_best = find_ti (cc, &theta_best, &phi_best);
+    /*
+     * With --compliance=both, give the matrices as compliances. The
+     * deviation and the distance stay those of the stiffnesses, as those
+     * are what was fitted.
+     */
+    if (bo.compliance_out)
+    {
+	invert_matrix_6x6 (res.ccrot, res.ccrot);
+	invert_matrix_6x6 (res.ccsym, res.ccsym);
+	invert_matrix_6x6 (res.ccorig, res.ccorig);
+    }
 
     /*
      * Output the results
      */
 
     /*
-     * Rotate the input elastic constants so that the symmetry axis is +Z, so
-     * that we can recognize the symmetry, and output it.
+     * The input elastic constants rotated so that the symmetry axis is +Z,
+     * so that we can recognize the symmetry.
      */
-    make_rotation_matrix (theta_best, phi_best, 0., rmat);
-    rotate_tensor (ccrot, cc, rmat);
-    printf ("Rotated C matrix:\n");
-    print_matrix_6x6 (ccrot);
+    printf ("Rotated %c matrix:\n", bo.compliance_out ? 'S' : 'C');
+    print_matrix_6x6 (res.ccrot);
     printf ("\n");
 
     /*
-     * Output the nearest VTI elastic constants.
+     * The nearest VTI elastic constants.
      */
-    dist = ti_distance (ccti, ccrot);
-    printf ("TI approximation:\n");
-    print_matrix_6x6 (ccti);
+    printf ("TI approximation%s:\n", bo.compliance_out ? " (S)" : "");
+    print_matrix_6x6 (res.ccsym);
     printf ("\n");
 
-    /* Transpose the rotation matrix so that it rotates the other way. */
-    transpose_matrix (rmat_transp, rmat);
     /*
-     * Rotate the best VTI approximation back to the original symmetry axis
+     * The best VTI approximation rotated back to the original symmetry axis
      * direction.
      */
-    rotate_tensor (cc2, ccti, rmat_transp);
-    printf ("TI approximation in original coordinate system:\n");
-    print_matrix_6x6 (cc2);
+    printf ("TI approximation in original coordinate system%s:\n",
+	    bo.compliance_out ? " (S)" : "");
+    print_matrix_6x6 (res.ccorig);
     printf ("\n");
 
     /*
-     * Calculate the deviation from TI element by element.
+     * The deviation from TI element by element.
      */
-    for (ii = 0; ii < 6; ii++)
-	for (jj = 0; jj <= ii; jj++)
-	{
-	    CC1 (ii, jj) = CC1 (jj, ii) =
-	     (CC (ii, jj) - CC2 (ii, jj)) * 100. / norm;
-	}
     printf
      ("Normalized deviation from TI in original coordinate system, in percent:\n");
-    format_print_matrix_6x6 ("%11.4f ", cc1);
+    format_print_matrix_6x6 ("%11.4f ", res.ccdev);
     printf ("\n");
 
     /* Output the distance from TI, normalized to a percentage. */
-    printf ("distance from TI = %.3f percent\n", 100. * dist / norm);
+    printf ("distance from TI = %.3f percent\n", 100. * res.dist / res.norm);
 
     /* Output the symmetry axis direction. */
+    printf ("Symmetry axis: (%.4f, %.4f, %.4f)\n",
+	    res.axis[0], res.axis[1], res.axis[2]);
+
+    printf ("theta = %.3f,   phi = %.3f\n", res.theta, res.phi);
+
+    if (search_budgeted (&bo.opts))
+	printf ("Search: %ld evaluations, resolution %.3g degrees, %s\n",
+		bo.opts.nevals, bo.opts.resolution,
+		bo.opts.converged ? "converged" : "not converged");
+
+    return 0;
+}
+
+/*
+ * --group: read stiffness matrices until the input runs out, and find
+ * the single TI symmetry axis that best fits all of them together.
+ * Output the shared axis, the overall distance from TI, and the distance
+ * from TI of each matrix using that axis. With compliance, the matrices
+ * read in are compliances.
+ */
+static int
+group_mode (int compliance)
+{
+int             nn, ncc;
+FLT_DBL        *ccs;
+FLT_DBL        *dists;
+FLT_DBL         rmat[9];
+FLT_DBL         rmat_transp[9];
+FLT_DBL         vec[3];
+FLT_DBL         vec_sym[3];
+FLT_DBL         theta_best, phi_best, dist_best;
+FLT_DBL         norm;
+double          norm_sum;
+
+    ccs = batch_read_all (&program, &ncc);
+    if (ccs == (FLT_DBL *) 0)
+	return 1;
+    dists = (FLT_DBL *) malloc ((ncc + 1) * sizeof (FLT_DBL));
+    if (dists == (FLT_DBL *) 0)
+    {
+	fprintf (stderr, "titest: out of memory\n");
+	return 1;
+    }
+    if (compliance)
+	batch_compliance (&program, ncc, ccs, 0);
+
+    dist_best = find_ti_group (ncc, ccs, &theta_best, &phi_best, dists);
+
+    printf ("Shared TI symmetry axis for %d matrices:\n", ncc);
+
+    make_rotation_matrix (theta_best, phi_best, 0., rmat);
+    transpose_matrix (rmat_transp, rmat);
     vec[0] = 0.;
     vec[1] = 0.;
     vec[2] = 1.;
     matrix_times_vector (vec_sym, rmat_transp, vec);
     printf ("Symmetry axis: (%.4f, %.4f, %.4f)\n",
 	    vec_sym[0], vec_sym[1], vec_sym[2]);
-
     printf ("theta = %.3f,   phi = %.3f\n", theta_best, phi_best);
+    printf ("\n");
+
+    /*
+     * Output the distance of each matrix from TI, normalized to a
+     * percentage of its own norm, and the overall distance normalized by
+     * the overall norm.
+     */
+    norm_sum = 0.;
+    for (nn = 0; nn < ncc; nn++)
+    {
+	norm = norm_packed (ccs + PACKED_SIZE * nn);
+	norm_sum += norm * norm;
+	printf ("Matrix %d: distance from TI = %.3f percent\n",
+		nn + 1, 100. * dists[nn] / norm);
+    }
+    printf ("\n");
+    printf ("Overall distance from TI = %.3f percent\n",
+	    100. * dist_best / sqrt (norm_sum));
+
+    free (ccs);
+    free (dists);
 
     return 0;
 }
+
+/*
+ * --threshold=percent: read stiffness matrices until the input runs out,
+ * and for each decide whether its distance from TI is no more than
+ * percent. Output one line per matrix: 1 if it is, 0 if not, and then
+ * the lower and upper bounds on the percent distance that decided it.
+ */
+static int
+threshold_mode (FLT_DBL percent)
+{
+FLT_DBL         cc[6 * 6];
+FLT_DBL         bounds[2];
+FLT_DBL         norm;
+int             yes, status;
+
+    while ((status = read_matrix_6x6 (cc)) > 0)
+    {
+	norm = norm_matrix_6x6 (cc);
+	yes = classify_ti (cc, percent * norm / 100., bounds);
+	printf ("%d  %.3f %.3f\n", yes,
+		100. * bounds[0] / norm, 100. * bounds[1] / norm);
+    }
+
+    return status < 0;
+}
+
+/*
+ * The value of every chosen field (see batch_fields) but the budget ones
+ * for matrix nn of a chunk.
+ */
+static void
+batch_values (int *chosen, struct batch_chunk *ch, int nn, double *values)
+{
+int             ii;
+FLT_DBL         rmat[9];
+FLT_DBL         rmat_transp[9];
+FLT_DBL         vec[3];
+FLT_DBL         vec_sym[3];
+
+    vec[0] = 0.;
+    vec[1] = 0.;
+    vec[2] = 1.;
+
+    if (chosen[1] || chosen[2] || chosen[3])
+    {
+	make_rotation_matrix (ch->theta_best[nn], ch->phi_best[nn], 0., rmat);
+	transpose_matrix (rmat_transp, rmat);
+	matrix_times_vector (vec_sym, rmat_transp, vec);
+    }
+
+    values[0] = chosen[0] ? 100. * ch->dist_best[nn] /
+     norm_packed (ch->ccs + PACKED_SIZE * nn) : 0.;
+    for (ii = 0; ii < 3; ii++)
+	values[1 + ii] = chosen[1 + ii] ? vec_sym[ii] : 0.;
+    values[4] = ch->theta_best[nn];
+    values[5] = ch->phi_best[nn];
+
+    return;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * The innermost kernels of the searches, for packed matrices (see
+ * packed_matrix.c), in float, double, and long double all at once:
+ *
+ *	rotate_packed_f		rotate_packed_d		rotate_packed_l
+ *	norm_packed_f		norm_packed_d		norm_packed_l
+ *	packed_distance_f	packed_distance_d	packed_distance_l
+ *	ti_distance_packed_f	ti_distance_packed_d	ti_distance_packed_l
+ *	ortho_distance_packed_f	ortho_distance_packed_d	ortho_distance_packed_l
+ *
+ * FLT_DBL only chooses which of these the usual names (rotate_packed and
+ * so on) call, so a program can still use the other precisions
+ * alongside. Each kernel takes and returns its own scalar type; float
+ * sums are accumulated in double, as FLT_DBL always has been.
+ *
+ * The code for all three is the same, in typed_kernels.h, included here
+ * once per type. Unlike the rest of the library it indexes the matrices
+ * only through the constant tables below rather than extern_packed and
+ * extern_voigt, which the compiler cannot see into, so the indexing is
+ * done at compile time.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/* extern_packed (see packed_matrix.c), known at compile time */
+static const int kernel_packed[6][6] = {
+    {0, 1, 2, 3, 4, 5},
+    {1, 6, 7, 8, 9, 10},
+    {2, 7, 11, 12, 13, 14},
+    {3, 8, 12, 15, 16, 17},
+    {4, 9, 13, 16, 18, 19},
+    {5, 10, 14, 17, 19, 20}
+};
+
+/*
+ * The number of times each packed element occurs in the full 3x3x3x3
+ * tensor: 1, 2, or 4 times for each Voigt index, twice again if it is
+ * off the diagonal and so stands for C_JI as well.
+ */
+static const double kernel_weight[PACKED_SIZE] = {
+    1., 2., 2., 4., 4., 4.,
+    1., 2., 4., 4., 4.,
+    1., 4., 4., 4.,
+    4., 8., 8.,
+    4., 8.,
+    4.
+};
+
+#define KERNEL_T	float
+#define KERNEL_SUM	double
+#define KERNEL_SQRT	sqrt
+#define KERNEL(name)	name ## _f
+#include "typed_kernels.h"
+#undef KERNEL_T
+#undef KERNEL_SUM
+#undef KERNEL_SQRT
+#undef KERNEL
+
+#define KERNEL_T	double
+#define KERNEL_SUM	double
+#define KERNEL_SQRT	sqrt
+#define KERNEL(name)	name ## _d
+#include "typed_kernels.h"
+#undef KERNEL_T
+#undef KERNEL_SUM
+#undef KERNEL_SQRT
+#undef KERNEL
+
+#define KERNEL_T	long double
+#define KERNEL_SUM	long double
+#define KERNEL_SQRT	sqrtl
+#define KERNEL(name)	name ## _l
+#include "typed_kernels.h"
+#undef KERNEL_T
+#undef KERNEL_SUM
+#undef KERNEL_SQRT
+#undef KERNEL
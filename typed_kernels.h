@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * The body of the typed kernels (see typed_kernels.c). There is no
+ * include guard: typed_kernels.c includes this once for each scalar type,
+ * with these defined:
+ *
+ *	KERNEL_T	the scalar type of the matrices;
+ *	KERNEL_SUM	the type to accumulate sums in;
+ *	KERNEL_SQRT	the square root function for KERNEL_SUM;
+ *	KERNEL(name)	the name of the kernel for this type.
+ *
+ * Only kernel_packed, kernel_weight, and constant indices are used to
+ * index the matrices, so the compiler can work every index out ahead of
+ * time.
+ */
+
+#define KCCP1(A,B)	ccp1[kernel_packed[(A)][(B)]]
+#define KCCP2(A,B)	ccp2[kernel_packed[(A)][(B)]]
+
+/*
+ * One row of the Bond matrix (see rotate_tensor.c): the Voigt index IJ of
+ * the rotated medium, made of the tensor indices I and J.
+ */
+#define KBOND_ROW(IJ,I,J) \
+    bond[0 + 6 * (IJ)] = RMAT (0, I) * RMAT (0, J); \
+    bond[1 + 6 * (IJ)] = RMAT (1, I) * RMAT (1, J); \
+    bond[2 + 6 * (IJ)] = RMAT (2, I) * RMAT (2, J); \
+    bond[3 + 6 * (IJ)] = RMAT (1, I) * RMAT (2, J); \
+    bond[3 + 6 * (IJ)] += RMAT (2, I) * RMAT (1, J); \
+    bond[4 + 6 * (IJ)] = RMAT (0, I) * RMAT (2, J); \
+    bond[4 + 6 * (IJ)] += RMAT (2, I) * RMAT (0, J); \
+    bond[5 + 6 * (IJ)] = RMAT (0, I) * RMAT (1, J); \
+    bond[5 + 6 * (IJ)] += RMAT (1, I) * RMAT (0, J)
+
+/*
+ * rotate_packed
+ */
+void
+KERNEL (rotate_packed) (KERNEL_T * ccp2, KERNEL_T * ccp1, KERNEL_T * rmat)
+{
+int             ij, kl, pq, kk;
+KERNEL_SUM      bond[6 * 6];
+KERNEL_SUM      cc[6 * 6];
+KERNEL_SUM      temp[6 * 6];
+KERNEL_SUM      sum;
+
+    KBOND_ROW (0, 0, 0);
+    KBOND_ROW (1, 1, 1);
+    KBOND_ROW (2, 2, 2);
+    KBOND_ROW (3, 1, 2);
+    KBOND_ROW (4, 0, 2);
+    KBOND_ROW (5, 0, 1);
+
+    /* Unpack, so the products below run over plain arrays */
+    kk = 0;
+    for (ij = 0; ij < 6; ij++)
+	for (kl = ij; kl < 6; kl++)
+	{
+	    cc[kl + 6 * ij] = cc[ij + 6 * kl] = ccp1[kk];
+	    kk++;
+	}
+
+    /* temp = M C */
+    for (ij = 0; ij < 6; ij++)
+	for (kl = 0; kl < 6; kl++)
+	{
+	    sum = 0.;
+	    for (pq = 0; pq < 6; pq++)
+		sum += bond[pq + 6 * ij] * cc[kl + 6 * pq];
+	    temp[kl + 6 * ij] = sum;
+	}
+
+    /* C' = temp M^T; it is symmetric, so only the upper triangle */
+    kk = 0;
+    for (ij = 0; ij < 6; ij++)
+	for (kl = ij; kl < 6; kl++)
+	{
+	    sum = 0.;
+	    for (pq = 0; pq < 6; pq++)
+		sum += temp[pq + 6 * ij] * bond[pq + 6 * kl];
+	    ccp2[kk] = sum;
+	    kk++;
+	}
+
+    return;
+}
+
+/*
+ * norm_packed
+ */
+KERNEL_T
+KERNEL (norm_packed) (KERNEL_T * ccp)
+{
+int             kk;
+KERNEL_SUM      temp;
+
+    temp = 0.;
+    for (kk = 0; kk < PACKED_SIZE; kk++)
+	temp += kernel_weight[kk] * ccp[kk] * ccp[kk];
+
+    return (KERNEL_T) KERNEL_SQRT (temp);
+}
+
+/*
+ * packed_distance
+ */
+KERNEL_T
+KERNEL (packed_distance) (KERNEL_T * ccp1, KERNEL_T * ccp2)
+{
+int             kk;
+KERNEL_SUM      temp1, temp2;
+
+    temp2 = 0.;
+    for (kk = 0; kk < PACKED_SIZE; kk++)
+    {
+	temp1 = ccp1[kk] - ccp2[kk];
+	temp2 += kernel_weight[kk] * temp1 * temp1;
+    }
+
+    return (KERNEL_T) KERNEL_SQRT (temp2);
+}
+
+/*
+ * ti_distance_packed
+ */
+KERNEL_T
+KERNEL (ti_distance_packed) (KERNEL_T * ccp2, KERNEL_T * ccp1)
+{
+int             kk;
+KERNEL_T        c33, c13, c55, c11, c66;
+
+/*
+ * Find the nearest VTI medium.
+ * Watch out! For some reason, this equation has been particularly
+ * susceptible to typos in the literature.
+ * This is a minimal set of 5 independent stiffness constants required
+ * to define a VTI medium.
+ */
+    c33 = KCCP1 (2, 2);
+    c13 = (KCCP1 (0, 2) + KCCP1 (1, 2)) / 2.;
+    c55 = (KCCP1 (3, 3) + KCCP1 (4, 4)) / 2.;
+    c11 =
+     (3. * KCCP1 (0, 0) + 3. * KCCP1 (1, 1) + 4. * KCCP1 (5, 5) +
+      2. * KCCP1 (0, 1)) / 8.;
+    c66 =
+     (KCCP1 (0, 0) + KCCP1 (1, 1) + 4. * KCCP1 (5, 5) -
+      2. * KCCP1 (0, 1)) / 8.;
+
+/*
+ * Fill out the VTI matrix from those 5.
+ * Most elements are zero.
+ */
+    for (kk = 0; kk < PACKED_SIZE; kk++)
+	ccp2[kk] = 0.;
+
+    KCCP2 (0, 0) = c11;
+    KCCP2 (1, 1) = c11;
+    KCCP2 (2, 2) = c33;
+    KCCP2 (3, 3) = c55;
+    KCCP2 (4, 4) = c55;
+    KCCP2 (5, 5) = c66;
+    KCCP2 (0, 2) = c13;
+    KCCP2 (1, 2) = c13;
+    KCCP2 (0, 1) = c11 - 2. * c66;
+
+    return KERNEL (packed_distance) (ccp2, ccp1);
+}
+
+/*
+ * ortho_distance_packed: the nearest Orthorhombic medium simply throws
+ * away everything outside the upper-left 3x3 block and the diagonal.
+ */
+KERNEL_T
+KERNEL (ortho_distance_packed) (KERNEL_T * ccp2, KERNEL_T * ccp1)
+{
+int             ii, jj;
+
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	{
+	    if (ii == jj || jj < 3)
+		KCCP2 (ii, jj) = KCCP1 (ii, jj);
+	    else
+		KCCP2 (ii, jj) = 0.;
+	}
+
+    return KERNEL (packed_distance) (ccp2, ccp1);
+}
+
+#undef KCCP1
+#undef KCCP2
+#undef KBOND_ROW
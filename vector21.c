@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+#include <math.h>
+#include "cmat.h"
+
+/*
+ * Convert between a 6x6 Voigt stiffness matrix and a vector of its
+ * 21 independent elements, ordered C11, C12, ..., C16, C22, ..., C66.
+ *
+ * Each element is scaled by the square root of the number of times it
+ * occurs in the full 3x3x3x3 tensor, so that the ordinary Euclidean length
+ * of the vector is the Federov norm of the tensor (see norm_matrix.c),
+ * and the dot product of two such vectors is the tensor inner product.
+ */
+
+/*
+ * The square root of the number of tensor elements C_IJ stands for.
+ */
+static FLT_DBL
+vector21_scale (int ii, int jj)
+{
+    if (ii >= 3 && jj >= 3)
+	return (ii == jj) ? 2. : 2. * sqrt (2.);
+    if (ii >= 3 || jj >= 3)
+	return 2.;
+
+    return (ii == jj) ? 1. : sqrt (2.);
+}
+
+/*
+ * Input: 6x6 elastic matrix cc
+ *
+ * Output: 21-vector xx
+ */
+void
+matrix_to_vector21 (FLT_DBL * xx, FLT_DBL * cc)
+{
+int             ii, jj, kk;
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	    xx[kk++] = vector21_scale (ii, jj) * CC (ii, jj);
+
+    return;
+}
+
+/*
+ * Input: 21-vector xx
+ *
+ * Output: 6x6 elastic matrix cc
+ */
+void
+vector21_to_matrix (FLT_DBL * cc, FLT_DBL * xx)
+{
+int             ii, jj, kk;
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	{
+	    CC (ii, jj) = CC (jj, ii) = xx[kk] / vector21_scale (ii, jj);
+	    kk++;
+	}
+
+    return;
+}
+
+/*
+ * The same conversions for packed matrices (see packed_matrix.c), which
+ * hold the elements in the same order.
+ */
+void
+packed_to_vector21 (FLT_DBL * xx, FLT_DBL * ccp)
+{
+int             ii, jj, kk;
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	{
+	    xx[kk] = vector21_scale (ii, jj) * ccp[kk];
+	    kk++;
+	}
+
+    return;
+}
+
+void
+vector21_to_packed (FLT_DBL * ccp, FLT_DBL * xx)
+{
+int             ii, jj, kk;
+
+    kk = 0;
+    for (ii = 0; ii < 6; ii++)
+	for (jj = ii; jj < 6; jj++)
+	{
+	    ccp[kk] = xx[kk] / vector21_scale (ii, jj);
+	    kk++;
+	}
+
+    return;
+}
+
+/*
+ * Find an orthonormal basis for the subspace a projection such as
+ * ti_distance_packed or ortho_distance_packed projects onto, by
+ * projecting each of the 21 unit vectors and orthonormalizing the
+ * results (Gram-Schmidt).
+ * The basis is returned as packed stiffness matrices.
+ *
+ * Return value: the number of basis vectors found.
+ */
+int
+projection_basis (FLT_DBL (*project) (FLT_DBL *, FLT_DBL *),
+		  FLT_DBL basis[MAX_BASIS][PACKED_SIZE])
+{
+int             ii, jj, kk, nbasis;
+FLT_DBL         xx[21], yy[21];
+FLT_DBL         vv[MAX_BASIS][21];
+FLT_DBL         ccp1[PACKED_SIZE], ccp2[PACKED_SIZE];
+FLT_DBL         dot, len;
+
+    nbasis = 0;
+    for (ii = 0; ii < 21 && nbasis < MAX_BASIS; ii++)
+    {
+	for (kk = 0; kk < 21; kk++)
+	    xx[kk] = 0.;
+	xx[ii] = 1.;
+
+	vector21_to_packed (ccp1, xx);
+	project (ccp2, ccp1);
+	packed_to_vector21 (yy, ccp2);
+
+	for (jj = 0; jj < nbasis; jj++)
+	{
+	    dot = 0.;
+	    for (kk = 0; kk < 21; kk++)
+		dot += yy[kk] * vv[jj][kk];
+	    for (kk = 0; kk < 21; kk++)
+		yy[kk] -= dot * vv[jj][kk];
+	}
+
+	len = 0.;
+	for (kk = 0; kk < 21; kk++)
+	    len += yy[kk] * yy[kk];
+	len = sqrt (len);
+
+	/* Nothing new in this direction */
+	if (len < 1.e-6)
+	    continue;
+
+	for (kk = 0; kk < 21; kk++)
+	    vv[nbasis][kk] = yy[kk] / len;
+	vector21_to_packed (basis[nbasis], vv[nbasis]);
+	nbasis++;
+    }
+
+    return nbasis;
+}
@@ -39,3 +39,21 @@ vector_to_angles (FLT_DBL vec[3], FLT_DBL * phi, FLT_DBL * theta)
 
     return;
 }
+
+/*
+ * The reverse: the unit vector pointing in the direction given by phi
+ * and theta (in degrees), as for vector_to_angles.
+ */
+
+void
+angles_to_vector (FLT_DBL phi, FLT_DBL theta, FLT_DBL vec[3])
+{
+    phi *= DEGTORAD;
+    theta *= DEGTORAD;
+
+    vec[0] = sin (phi) * sin (theta);
+    vec[1] = sin (phi) * cos (theta);
+    vec[2] = cos (phi);
+
+    return;
+}
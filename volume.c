@@ -0,0 +1,664 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Nearest TI or Orthorhombic medium at every point of a 3D volume of
+ * stiffness matrices, coarse to fine.
+ *
+ * In a real earth model the symmetry axes change smoothly from point to
+ * point almost everywhere, so a full search at every point mostly finds
+ * out again what its neighbors already knew. Instead, only every
+ * VOLUME_STRIDE'th point along each axis gets a full search. The grid is
+ * then halved, again and again, down to every point. Each new point
+ * starts from the orientation interpolated from the already-solved
+ * points around it (the corners of the cell it is in the middle of, or
+ * the ends of the edge, or of the face) and only refines that (see
+ * warm_inc in cmat.h), which takes a few dozen distance evaluations
+ * instead of thousands.
+ *
+ * Where the model isn't smooth, at a fault or the edge of a body, the
+ * refined answer ends up somewhere other than where its neighbors said it
+ * would be, or fits much worse than theirs do, and such points get a full
+ * search after all. So do the points where the warm start failed to
+ * converge. "Somewhere other" means the orientations are more than agree
+ * degrees apart, counting orientations that differ only by a relabeling
+ * of the symmetry axes as the same.
+ *
+ * The full searches at each level are done together, as a batch (see
+ * batch_scan.c).
+ *
+ * With progress, points already done are skipped, and progress is saved
+ * as more get done, so a run that is cut short can be taken up again. An
+ * unfinished point is simply solved again from the start, which for a
+ * warm start costs little: every point it depends on is done. The
+ * volume_checkpoint_ functions keep that progress in a checkpoint file.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "cmat.h"
+
+/* The spacing of the points searched in full to start with */
+#define VOLUME_STRIDE	8
+
+/* The default for agree, in degrees */
+#define VOLUME_AGREE	5.
+
+/*
+ * The grid spacing, in degrees, the warm starts refine from, for TI and
+ * for Orthorhombic. Newton's method reaches about twice this far.
+ */
+#define VOLUME_WARM_INC	2.
+#define VOLUME_WARM_INC_ORTHO	4.
+
+/*
+ * The most distance evaluations a warm start may take. One that needs
+ * more has strayed too far to be worth finishing: a full search is
+ * cheaper.
+ */
+#define VOLUME_WARM_EVALS	400
+
+/*
+ * A refined point may be this many times as far from symmetry, relative
+ * to its norm, as the worst of its neighbors, plus VOLUME_FLOOR.
+ */
+#define VOLUME_SLACK	1.5
+#define VOLUME_FLOOR	.001
+
+/*
+ * How far apart two changed stretches of a checkpoint may be and still be
+ * written together
+ */
+#define VOLUME_SAVE_GAP	64
+
+/*
+ * The cosine of the angle between two TI symmetry axes, given as theta
+ * and phi (which way an axis points doesn't matter).
+ */
+static double
+volume_cos_ti (FLT_DBL * orient1, FLT_DBL * orient2)
+{
+FLT_DBL         v1[3], v2[3];
+
+    angles_to_vector (orient1[1], orient1[0], v1);
+    angles_to_vector (orient2[1], orient2[0], v2);
+
+    return fabs (v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2]);
+}
+
+/*
+ * Relabel the principal axes of rmat2 (the rows of the rotation) so that
+ * it is as close as it can be to rmat1: try every proper rotation that
+ * takes the coordinate axes into each other, and keep the best, in
+ * rmat. Return the cosine of half the angle left between them.
+ */
+static double
+volume_align_ortho (FLT_DBL * rmat1, FLT_DBL * rmat2, FLT_DBL * rmat)
+{
+static const int perm[6][3] = {
+    {0, 1, 2}, {1, 2, 0}, {2, 0, 1}, {0, 2, 1}, {2, 1, 0}, {1, 0, 2}
+};
+double          dots[3][3];
+double          trace, best;
+int             ip, is, ii, jj, sign[3], det;
+
+    /* dots[ii][jj] is row ii of rmat1 dot row jj of rmat2 */
+    for (ii = 0; ii < 3; ii++)
+	for (jj = 0; jj < 3; jj++)
+	    dots[ii][jj] = rmat1[3 * ii] * rmat2[3 * jj] +
+	     rmat1[3 * ii + 1] * rmat2[3 * jj + 1] +
+	     rmat1[3 * ii + 2] * rmat2[3 * jj + 2];
+
+    best = -4.;
+    for (ip = 0; ip < 6; ip++)
+	for (is = 0; is < 8; is++)
+	{
+	    /* Odd permutations need an odd number of sign flips. */
+	    det = (ip < 3) ? 1 : -1;
+	    for (ii = 0; ii < 3; ii++)
+	    {
+		sign[ii] = (is & (1 << ii)) ? -1 : 1;
+		det *= sign[ii];
+	    }
+	    if (det < 0)
+		continue;
+
+	    trace = 0.;
+	    for (ii = 0; ii < 3; ii++)
+		trace += sign[ii] * dots[ii][perm[ip][ii]];
+	    if (trace > best)
+	    {
+		best = trace;
+		for (ii = 0; ii < 3; ii++)
+		    for (jj = 0; jj < 3; jj++)
+			rmat[3 * ii + jj] = sign[ii] *
+			 rmat2[3 * perm[ip][ii] + jj];
+	    }
+	}
+
+    /* The angle of the rotation between them, from its trace */
+    return sqrt ((best + 1.) / 4. > 0. ? (best + 1.) / 4. : 0.);
+}
+
+/*
+ * Are two orientations within agree degrees (cos_agree, the cosine of
+ * that, or of half that for Orthorhombic) of each other?
+ */
+static int
+volume_agrees (int symmetry, FLT_DBL * orient1, FLT_DBL * orient2,
+	       double cos_agree)
+{
+FLT_DBL         rmat[9];
+
+    if (symmetry == FIT_ORTHO)
+	return volume_align_ortho (orient1, orient2, rmat) >= cos_agree;
+    return volume_cos_ti (orient1, orient2) >= cos_agree;
+}
+
+/*
+ * The orientation in the middle of nn others: for TI the average axis
+ * (each turned to point the same way as the first), for Orthorhombic the
+ * average rotation (each with its axes relabeled to match the first, as
+ * quaternions of the same sign).
+ */
+static void
+volume_middle (int symmetry, int nn, FLT_DBL ** orients, FLT_DBL * orient)
+{
+FLT_DBL         vec[3], v0[3], sum[4], qq[4], q0[4];
+FLT_DBL         rmat[9];
+double          dot, len;
+int             kk, ii, ncomp;
+
+    ncomp = (symmetry == FIT_ORTHO) ? 4 : 3;
+    for (ii = 0; ii < 4; ii++)
+	sum[ii] = 0.;
+
+    for (kk = 0; kk < nn; kk++)
+    {
+	if (symmetry == FIT_ORTHO)
+	{
+	    volume_align_ortho (orients[0], orients[kk], rmat);
+	    matrix_to_quaternion (rmat, qq);
+	    if (kk == 0)
+		for (ii = 0; ii < 4; ii++)
+		    q0[ii] = qq[ii];
+	    dot = qq[0] * q0[0] + qq[1] * q0[1] + qq[2] * q0[2] + qq[3] * q0[3];
+	}
+	else
+	{
+	    angles_to_vector (orients[kk][1], orients[kk][0], qq);
+	    if (kk == 0)
+		for (ii = 0; ii < 3; ii++)
+		    v0[ii] = qq[ii];
+	    dot = qq[0] * v0[0] + qq[1] * v0[1] + qq[2] * v0[2];
+	}
+	for (ii = 0; ii < ncomp; ii++)
+	    sum[ii] += (dot < 0.) ? -qq[ii] : qq[ii];
+    }
+
+    len = 0.;
+    for (ii = 0; ii < ncomp; ii++)
+	len += sum[ii] * sum[ii];
+    len = sqrt (len);
+
+    if (symmetry == FIT_ORTHO)
+    {
+	for (ii = 0; ii < 4; ii++)
+	    qq[ii] = sum[ii] / len;
+	quaternion_to_matrix (qq, orient);
+    }
+    else
+    {
+	for (ii = 0; ii < 3; ii++)
+	    vec[ii] = sum[ii] / len;
+	vector_to_angles (vec, orient + 1, orient);
+    }
+
+    return;
+}
+
+/*
+ * Mark point nn done, and save progress every so often.
+ */
+static void
+volume_done (struct volume_progress *progress, long nn, long *nsince)
+{
+    if (progress == (struct volume_progress *) 0)
+	return;
+
+    progress->done[nn] = 1;
+    if (++*nsince >= progress->every)
+    {
+	progress->save (progress->data);
+	*nsince = 0;
+    }
+
+    return;
+}
+
+/*
+ * Full searches of the nn points in list, together.
+ */
+static int
+volume_global (int symmetry, int nn, long *list, FLT_DBL * ccs,
+	       FLT_DBL * orient, FLT_DBL * dist)
+{
+FLT_DBL        *ccs_list, *orient_list, *dist_list;
+int             norient, kk, ii;
+
+    if (nn == 0)
+	return 0;
+
+    norient = VOLUME_NORIENT (symmetry);
+    ccs_list = (FLT_DBL *) malloc (nn * PACKED_SIZE * sizeof (FLT_DBL));
+    orient_list = (FLT_DBL *) malloc (nn * 9 * sizeof (FLT_DBL));
+    dist_list = (FLT_DBL *) malloc (nn * sizeof (FLT_DBL));
+    if (ccs_list == (FLT_DBL *) 0 || orient_list == (FLT_DBL *) 0 ||
+	dist_list == (FLT_DBL *) 0)
+    {
+	free (ccs_list);
+	free (orient_list);
+	free (dist_list);
+	return -1;
+    }
+
+    for (kk = 0; kk < nn; kk++)
+	for (ii = 0; ii < PACKED_SIZE; ii++)
+	    ccs_list[PACKED_SIZE * kk + ii] = ccs[PACKED_SIZE * list[kk] + ii];
+
+    if (symmetry == FIT_ORTHO)
+	find_ortho_batch (nn, ccs_list, orient_list, dist_list);
+    else
+	find_ti_batch (nn, ccs_list, orient_list, orient_list + nn, dist_list);
+
+    for (kk = 0; kk < nn; kk++)
+    {
+	dist[list[kk]] = dist_list[kk];
+	if (symmetry == FIT_ORTHO)
+	    for (ii = 0; ii < 9; ii++)
+		orient[norient * list[kk] + ii] = orient_list[9 * kk + ii];
+	else
+	{
+	    orient[norient * list[kk]] = orient_list[kk];
+	    orient[norient * list[kk] + 1] = orient_list[nn + kk];
+	}
+    }
+
+    free (ccs_list);
+    free (orient_list);
+    free (dist_list);
+
+    return 0;
+}
+
+/*
+ * The levels along one axis of nn points. Level 0 is every
+ * VOLUME_STRIDE'th point and the last one; each level after that is the
+ * points half way between those of the levels before, lo and hi the
+ * points on either side of it. Return the number of levels.
+ */
+static int
+volume_levels (int nn, int *level, int *lo, int *hi)
+{
+int             ii, prev, nlevel;
+
+    for (ii = 0; ii < nn; ii++)
+    {
+	level[ii] = (ii % VOLUME_STRIDE == 0 || ii == nn - 1) ? 0 : -1;
+	lo[ii] = hi[ii] = ii;
+    }
+
+    for (nlevel = 1;; nlevel++)
+    {
+	prev = -1;
+	for (ii = 0; ii < nn; ii++)
+	{
+	    if (level[ii] < 0 || level[ii] == nlevel)
+		continue;
+	    if (prev >= 0 && ii - prev >= 2)
+	    {
+		level[(prev + ii) / 2] = nlevel;
+		lo[(prev + ii) / 2] = prev;
+		hi[(prev + ii) / 2] = ii;
+	    }
+	    prev = ii;
+	}
+
+	for (ii = 0; ii < nn && level[ii] >= 0; ii++)
+	    ;
+	if (ii == nn)
+	    return nlevel + 1;
+    }
+}
+
+/*
+ * Input:
+ *	symmetry is FIT_TI or FIT_ORTHO.
+ *	dims are the number of points along each axis of the volume,
+ *	dims[0] varying fastest.
+ *	ccs is the dims[0] * dims[1] * dims[2] packed stiffness matrices.
+ *	agree (in degrees) is how far apart neighboring orientations may be
+ *	and still be taken as agreeing, or 0 for the default.
+ *
+ * Output:
+ *	orient is the best orientation at each point: for TI, theta and phi
+ *	(as for find_ti), for Orthorhombic, the 9 elements of rmat (as for
+ *	find_ortho).
+ *	dist is the distance from symmetry at each point.
+ *	stats, if not a null pointer, says how much work that took.
+ *	progress, if not a null pointer, is as described above, with
+ *	orient and dist already filled in at the points done.
+ *
+ * Return value:
+ *	0, or -1 if it ran out of memory.
+ */
+int
+find_volume (int symmetry, int *dims, FLT_DBL * ccs, FLT_DBL agree,
+	     FLT_DBL * orient, FLT_DBL * dist, struct volume_stats *stats,
+	     struct volume_progress *progress)
+{
+long            npoint, nn, nglobal, npiece, nsince, *list;
+long            nbr_at[8];
+int            *level[3], *lo[3], *hi[3];
+int             coord[3], nbr[3];
+int             lev, nlevel, norient, ii, kk, nnbr, corner, ok;
+FLT_DBL        *nbrs[8];
+FLT_DBL         start[9], middle[9];
+double          cos_agree, worst;
+struct search_opts opts;
+FLT_DBL        *ccp;
+
+    if (agree <= 0.)
+	agree = VOLUME_AGREE;
+    /* Orthorhombic orientations are compared by half the angle. */
+    cos_agree = cos (((symmetry == FIT_ORTHO) ? .5 : 1.) * agree * DEGTORAD);
+    norient = VOLUME_NORIENT (symmetry);
+
+    npoint = (long) dims[0] * dims[1] * dims[2];
+    list = (long *) malloc ((npoint + 1) * sizeof (long));
+    ok = (list != (long *) 0);
+    for (ii = 0; ii < 3; ii++)
+    {
+	level[ii] = (int *) malloc (3 * (dims[ii] + 1) * sizeof (int));
+	ok = ok && level[ii] != (int *) 0;
+    }
+    if (!ok)
+    {
+	free (list);
+	for (ii = 0; ii < 3; ii++)
+	    free (level[ii]);
+	return -1;
+    }
+
+    nlevel = 0;
+    for (ii = 0; ii < 3; ii++)
+    {
+	lo[ii] = level[ii] + dims[ii] + 1;
+	hi[ii] = lo[ii] + dims[ii] + 1;
+	kk = volume_levels (dims[ii], level[ii], lo[ii], hi[ii]);
+	if (kk > nlevel)
+	    nlevel = kk;
+    }
+
+    if (stats != (struct volume_stats *) 0)
+    {
+	stats->ncoarse = 0;
+	stats->nwarm = 0;
+	stats->nglobal = 0;
+    }
+
+    /* A point's level is the finest of its coordinates' levels. */
+    nsince = 0;
+    for (lev = 0; lev < nlevel; lev++)
+    {
+	nglobal = 0;
+
+	for (nn = 0; nn < npoint; nn++)
+	{
+	    coord[0] = (int) (nn % dims[0]);
+	    coord[1] = (int) ((nn / dims[0]) % dims[1]);
+	    coord[2] = (int) (nn / ((long) dims[0] * dims[1]));
+
+	    kk = 0;
+	    for (ii = 0; ii < 3; ii++)
+		if (level[ii][coord[ii]] > kk)
+		    kk = level[ii][coord[ii]];
+	    if (kk != lev || (progress != (struct volume_progress *) 0 &&
+			      progress->done[nn]))
+		continue;
+
+	    if (lev == 0)
+	    {
+		list[nglobal++] = nn;
+		continue;
+	    }
+
+	    /*
+	     * The solved points around this one: along each axis where its
+	     * coordinate is new at this level, the points on either side.
+	     */
+	    nnbr = 0;
+	    for (corner = 0; corner < 8; corner++)
+	    {
+		ok = 1;
+		for (ii = 0; ii < 3; ii++)
+		{
+		    nbr[ii] = coord[ii];
+		    if (level[ii][coord[ii]] == lev)
+			nbr[ii] = (corner & (1 << ii)) ? hi[ii][coord[ii]] :
+			 lo[ii][coord[ii]];
+		    else if (corner & (1 << ii))
+			ok = 0;
+		}
+		if (ok)
+		{
+		    nbr_at[nnbr] = nbr[0] + dims[0] *
+		     (nbr[1] + (long) dims[1] * nbr[2]);
+		    nbrs[nnbr] = orient + norient * nbr_at[nnbr];
+		    nnbr++;
+		}
+	    }
+
+	    volume_middle (symmetry, nnbr, nbrs, start);
+	    for (ii = 0; ii < norient; ii++)
+		middle[ii] = start[ii];
+
+	    search_defaults (&opts);
+	    opts.warm_inc = (symmetry == FIT_ORTHO) ? VOLUME_WARM_INC_ORTHO :
+	     VOLUME_WARM_INC;
+	    opts.max_evals = VOLUME_WARM_EVALS;
+	    ccp = ccs + PACKED_SIZE * nn;
+	    if (symmetry == FIT_ORTHO)
+		dist[nn] = search_ortho (rotated_ortho_distance,
+					 rotated_ti_distance, (void *) ccp,
+					 &opts, start);
+	    else
+		dist[nn] = search_ti (rotated_ti_distance, (void *) ccp,
+				      &opts, start, start + 1);
+	    for (ii = 0; ii < norient; ii++)
+		orient[norient * nn + ii] = start[ii];
+
+	    /*
+	     * Is the answer where the neighbors said it would be, and does
+	     * it fit about as well as theirs do?
+	     */
+	    ok = opts.converged &&
+	     volume_agrees (symmetry, middle, start, cos_agree);
+	    worst = 0.;
+	    for (ii = 0; ii < nnbr && ok; ii++)
+		if (dist[nbr_at[ii]] / norm_packed (ccs + PACKED_SIZE *
+						    nbr_at[ii]) > worst)
+		    worst = dist[nbr_at[ii]] /
+		     norm_packed (ccs + PACKED_SIZE * nbr_at[ii]);
+	    if (ok && dist[nn] / norm_packed (ccp) >
+		VOLUME_SLACK * worst + VOLUME_FLOOR)
+		ok = 0;
+
+	    if (ok)
+	    {
+		if (stats != (struct volume_stats *) 0)
+		    stats->nwarm++;
+		volume_done (progress, nn, &nsince);
+	    }
+	    else
+		list[nglobal++] = nn;
+	}
+
+	/* With progress to save, a piece at a time */
+	for (nn = 0; nn < nglobal; nn += npiece)
+	{
+	    npiece = nglobal - nn;
+	    if (progress != (struct volume_progress *) 0 &&
+		progress->every < npiece)
+		npiece = progress->every;
+	    if (volume_global (symmetry, (int) npiece, list + nn, ccs, orient,
+			       dist) < 0)
+		break;
+	    for (kk = 0; kk < npiece; kk++)
+		volume_done (progress, list[nn + kk], &nsince);
+	}
+	if (nn < nglobal)
+	{
+	    nlevel = -1;
+	    break;
+	}
+	if (stats != (struct volume_stats *) 0)
+	{
+	    if (lev == 0)
+		stats->ncoarse += nglobal;
+	    else
+		stats->nglobal += nglobal;
+	}
+    }
+
+    free (list);
+    for (ii = 0; ii < 3; ii++)
+	free (level[ii]);
+
+    return (nlevel < 0) ? -1 : 0;
+}
+
+/*
+ * A volume run's checkpoint (see checkpoint.c) holds, for every point,
+ * whether it is done (one byte each), then the orientations (as in
+ * find_volume), then the distances.
+ *
+ * Input:
+ *	symmetry is FIT_TI or FIT_ORTHO.
+ *	dims are the number of points along each axis of the volume.
+ *
+ * Return value:
+ *	The size of the checkpoint, in bytes.
+ */
+long
+volume_checkpoint_size (int symmetry, int *dims)
+{
+    return (long) dims[0] * dims[1] * dims[2] *
+     (1 + (VOLUME_NORIENT (symmetry) + 1) * sizeof (FLT_DBL));
+}
+
+/*
+ * Take up a volume run again from its checkpoint.
+ *
+ * Input:
+ *	vc is as described in cmat.h.
+ *
+ * Output:
+ *	vc->done, vc->orient, and vc->dist are read from the checkpoint,
+ *	and vc->saved is set to vc->done.
+ *
+ * Return value:
+ *	The number of points done, or -1 if the checkpoint can't be read.
+ */
+long
+volume_checkpoint_read (struct volume_checkpoint *vc)
+{
+long            npoint, nn, ndone;
+int             norient;
+
+    npoint = vc->npoint;
+    norient = VOLUME_NORIENT (vc->symmetry);
+    if (checkpoint_read (vc->ckpt, 0, vc->done, npoint) < 0 ||
+	checkpoint_read (vc->ckpt, npoint, vc->orient,
+			 norient * npoint * sizeof (FLT_DBL)) < 0 ||
+	checkpoint_read (vc->ckpt, npoint * (1 + norient * sizeof (FLT_DBL)),
+			 vc->dist, npoint * sizeof (FLT_DBL)) < 0)
+	return -1;
+
+    for (nn = ndone = 0; nn < npoint; nn++)
+    {
+	vc->saved[nn] = vc->done[nn];
+	ndone += (vc->done[nn] != 0);
+    }
+
+    return ndone;
+}
+
+/*
+ * Bring a volume run's checkpoint up to date: write the answers at the
+ * points done since it last was, and only once they are on disk, that
+ * those points are done. Nearby stretches of changed points are written
+ * together; writing over the points between them does no harm.
+ *
+ * Input:
+ *	vc is as described in cmat.h.
+ *
+ * Output:
+ *	vc->saved is set to vc->done, if all went well.
+ *
+ * Return value:
+ *	0, or -1 if the checkpoint can't be written.
+ */
+int
+volume_checkpoint_write (struct volume_checkpoint *vc)
+{
+long            nn, first, last, npoint, nbytes;
+int             pass, norient;
+
+    npoint = vc->npoint;
+    norient = VOLUME_NORIENT (vc->symmetry);
+    for (pass = 0; pass < 2; pass++)
+    {
+	for (nn = 0; nn < npoint; nn++)
+	{
+	    if (vc->done[nn] == vc->saved[nn])
+		continue;
+	    first = last = nn;
+	    for (nn++; nn < npoint && nn - last <= VOLUME_SAVE_GAP; nn++)
+		if (vc->done[nn] != vc->saved[nn])
+		    last = nn;
+	    nn = last;
+
+	    if (pass == 0)
+	    {
+		nbytes = (last + 1 - first) * sizeof (FLT_DBL);
+		if (checkpoint_write (vc->ckpt, npoint + norient * first *
+				      sizeof (FLT_DBL),
+				      vc->orient + norient * first,
+				      norient * nbytes) < 0 ||
+		    checkpoint_write (vc->ckpt, npoint * (1 + norient *
+							  sizeof (FLT_DBL)) +
+				      first * sizeof (FLT_DBL),
+				      vc->dist + first, nbytes) < 0)
+		    return -1;
+	    }
+	    else if (checkpoint_write (vc->ckpt, first, vc->done + first,
+				       last + 1 - first) < 0)
+		return -1;
+	}
+	if (pass == 0 && checkpoint_sync (vc->ckpt, 0) < 0)
+	    return -1;
+    }
+
+    for (nn = 0; nn < npoint; nn++)
+	vc->saved[nn] = vc->done[nn];
+
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2005 by the Society of Exploration Geophysicists.
+ * For more information, go to http://software.seg.org/2005/0001 .
+ * You must read and accept usage terms at:
+ * http://software.seg.org/disclaimer.txt before use.
+ *
+ * Revision history:
+ * Original SEG version by Joe Dellinger, BP EPTG, July 2005.
+ */
+
+/*
+ * Machine-readable output for batch runs: one record per stiffness
+ * matrix, each record a list of named numbers (the "fields").
+ *
+ * Records can be written as
+ *	OUTPUT_CSV	a header line of field names, then one line of
+ *			comma-separated numbers per record;
+ *	OUTPUT_JSON	one JSON object per line, {"name":value,...};
+ *	OUTPUT_BINARY	no header, just the numbers of each record one after
+ *			the other as native-format doubles.
+ *
+ * Numbers are written at full precision, using format_double, and
+ * everything is collected in a large buffer that is written out in
+ * blocks, so formatting rather than printf sets the pace.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "cmat.h"
+
+#define OUT_BUFSIZE	65536
+
+/* The most characters one field of a record can take */
+#define OUT_FIELD_MAX	(OUTPUT_NAME_MAX + 40)
+
+static char     out_buf[OUT_BUFSIZE];
+static size_t   out_len;
+
+static int      out_format;
+static int      out_nfield;
+static int     *out_order;
+static const char **out_names;
+
+/*
+ * Write out the buffer.
+ */
+static void
+out_flush (void)
+{
+    fwrite (out_buf, 1, out_len, stdout);
+    out_len = 0;
+    return;
+}
+
+/*
+ * Make room for nn more characters.
+ */
+static void
+out_room (size_t nn)
+{
+    if (out_len + nn > OUT_BUFSIZE)
+	out_flush ();
+    return;
+}
+
+static void
+out_string (const char *string)
+{
+size_t          nn;
+
+    nn = strlen (string);
+    memcpy (out_buf + out_len, string, nn);
+    out_len += nn;
+    return;
+}
+
+/*
+ * Which of the output formats is called name? Return -1 if none is.
+ */
+int
+output_format (const char *name)
+{
+    if (strcmp (name, "text") == 0)
+	return OUTPUT_TEXT;
+    if (strcmp (name, "csv") == 0)
+	return OUTPUT_CSV;
+    if (strcmp (name, "json") == 0)
+	return OUTPUT_JSON;
+    if (strcmp (name, "binary") == 0)
+	return OUTPUT_BINARY;
+    return -1;
+}
+
+/*
+ * Choose fields to output.
+ *
+ * Input:
+ *	list is a comma-separated list of field names. A name can also be
+ *	the part of one or more names before a "_", to choose all of them:
+ *	"axis" for "axis_x,axis_y,axis_z", for example.
+ *	names gives the nfield names of the fields that can be output.
+ *
+ * Output:
+ *	order gives the index in names of each field chosen, in the order
+ *	they were listed. It must have room for OUTPUT_FIELDS_MAX.
+ *
+ * Return value:
+ *	The number of fields chosen (at least 1), or -1 if a name wasn't
+ *	recognized or too many were chosen (reported on standard error).
+ */
+int
+output_fields (const char *list, int nfield, const char **names, int *order)
+{
+const char     *cp, *end;
+size_t          len;
+int             ii, nchosen, found;
+
+    nchosen = 0;
+    for (cp = list; *cp != '\0'; cp = (*end == ',') ? end + 1 : end)
+    {
+	end = strchr (cp, ',');
+	if (end == (char *) 0)
+	    end = cp + strlen (cp);
+	len = (size_t) (end - cp);
+
+	found = 0;
+	for (ii = 0; ii < nfield; ii++)
+	{
+	    if (strncmp (names[ii], cp, len) != 0 ||
+		(names[ii][len] != '\0' && names[ii][len] != '_'))
+		continue;
+	    if (nchosen == OUTPUT_FIELDS_MAX)
+	    {
+		fprintf (stderr, "too many output fields\n");
+		return -1;
+	    }
+	    order[nchosen++] = ii;
+	    found = 1;
+	}
+
+	if (!found)
+	{
+	    fprintf (stderr, "unknown output field \"%.*s\"; choose from",
+		     (int) len, cp);
+	    for (ii = 0; ii < nfield; ii++)
+		fprintf (stderr, "%s %s", ii ? "," : "", names[ii]);
+	    fprintf (stderr, "\n");
+	    return -1;
+	}
+    }
+
+    if (nchosen == 0)
+    {
+	fprintf (stderr, "no output fields chosen\n");
+	return -1;
+    }
+
+    return nchosen;
+}
+
+/*
+ * Go on writing records to standard output, as for output_start, after
+ * the ones an earlier run wrote there (so without the header).
+ */
+void
+output_continue (int format, const char **names, int nchosen, int *order)
+{
+    out_format = format;
+    out_names = names;
+    out_nfield = nchosen;
+    out_order = order;
+    out_len = 0;
+
+    return;
+}
+
+/*
+ * Start writing records to standard output.
+ *
+ * Input:
+ *	format is OUTPUT_CSV, OUTPUT_JSON, or OUTPUT_BINARY.
+ *	names are the names of all the fields a record can have, and
+ *	order the indices of the nchosen of them to be written (see
+ *	output_fields). Both must stay around until output_finish.
+ */
+void
+output_start (int format, const char **names, int nchosen, int *order)
+{
+int             ii;
+
+    output_continue (format, names, nchosen, order);
+
+    if (format == OUTPUT_CSV)
+    {
+	for (ii = 0; ii < nchosen; ii++)
+	{
+	    out_room (OUT_FIELD_MAX);
+	    if (ii > 0)
+		out_buf[out_len++] = ',';
+	    out_string (names[order[ii]]);
+	}
+	out_buf[out_len++] = '\n';
+    }
+
+    return;
+}
+
+/*
+ * Write one record. values holds the value of every field in names, in
+ * that order; only the chosen ones are written.
+ */
+void
+output_record (double *values)
+{
+int             ii;
+double          value;
+
+    if (out_format == OUTPUT_BINARY)
+    {
+	for (ii = 0; ii < out_nfield; ii++)
+	{
+	    out_room (sizeof (double));
+	    memcpy (out_buf + out_len, &values[out_order[ii]], sizeof (double));
+	    out_len += sizeof (double);
+	}
+	return;
+    }
+
+    for (ii = 0; ii < out_nfield; ii++)
+    {
+	out_room (OUT_FIELD_MAX);
+	value = values[out_order[ii]];
+
+	if (out_format == OUTPUT_JSON)
+	{
+	    out_buf[out_len++] = (ii == 0) ? '{' : ',';
+	    out_buf[out_len++] = '"';
+	    out_string (out_names[out_order[ii]]);
+	    out_buf[out_len++] = '"';
+	    out_buf[out_len++] = ':';
+	    /* JSON has no infinities or NaNs. */
+	    if (value - value != 0.)
+	    {
+		out_string ("null");
+		continue;
+	    }
+	}
+	else if (ii > 0)
+	    out_buf[out_len++] = ',';
+
+	out_len += (size_t) format_double (out_buf + out_len, value);
+    }
+
+    out_room (2);
+    if (out_format == OUTPUT_JSON)
+	out_buf[out_len++] = '}';
+    out_buf[out_len++] = '\n';
+
+    return;
+}
+
+/*
+ * Write out anything still buffered.
+ */
+void
+output_finish (void)
+{
+    out_flush ();
+    fflush (stdout);
+    return;
+}